@@ -0,0 +1,278 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Live camera telemetry: reads the rings the CSI and ICI capture threads
+ * fill (see cam_telemetry.h) and prints frame rate, inter-frame jitter,
+ * dequeue and render latency once per interval. With -k it prints the
+ * software KPI markers (see kpi_marker.h) instead.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cam_telemetry.h"
+#include "kpi_marker.h"
+
+#define NS_PER_MS 1000000.0
+
+static const char *const sources[] = { "csi", "ici" };
+#define SOURCE_COUNT (sizeof(sources) / sizeof(sources[0]))
+
+struct ring_reader {
+	const char *source;
+	const struct cam_telemetry *t;
+	uint64_t next;		/* next record to read */
+	uint64_t prev_capture;	/* capture time of the last record read */
+};
+
+struct window_stats {
+	unsigned int frames, lost, torn, unrendered, lone, recovered;
+	uint64_t first_capture, last_capture;
+	double interval_sum, interval_sq, interval_max;
+	unsigned int intervals;
+	double dequeue_sum, dequeue_max;
+	double render_sum, render_max;
+	unsigned int rendered;
+};
+
+static volatile sig_atomic_t quit;
+
+static void on_signal(int signum)
+{
+	quit = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s csi|ici] [-i interval_ms] [-n reports] [-f] [-k]\n", name);
+	fprintf(stderr, "\t-s\tonly read this camera (default: every running one)\n");
+	fprintf(stderr, "\t-i\treport interval in ms (default: 1000)\n");
+	fprintf(stderr, "\t-n\tstop after this many reports (default: no limit)\n");
+	fprintf(stderr, "\t-f\talso print every frame\n");
+	fprintf(stderr, "\t-k\tprint the KPI markers recorded so far and exit\n");
+}
+
+/* Markers in the shared memory ring, times relative to boot */
+static int dump_markers(void)
+{
+	const struct kpi_marker_ring *r = kpi_marker_ring_attach();
+	struct kpi_marker_record rec;
+	uint64_t head, n, prev = 0;
+
+	if (!r) {
+		fprintf(stderr, "no KPI markers in %s\n", KPI_MARKER_SHM_PATH);
+		return 1;
+	}
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	n = head > KPI_MARKER_SLOTS ? head - KPI_MARKER_SLOTS : 0;
+	for (; n < head; n++) {
+		if (kpi_marker_read(r, n, &rec) < 0) {
+			printf("marker %llu lost\n", (unsigned long long) n);
+			continue;
+		}
+		printf("%10.3f ms  +%8.3f  %-24s id %u tid %d\n",
+				rec.boot_ns / NS_PER_MS,
+				prev ? (double) (int64_t) (rec.boot_ns - prev) / NS_PER_MS : 0,
+				rec.name, rec.id, rec.tid);
+		prev = rec.boot_ns;
+	}
+	munmap((void *) r, sizeof(*r));
+	return 0;
+}
+
+static void account(struct ring_reader *r, struct window_stats *w,
+		const struct cam_frame_record *rec, uint64_t n, int per_frame)
+{
+	double dequeue = (double) (int64_t) (rec->dequeue_ns - rec->capture_ns) / NS_PER_MS;
+	double render = rec->render_ns ?
+		(double) (int64_t) (rec->render_ns - rec->capture_ns) / NS_PER_MS : 0;
+
+	if (!w->frames)
+		w->first_capture = rec->capture_ns;
+	w->last_capture = rec->capture_ns;
+	w->frames++;
+
+	if (r->prev_capture && rec->capture_ns > r->prev_capture) {
+		double dt = (double) (rec->capture_ns - r->prev_capture) / NS_PER_MS;
+
+		w->interval_sum += dt;
+		w->interval_sq += dt * dt;
+		if (dt > w->interval_max)
+			w->interval_max = dt;
+		w->intervals++;
+	}
+	r->prev_capture = rec->capture_ns;
+
+	w->dequeue_sum += dequeue;
+	if (dequeue > w->dequeue_max)
+		w->dequeue_max = dequeue;
+	if (rec->render_ns) {
+		w->render_sum += render;
+		if (render > w->render_max)
+			w->render_max = render;
+		w->rendered++;
+	} else {
+		w->unrendered++;
+	}
+	if (rec->flags & CAM_FRAME_LONE_FIELD)
+		w->lone++;
+	if (rec->flags & CAM_FRAME_RECOVERED)
+		w->recovered++;
+
+	if (per_frame)
+		printf("%s frame %llu buf %u%s%s%s capture %.3f dequeue +%.3f render %s%.3f ms\n",
+				r->source, (unsigned long long) n, rec->buffer,
+				rec->flags & CAM_FRAME_BOTTOM ? " bottom" : "",
+				rec->flags & CAM_FRAME_LONE_FIELD ? " lone" : "",
+				rec->flags & CAM_FRAME_RECOVERED ? " recovered" : "",
+				rec->capture_ns / NS_PER_MS, dequeue,
+				rec->render_ns ? "+" : "-", render);
+}
+
+static void report(const struct ring_reader *r, const struct window_stats *w)
+{
+	double mean = w->intervals ? w->interval_sum / w->intervals : 0;
+	double var = w->intervals ? w->interval_sq / w->intervals - mean * mean : 0;
+	double fps = w->last_capture > w->first_capture ?
+		(w->frames - 1) * 1000.0 / ((w->last_capture - w->first_capture) / NS_PER_MS) : 0;
+
+	printf("%s %7.2f fps  interval %6.2f ms jitter %5.2f ms max %6.2f ms  "
+			"dequeue %5.2f/%5.2f ms  render %6.2f/%6.2f ms  "
+			"unrendered %u lone %u lost %u recovered %u\n",
+			r->source, fps, mean, var > 0 ? sqrt(var) : 0, w->interval_max,
+			w->frames ? w->dequeue_sum / w->frames : 0, w->dequeue_max,
+			w->rendered ? w->render_sum / w->rendered : 0, w->render_max,
+			w->unrendered, w->lone, w->lost + w->torn, w->recovered);
+	fflush(stdout);
+}
+
+static void poll_ring(struct ring_reader *r, int per_frame)
+{
+	struct window_stats w;
+	struct cam_frame_record rec;
+	uint64_t head, n;
+
+	if (!r->t) {
+		r->t = cam_telemetry_attach(r->source);
+		if (!r->t)
+			return;
+		r->next = __atomic_load_n(&r->t->head, __ATOMIC_ACQUIRE);
+		r->prev_capture = 0;
+	}
+	if (__atomic_load_n(&r->t->magic, __ATOMIC_ACQUIRE) != CAM_TELEMETRY_MAGIC)
+		return;
+
+	memset(&w, 0, sizeof(w));
+	head = __atomic_load_n(&r->t->head, __ATOMIC_ACQUIRE);
+	/* the writer restarted and recreated the ring */
+	if (head < r->next) {
+		r->next = 0;
+		r->prev_capture = 0;
+	}
+	if (head - r->next > CAM_TELEMETRY_SLOTS) {
+		w.lost = head - r->next - CAM_TELEMETRY_SLOTS;
+		r->next = head - CAM_TELEMETRY_SLOTS;
+	}
+
+	/* the newest frame may still be on its way to the screen */
+	for (n = r->next; n + 1 < head; n++) {
+		if (cam_telemetry_read(r->t, n, &rec) < 0) {
+			w.torn++;
+			continue;
+		}
+		account(r, &w, &rec, n, per_frame);
+	}
+	if (head)
+		r->next = head - 1 > r->next ? head - 1 : r->next;
+
+	if (w.frames || w.lost || w.torn)
+		report(r, &w);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ring_reader readers[SOURCE_COUNT];
+	unsigned int interval_ms = 1000, reports = 0, i, count = 0;
+	int per_frame = 0, opt, only = -1;
+
+	while ((opt = getopt(argc, argv, "s:i:n:fkh")) != -1) {
+		switch (opt) {
+		case 's':
+			for (i = 0; i < SOURCE_COUNT; i++)
+				if (!strcmp(optarg, sources[i]))
+					only = i;
+			if (only < 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'n':
+			reports = atoi(optarg);
+			break;
+		case 'f':
+			per_frame = 1;
+			break;
+		case 'k':
+			return dump_markers();
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!interval_ms) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	memset(readers, 0, sizeof(readers));
+	for (i = 0; i < SOURCE_COUNT; i++)
+		readers[i].source = sources[i];
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	while (!quit && (!reports || count < reports)) {
+		usleep(interval_ms * 1000);
+		for (i = 0; i < SOURCE_COUNT; i++) {
+			if (only < 0 || (int) i == only)
+				poll_ring(&readers[i], per_frame);
+		}
+		count++;
+	}
+
+	for (i = 0; i < SOURCE_COUNT; i++)
+		cam_telemetry_detach(readers[i].t);
+	return 0;
+}
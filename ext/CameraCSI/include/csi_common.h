@@ -36,15 +36,23 @@ enum render_type {
         RENDER_TYPE_WL,
         RENDER_TYPE_GL,
         RENDER_TYPE_GL_DMA,
+        RENDER_TYPE_SHM,
 };
 
 
+struct csi_buffer_pool;
+
 struct set_up {
         unsigned int ow, oh;
+        struct csi_buffer_pool *pool;	/* NULL to allocate per engagement */
+        unsigned int cpu_convert;	/* YUV to RGB on the CPU into wl_shm buffers */
+        unsigned int kms_preview;	/* scan out through KMS until the compositor is up */
 };
 
 int CsiStartDisplay(struct set_up, void*, int);
 void CsiStopDisplay(int);
+struct csi_buffer_pool *CsiCreateBufferPool(unsigned int buffer_count);
+void CsiDestroyBufferPool(struct csi_buffer_pool *pool);
 int ConfigureCSI(void);
 
 #endif
@@ -76,6 +76,11 @@
 #include <xf86drm.h>
 
 #include "csi_common.h"
+#include "cam_telemetry.h"
+#include "kms_presenter.h"
+#include "gl_program_cache.h"
+#include "yuv2rgb.h"
+#include "shm_frame.h"
 
 #define BATCH_SIZE 0x80000
 #define TARGET_NUM_SECONDS 5
@@ -83,8 +88,13 @@
 
 int m_CSIEnabled = 1;
 extern void GPIOControl_outputPattern(void*);
+extern void WaylandReady_wait(void);
+extern int WaylandReady_isReady(void);
+extern int WaylandReady_pollFd(void);
 void * g_gpioclass = NULL;
 static int g_triggeronce = 1;
+/* frame timing for earlyapp-camstat, kept for the life of the process */
+static struct cam_telemetry *csi_telemetry;
 
 /* UYVY */
 static const char *frag_shader_text_UYVY  =
@@ -198,8 +208,6 @@ PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 
-PFNGLPROGRAMBINARYOESPROC clr_glProgramBinaryOES = NULL;
-PFNGLGETPROGRAMBINARYOESPROC clr_glGetProgramBinaryOES = NULL;
 
 #define ARRAY_SIZE(a)   	(sizeof(a)/sizeof((a)[0]))
 #define OPT_STRIDE              263
@@ -258,6 +266,13 @@ struct setup {
         unsigned int mplane_type;
 };
 
+/* RENDER_TYPE_WL and RENDER_TYPE_SHM hand buffers straight to the compositor */
+static inline int render_uses_egl(const struct setup *s)
+{
+	return s->render_type == RENDER_TYPE_GL ||
+		s->render_type == RENDER_TYPE_GL_DMA;
+}
+
 struct v4l2_device {
 	const char *devname;
 	int fd;
@@ -289,6 +304,12 @@ static struct {
 	{ V4L2_BUF_TYPE_VIDEO_OVERLAY, 0, "Video overlay", "overlay" },
 };
 
+enum buffer_owner {
+	BUF_OWNER_DRIVER,	/* queued to the IPU */
+	BUF_OWNER_MAILBOX,	/* newest captured frame, not yet taken by redraw */
+	BUF_OWNER_DISPLAY	/* used for the frame on screen */
+};
+
 struct buffer {
 	drm_intel_bo *bo;
 	unsigned int index;
@@ -298,6 +319,42 @@ struct buffer {
 	uint32_t flink_name;
 	struct wl_buffer *buf;
 	EGLImageKHR khrImage;
+	int owner;		/* enum buffer_owner, only changed atomically */
+	int released;		/* wl_buffer.release seen while still on screen */
+	uint64_t capture_ns;	/* driver timestamp of the frame it holds */
+	uint64_t frame_id;	/* telemetry record of that frame */
+};
+
+/* Latest-frame mailbox between the polling thread and redraw. Capture posts
+ * its newest buffer, redraw swaps it out; a frame replaced before redraw
+ * took it goes straight back to the IPU. */
+struct mailbox {
+	struct buffer *pending;	/* exchanged atomically by both threads */
+	struct buffer *shown;	/* redraw only */
+};
+
+/* Why the watchdog restarted the stream */
+enum watchdog_reason {
+	WATCHDOG_NONE,
+	WATCHDOG_STALL,		/* no frame within WATCHDOG_STALL_FRAMES periods */
+	WATCHDOG_IPU_ERROR,	/* POLLERR on the video node */
+	WATCHDOG_QBUF,		/* a buffer could not be handed back */
+};
+
+static const char *const watchdog_reasons[] = {
+	"none", "stall", "IPU error", "QBUF failure"
+};
+
+/* Capture supervisor, run from the polling thread */
+struct watchdog {
+	pthread_mutex_t qbuf_lock;	/* QBUF against a stream restart */
+	int request;			/* enum watchdog_reason, any thread */
+	uint64_t frame_period_ns;	/* running estimate */
+	uint64_t last_frame_ns;		/* 0 until the stream delivered */
+	unsigned int unanswered;	/* restarts with no frame since */
+	int flag_next;			/* telemetry flag for the next frame */
+	unsigned int recoveries;
+	double last_recovery_ms, max_recovery_ms;
 };
 
 struct output {
@@ -314,6 +371,8 @@ struct display {
 	struct wl_shell *wl_shell;
 	struct ivi_application *ivi_application;
 	struct wl_drm *wl_drm;
+	struct wl_shm *shm;
+	struct shm_buffer shm_buffers[2];
 	struct window *window;
 	struct wl_list output_list;
 	int	   fd;
@@ -321,6 +380,9 @@ struct display {
 	struct buffer *buffers;
 	struct v4l2_device *v4l2;
 	struct setup *s;
+	struct mailbox mb_top, mb_bottom;
+	unsigned int frames_shown, frames_dropped;
+	struct watchdog watchdog;
 	struct {
 		EGLDisplay dpy;
 		EGLContext ctx;
@@ -376,6 +438,9 @@ struct time_measurements
 {
 	struct timespec app_start_time;
 	struct timespec before_md_init_time;
+	struct timespec md_enum_time;
+	struct timespec md_chain_time[4];
+	struct timespec md_fmt_time;
 	struct timespec md_init_time;
 	struct timespec weston_init_time;
 	struct timespec v4l2_init_time;
@@ -446,6 +511,13 @@ void print_csi_time_measurements()
 	printf("%-25s | %-10s | %-6s\n", "Tracepoint", "System ts", "Time since app start");
 
 	print_time_measurement("App start", time_measurements.app_start_time, time_measurements.app_start_time);
+	print_time_measurement("Media ctl enumerate", time_measurements.before_md_init_time, time_measurements.md_enum_time);
+	print_time_measurement(" BE SOC formats", time_measurements.md_enum_time, time_measurements.md_chain_time[0]);
+	print_time_measurement(" CSI-2 formats", time_measurements.md_enum_time, time_measurements.md_chain_time[1]);
+	print_time_measurement(" Pixel array formats", time_measurements.md_enum_time, time_measurements.md_chain_time[2]);
+	print_time_measurement(" Binner formats", time_measurements.md_enum_time, time_measurements.md_chain_time[3]);
+	print_time_measurement("Media ctl formats", time_measurements.md_enum_time, time_measurements.md_fmt_time);
+	print_time_measurement("Media ctl links", time_measurements.md_fmt_time, time_measurements.md_init_time);
 	print_time_measurement("Media ctl setup", time_measurements.app_start_time, time_measurements.md_init_time);
 	print_time_measurement("V4L2 setup", time_measurements.app_start_time, time_measurements.v4l2_init_time);
 	print_time_measurement("IPU streamon", time_measurements.app_start_time, time_measurements.streamon_time);
@@ -461,8 +533,6 @@ int first_csi_frame_rendered = 0;
 
 static int running = 1;
 static int error_recovery = 0;
-struct buffer *cur_top_buffer = NULL;
-struct buffer *cur_bottom_buffer = NULL;
 struct wl_display *csi_display_connection = NULL;
 
 static struct output *
@@ -479,32 +549,6 @@ get_default_output(struct display *display)
 	return NULL;
 }
 
-static GLuint
-create_shader(struct window *window, const char *source, GLenum shader_type)
-{
-	GLuint shader;
-	GLint status;
-
-	shader = glCreateShader(shader_type);
-	assert(shader != 0);
-
-	glShaderSource(shader, 1, (const char **) &source, NULL);
-	glCompileShader(shader);
-
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-	if (!status) {
-		char log[1000];
-		GLsizei len;
-		glGetShaderInfoLog(shader, 1000, &len, log);
-		fprintf(stderr, "Error: compiling %s: %*s\n",
-				shader_type == GL_VERTEX_SHADER ? "vertex" : "fragment",
-				len, log);
-		exit(1);
-	}
-
-	return shader;
-}
-
 static void
 handle_ping(void *data, struct wl_shell_surface *shell_surface,
 		uint32_t serial)
@@ -644,7 +688,7 @@ destroy_surface(struct window *window)
 {
 	struct display *display = window->display;
 
-	if (display->s->render_type != RENDER_TYPE_WL) {
+	if (render_uses_egl(display->s)) {
 		/* Required, otherwise segfault in egl_dri2.c: dri2_make_current()
 		 * on eglReleaseThread(). */
 		eglMakeCurrent(window->display->egl.dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
@@ -698,7 +742,7 @@ update_fps(struct window *window)
 	}
 }
 
-static void v4l2_queue_buffer(struct v4l2_device *dev, const struct buffer *buffer)
+static int v4l2_queue_buffer(struct v4l2_device *dev, const struct buffer *buffer)
 {
 	struct v4l2_buffer buf;
 	int ret;
@@ -722,10 +766,7 @@ static void v4l2_queue_buffer(struct v4l2_device *dev, const struct buffer *buff
 	buf.index = buffer->index;
 
 	ret = ioctl(dev->fd, VIDIOC_QBUF, &buf);
-	if (ret) {
-		error_recovery = 1;
-		signal_int(0);
-	}
+	return ret ? -1 : 0;
 }
 
 static struct buffer *v4l2_dequeue_buffer(struct v4l2_device *dev, struct buffer *buffers)
@@ -756,10 +797,102 @@ static struct buffer *v4l2_dequeue_buffer(struct v4l2_device *dev, struct buffer
 	} else {
 		buffers[buf.index].field_type = FIELD_TYPE_NONE;
 	}
+	buffers[buf.index].capture_ns = cam_telemetry_tv_ns(&buf.timestamp);
 
 	return &buffers[buf.index];
 }
 
+static int buffer_set_owner(struct buffer *buf, int from, int to)
+{
+	return __atomic_compare_exchange_n(&buf->owner, &from, to, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void watchdog_kick(struct display *display, enum watchdog_reason reason)
+{
+	int none = WATCHDOG_NONE;
+
+	__atomic_compare_exchange_n(&display->watchdog.request, &none, reason, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/* Hands a buffer back to the IPU, at most once per capture */
+static void buffer_requeue(struct display *display, struct buffer *buf, int from)
+{
+	pthread_mutex_lock(&display->watchdog.qbuf_lock);
+	/* a failed one stays with the driver, the watchdog queues it again */
+	if (buffer_set_owner(buf, from, BUF_OWNER_DRIVER) &&
+			v4l2_queue_buffer(display->v4l2, buf) < 0)
+		watchdog_kick(display, WATCHDOG_QBUF);
+	pthread_mutex_unlock(&display->watchdog.qbuf_lock);
+}
+
+static void mailbox_post(struct display *display, struct mailbox *mb, struct buffer *buf)
+{
+	struct buffer *old;
+
+	buffer_set_owner(buf, BUF_OWNER_DRIVER, BUF_OWNER_MAILBOX);
+	old = __atomic_exchange_n(&mb->pending, buf, __ATOMIC_ACQ_REL);
+	if (old) {
+		__atomic_add_fetch(&display->frames_dropped, 1, __ATOMIC_RELAXED);
+		buffer_requeue(display, old, BUF_OWNER_MAILBOX);
+	}
+}
+
+/* Returns the previously shown buffer if a newer frame replaced it */
+static struct buffer *mailbox_take(struct display *display, struct mailbox *mb)
+{
+	struct buffer *prev;
+	struct buffer *buf = __atomic_exchange_n(&mb->pending, NULL, __ATOMIC_ACQ_REL);
+
+	if (!buf)
+		return NULL;
+
+	buffer_set_owner(buf, BUF_OWNER_MAILBOX, BUF_OWNER_DISPLAY);
+	__atomic_add_fetch(&display->frames_shown, 1, __ATOMIC_RELAXED);
+	buf->released = 0;
+	prev = mb->shown;
+	mb->shown = buf;
+	return prev;
+}
+
+/* Only called while the polling thread is not running */
+static void mailbox_reset(struct display *display)
+{
+	unsigned int i;
+
+	memset(&display->mb_top, 0, sizeof(display->mb_top));
+	memset(&display->mb_bottom, 0, sizeof(display->mb_bottom));
+	for (i = 0; i < display->s->buffer_count; i++) {
+		display->buffers[i].owner = BUF_OWNER_DRIVER;
+		display->buffers[i].released = 0;
+	}
+}
+
+static void
+buffer_release(void *data, struct wl_buffer *wl_buf)
+{
+	struct display *display = data;
+	unsigned int i;
+
+	for (i = 0; i < display->s->buffer_count; i++) {
+		struct buffer *buf = &display->buffers[i];
+
+		if (buf->buf != wl_buf)
+			continue;
+		/* still on screen, handed back once redraw replaces it */
+		if (buf == display->mb_top.shown)
+			buf->released = 1;
+		else
+			buffer_requeue(display, buf, BUF_OWNER_DISPLAY);
+		return;
+	}
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	buffer_release
+};
+
 static void make_orth_matrix(GLfloat *data, GLfloat left, GLfloat right,
 		GLfloat bottom, GLfloat top,
 		GLfloat znear, GLfloat zfar)
@@ -791,6 +924,36 @@ static void redraw_wl_way(struct window *window, struct wl_buffer *buf, uint32_t
 	}
 }
 
+static void redraw_shm_way(struct window *window, unsigned char *start_top,
+		unsigned char *start_bottom)
+{
+	struct display *display = window->display;
+	struct setup *s = display->s;
+	struct yuv_image top = { 0 }, bottom;
+
+	top.format = s->in_fourcc == V4L2_MBUS_FMT_YUYV8_1X16
+		? YUV_FORMAT_YUYV : YUV_FORMAT_UYVY;
+	top.plane[0] = start_top;
+	top.pitch[0] = s->iw * 2;
+	top.width = s->iw;
+	top.height = s->ih;
+	bottom = top;
+	bottom.plane[0] = start_bottom;
+
+	if (shm_frame_present(window->surface, display->shm_buffers, &top,
+				s->interlaced ? &bottom : NULL, s->ow, s->oh) < 0)
+		return;
+
+	if(g_triggeronce && g_gpioclass)
+		GPIOControl_outputPattern(g_gpioclass);
+
+	if (first_csi_frame_received == 1 && first_csi_frame_rendered == 0) {
+		first_csi_frame_rendered = 1;
+		GET_TS(time_measurements.first_frame_rendered_time);
+		print_time_measurements();
+	}
+}
+
 static void redraw_egl_way(struct window *window, struct buffer *top_buf,
 		struct buffer *bottom_buf, unsigned char *start_top, unsigned char *start_bottom)
 {
@@ -864,13 +1027,19 @@ static void
 redraw(void *data, struct wl_callback *callback, uint32_t time)
 {
 	struct window *window = data;
-	struct buffer * buf_top = (cur_top_buffer)
-		? cur_top_buffer
-		: &(window->display->buffers[0]);
+	struct display *display = window->display;
+	struct buffer *old_top = display->mb_top.shown;
+	struct buffer *old_bottom = display->mb_bottom.shown;
+	struct buffer *prev_top = mailbox_take(display, &display->mb_top);
+	struct buffer *prev_bottom = mailbox_take(display, &display->mb_bottom);
+
+	struct buffer * buf_top = (display->mb_top.shown)
+		? display->mb_top.shown
+		: &(display->buffers[0]);
 
-	struct buffer * buf_bottom = (cur_bottom_buffer)
-		? cur_bottom_buffer
-		: &(window->display->buffers[0]);
+	struct buffer * buf_bottom = (display->mb_bottom.shown)
+		? display->mb_bottom.shown
+		: &(display->buffers[0]);
 
 	unsigned char *start_top;
 	unsigned char *start_bottom;
@@ -888,9 +1057,174 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 
 	if (window->display->s->render_type == RENDER_TYPE_WL) {
 		redraw_wl_way(window, buf_top->buf, time);
+		/* the compositor already let go of it while it was on screen */
+		if (prev_top && prev_top->released)
+			buffer_requeue(display, prev_top, BUF_OWNER_DISPLAY);
+		/* bottom fields are never attached on this path */
+		if (prev_bottom)
+			buffer_requeue(display, prev_bottom, BUF_OWNER_DISPLAY);
+	} else if (window->display->s->render_type == RENDER_TYPE_SHM) {
+		redraw_shm_way(window, start_top, start_bottom);
+		/* copied out by the conversion, the IPU can have them back */
+		if (prev_top)
+			buffer_requeue(display, prev_top, BUF_OWNER_DISPLAY);
+		if (prev_bottom)
+			buffer_requeue(display, prev_bottom, BUF_OWNER_DISPLAY);
 	} else {
 		redraw_egl_way(window, buf_top, buf_bottom, start_top, start_bottom);
+		/* sampled by the previous frame, which completed before this callback */
+		if (prev_top)
+			buffer_requeue(display, prev_top, BUF_OWNER_DISPLAY);
+		if (prev_bottom)
+			buffer_requeue(display, prev_bottom, BUF_OWNER_DISPLAY);
 	}
+
+	if (display->mb_top.shown != old_top)
+		cam_telemetry_render(csi_telemetry, display->mb_top.shown->frame_id);
+	if (display->mb_bottom.shown != old_bottom)
+		cam_telemetry_render(csi_telemetry, display->mb_bottom.shown->frame_id);
+}
+
+/*
+ * KMS preview handover. The file exists while the preview holds DRM
+ * master; the compositor unit writes to it before starting and waits for
+ * it to disappear, which happens once master has been dropped.
+ */
+#define KMS_HANDOVER_FILE	"/run/earlyapp-kms-master"
+/* how long the last preview frame waits for the compositor's first one */
+#define KMS_HANDOVER_TIMEOUT_MS	2000
+
+static int kms_handover_requested(int fd)
+{
+	struct stat st;
+
+	return fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0;
+}
+
+/*
+ * Before the compositor is up, frames are converted on the CPU into dumb
+ * buffers on the primary plane. DRM master is held until the compositor
+ * asks for it through KMS_HANDOVER_FILE (or its socket shows up without
+ * asking); the last frame then stays on screen until the compositor has
+ * put up its own.
+ */
+static void kms_preview(struct display *display)
+{
+	struct setup *s = display->s;
+	struct kms_presenter kms;
+	struct yuv_image top = { 0 }, bottom;
+	struct rgb_image dst;
+	unsigned int frames = 0;
+	struct pollfd wl_pfd;
+	int handover_fd, wayland_up = 0;
+	int ret = 0;
+
+	if (WARN_ON(s->in_fourcc != V4L2_MBUS_FMT_UYVY8_1X16 &&
+				s->in_fourcc != V4L2_MBUS_FMT_YUYV8_1X16,
+				"KMS preview needs UYVY or YUYV input\n"))
+		return;
+	if (WARN_ON(kms_presenter_open(&kms, display->fd) < 0,
+				"KMS preview disabled\n"))
+		return;
+	if (kms_presenter_acquire(&kms) == KMS_HANDED_OVER) {
+		printf("KMS preview skipped, the compositor holds DRM master\n");
+		kms_presenter_close(&kms);
+		return;
+	}
+	handover_fd = open(KMS_HANDOVER_FILE, O_RDWR | O_CREAT | O_TRUNC |
+			O_CLOEXEC, 0600);
+	WARN_ON(handover_fd < 0, "Cannot create %s: %s\n", KMS_HANDOVER_FILE,
+			ERRSTR);
+
+	top.format = s->in_fourcc == V4L2_MBUS_FMT_YUYV8_1X16
+		? YUV_FORMAT_YUYV : YUV_FORMAT_UYVY;
+	top.pitch[0] = s->iw * 2;
+	top.width = s->iw;
+	top.height = s->ih;
+	dst.width = kms.width;
+	dst.height = kms.height;
+	/* wakes up on changes to the socket directory; isReady() reads the
+	 * watch and only connects to the socket after one */
+	wl_pfd.fd = WaylandReady_pollFd();
+	wl_pfd.events = POLLIN;
+	wayland_up = WaylandReady_isReady();
+
+	while (running && ret == 0 && !kms_handover_requested(handover_fd) &&
+			!wayland_up) {
+		struct buffer *old_top = display->mb_top.shown;
+		struct buffer *old_bottom = display->mb_bottom.shown;
+		struct buffer *prev_top, *prev_bottom;
+		struct kms_buffer *fb;
+
+		if (!__atomic_load_n(&display->mb_top.pending, __ATOMIC_ACQUIRE) &&
+		    !__atomic_load_n(&display->mb_bottom.pending, __ATOMIC_ACQUIRE)) {
+			/* doubles as the 1 ms wait for the next frame */
+			poll(&wl_pfd, 1, 1);
+			wayland_up = WaylandReady_isReady();
+			continue;
+		}
+		prev_top = mailbox_take(display, &display->mb_top);
+		prev_bottom = mailbox_take(display, &display->mb_bottom);
+		if (!display->mb_top.shown)
+			continue;
+
+		/* the back buffer is the one the last flip took off screen */
+		kms_presenter_wait(&kms, KMS_FLIP_TIMEOUT_MS);
+		fb = kms_presenter_back(&kms);
+		top.plane[0] = display->mb_top.shown->bo->virtual;
+		bottom = top;
+		if (display->mb_bottom.shown)
+			bottom.plane[0] = display->mb_bottom.shown->bo->virtual;
+		dst.pixels = (uint32_t *) fb->map;
+		dst.pitch = fb->pitch;
+
+		if (!WARN_ON(yuv_to_xrgb(&top, s->interlaced && display->mb_bottom.shown
+						? &bottom : NULL, &dst) < 0,
+					"YUV to RGB conversion failed\n"))
+			ret = kms_presenter_present(&kms);
+
+		/* copied out by the conversion, the IPU can have them back */
+		if (prev_top)
+			buffer_requeue(display, prev_top, BUF_OWNER_DISPLAY);
+		if (prev_bottom)
+			buffer_requeue(display, prev_bottom, BUF_OWNER_DISPLAY);
+		if (ret != 0)
+			break;
+
+		frames++;
+		if (display->mb_top.shown != old_top)
+			cam_telemetry_render(csi_telemetry, display->mb_top.shown->frame_id);
+		if (display->mb_bottom.shown && display->mb_bottom.shown != old_bottom)
+			cam_telemetry_render(csi_telemetry, display->mb_bottom.shown->frame_id);
+
+		if(g_triggeronce && g_gpioclass)
+			GPIOControl_outputPattern(g_gpioclass);
+
+		if (first_csi_frame_received == 1 && first_csi_frame_rendered == 0) {
+			first_csi_frame_rendered = 1;
+			GET_TS(time_measurements.first_frame_rendered_time);
+			print_time_measurements();
+		}
+	}
+
+	kms_presenter_release(&kms);
+	if (handover_fd >= 0) {
+		unlink(KMS_HANDOVER_FILE);
+		close(handover_fd);
+	}
+	printf("KMS preview showed %u frames, %s\n", frames,
+			ret == KMS_HANDED_OVER ? "compositor took over" :
+			ret < 0 ? "scanout failed" : "handed over to the compositor");
+
+	/* frames keep flowing through the mailbox meanwhile */
+	if (ret == 0 && frames &&
+			kms_presenter_replaced(&kms, KMS_HANDOVER_TIMEOUT_MS) < 0)
+		printf("KMS preview: no compositor frame after %d ms\n",
+				KMS_HANDOVER_TIMEOUT_MS);
+	kms_presenter_close(&kms);
+	/* never attached, redraw may hand it back as soon as it is replaced */
+	if (display->mb_top.shown)
+		display->mb_top.shown->released = 1;
 }
 
 static const struct wl_callback_listener frame_listener = {
@@ -943,6 +1277,9 @@ registry_handle_global(void *data, struct wl_registry *registry,
 	} else if (!strcmp(interface, "wl_drm")) {
 		d->wl_drm =
 			wl_registry_bind(registry, name, &wl_drm_interface, 1);
+	} else if (!strcmp(interface, "wl_shm")) {
+		d->shm =
+			wl_registry_bind(registry, name, &wl_shm_interface, 1);
 	}
 }
 
@@ -1128,52 +1465,9 @@ struct v4l2_subdev_routing {
 #define VIDIOC_SUBDEV_G_ROUTING                        _IOWR('V', 38, struct v4l2_subdev_routing)
 #define VIDIOC_SUBDEV_S_ROUTING                        _IOWR('V', 39, struct v4l2_subdev_routing)
 
-char* find_entity(struct media_device* md, const char* entity_name)
-{
-	struct media_entity *entity = NULL;
-	const struct media_entity_desc *entity_desc = NULL;
-	int entities_count = media_get_entities_count(md);
-	int i;
-	char *full_entity_name;
-
-	for (i = 0; i < entities_count; i++) {
-		entity = media_get_entity(md, i);
-		entity_desc = media_entity_get_info(entity);
-		if (strncmp(entity_name, entity_desc->name, strlen(entity_name)) == 0) {
-			full_entity_name = strdup(entity_desc->name);
-			return full_entity_name;
-		}
-	}
-	return NULL;
-}
-
-const char* get_entity_devname(struct media_device* md, const char* entity_name)
+static int subdev_set_fmt(int fd, unsigned int width, unsigned int height, int fmt, int interlaced, unsigned int pad)
 {
-	struct media_entity * entity = NULL;
-	entity = media_get_entity_by_name(md, entity_name);
-	if (!entity) {
-		printf("Cannot find entity %s\n", entity_name);
-		return NULL;
-	}
-	return media_entity_get_devname(entity);
-}
-
-int set_fmt(struct media_device* md, const char* entity_name, unsigned int width, unsigned int height, int fmt, int interlaced, unsigned int pad)
-{
-	struct media_entity * entity = NULL;
 	int ret;
-	entity = media_get_entity_by_name(md, entity_name);
-	if (!entity) {
-		printf("Cannot find entity %s\n", entity_name);
-		return -1;
-	}
-
-	entity->fd = open(entity->devname, O_RDWR);
-	if (entity->fd < 0) {
-		printf("Cannot open subdev\n");
-		return -1;
-	}
-
 	struct v4l2_mbus_framefmt format;
 	struct v4l2_subdev_format subdev_fmt;
 	memset(&format, 0 , sizeof(format));
@@ -1189,14 +1483,12 @@ int set_fmt(struct media_device* md, const char* entity_name, unsigned int width
 	subdev_fmt.pad = pad;
 	subdev_fmt.which = V4L2_SUBDEV_FORMAT_ACTIVE;
 	subdev_fmt.format = format;
-	ret = ioctl(entity->fd, VIDIOC_SUBDEV_S_FMT, &subdev_fmt);
+	ret = ioctl(fd, VIDIOC_SUBDEV_S_FMT, &subdev_fmt);
 	if (ret < 0) {
 		printf("Cannot set format %d\n", ret);
 		return -1;
 	}
 
-	format = subdev_fmt.format;
-	close(entity->fd);
 	return 0;
 }
 
@@ -1230,23 +1522,9 @@ int set_ctrl(struct media_device *md, const char* entity_name, int ctrl_id, int
 
 }
 
-int setup_routing(struct media_device *md, const char* entity_name)
+static int subdev_set_routing(int subdev_fd)
 {
 	int ret;
-	struct media_entity * entity = NULL;
-	entity = media_get_entity_by_name(md, entity_name);
-	if (!entity) {
-		printf("Cannot find entity %s\n", entity_name);
-		return -1;
-	}
-
-	const char* subdev_node = media_entity_get_devname(entity);
-	int subdev_fd = open(subdev_node, O_RDWR);
-	if (subdev_fd < 0) {
-		printf("Cannot open subdev\n");
-		return -1;
-	}
-
 	struct v4l2_subdev_routing routing;
 	struct v4l2_subdev_route route[2];
 
@@ -1268,31 +1546,15 @@ int setup_routing(struct media_device *md, const char* entity_name)
 	ret = ioctl(subdev_fd, VIDIOC_SUBDEV_S_ROUTING, &routing);
 	if (ret < -1) {
 		printf("unable to set routing %s %d\n", strerror(ret), ret);
-		close(subdev_fd);
 		return -1;
 	}
 
-	close(subdev_fd);
 	return 0;
 }
 
-int set_compose(struct media_device *md, const char* entity_name, int width, int height, int pad)
+static int subdev_set_compose(int subdev_fd, int width, int height, int pad)
 {
-	struct media_entity * entity = NULL;
 	int ret;
-	entity = media_get_entity_by_name(md, entity_name);
-	if (!entity) {
-		printf("Cannot find entity %s\n", entity_name);
-		return -1;
-	}
-
-	const char* subdev_node = media_entity_get_devname(entity);
-	int subdev_fd = open(subdev_node, O_RDWR);
-	if (subdev_fd < 0) {
-		printf("Cannot open subdev\n");
-		return -1;
-	}
-
 	struct v4l2_rect rect;
 	struct v4l2_subdev_selection sel;
 	rect.left = 0;
@@ -1313,42 +1575,26 @@ int set_compose(struct media_device *md, const char* entity_name, int width, int
 		printf("Cannot set crop\n");
 		return -1;
 	}
-	rect = sel.r;
 
-	close(subdev_fd);
 	return 0;
 }
 
-int setup_link(struct media_device* md, const char* source_entity_name, int source_pad_number,
-		const char* sink_entity_name, int sink_pad_number,
+static int setup_entity_link(struct media_device* md, struct media_entity *source_entity, int source_pad_number,
+		struct media_entity *sink_entity, int sink_pad_number,
 		int flags)
 {
-	struct media_entity * source_entity = NULL;
-	struct media_entity * sink_entity = NULL;
 	struct media_pad* source_pad = NULL;
 	struct media_pad* sink_pad = NULL;
 
-	source_entity = media_get_entity_by_name(md, source_entity_name);
-	if (!source_entity) {
-		printf("Cannot find entity %s\n", source_entity_name);
-		return -1;
-	}
-
 	source_pad = (struct media_pad*)media_entity_get_pad(source_entity, source_pad_number);
 	if (!source_pad) {
-		printf("Cannot find pad %d of entity %s\n", source_pad_number, source_entity_name);
-		return -1;
-	}
-
-	sink_entity = media_get_entity_by_name(md, sink_entity_name);
-	if (!sink_entity) {
-		printf("Cannot find entity %s\n", sink_entity_name);
+		printf("Cannot find pad %d of entity %s\n", source_pad_number, source_entity->info.name);
 		return -1;
 	}
 
 	sink_pad = (struct media_pad*)media_entity_get_pad(sink_entity, sink_pad_number);
 	if (!sink_pad) {
-		printf("Cannot find pad %d of entity %s\n", sink_pad_number, sink_entity_name);
+		printf("Cannot find pad %d of entity %s\n", sink_pad_number, sink_entity->info.name);
 		return -1;
 	}
 
@@ -1360,72 +1606,213 @@ int setup_link(struct media_device* md, const char* source_entity_name, int sour
 	return 0;
 }
 
-static int media_controller_init(struct setup* s)
-{
-	int ret;
-	struct media_device* md = NULL;
-	md = media_device_new("/dev/media0");
-	BYE_ON(!md, "Cannot create media device\n");
-
-	ret = media_device_enumerate(md);
-	BYE_ON(ret, "Cannot enumerate media device\n");
-
-	char* adv_pa = NULL;
-	char* adv_binner = NULL;
-	const char* ipu4_csi = "Intel IPU4 CSI-2 4";
-
-	ret = setup_routing(md, "Intel IPU4 CSI2 BE SOC");
-	BYE_ON(ret, "Cannot setup routing\n");
+/* Entities of the ADV7481 CVBS -> IPU4 graph, resolved in one enumeration pass */
+enum md_entity_idx {
+	MD_ENT_BE_SOC,
+	MD_ENT_CSI,
+	MD_ENT_ADV_PA,
+	MD_ENT_ADV_BINNER,
+	MD_ENT_CAPTURE,
+	MD_ENT_COUNT
+};
 
-	adv_pa = find_entity(md, "adv7481-cvbs pixel array a");
-	adv_binner = find_entity(md, "adv7481-cvbs binner a");
-	
-	BYE_ON((adv_pa == NULL || adv_binner == NULL), "Cannot find pixel array and binner entities\n");
+static const struct {
+	const char *name;
+	int prefix;	/* adv7481 entity names carry the i2c address */
+} md_entity_names[MD_ENT_COUNT] = {
+	[MD_ENT_BE_SOC]		= { "Intel IPU4 CSI2 BE SOC", 0 },
+	[MD_ENT_CSI]		= { "Intel IPU4 CSI-2 4", 0 },
+	[MD_ENT_ADV_PA]		= { "adv7481-cvbs pixel array a", 1 },
+	[MD_ENT_ADV_BINNER]	= { "adv7481-cvbs binner a", 1 },
+	[MD_ENT_CAPTURE]	= { "Intel IPU4 BE SOC capture 0", 0 },
+};
 
-	ret = set_fmt(md, ipu4_csi, 720, 240, s->in_fourcc, s->interlaced, 0);
-	//ret = set_fmt(md, ipu4_csi, s->iw, s->ih, s->in_fourcc, s->interlaced, 0);
-	BYE_ON(ret, "Cannot set format for entity %s[%d]\n", ipu4_csi, 0);
+static int md_index_entities(struct media_device *md, struct media_entity **index)
+{
+	unsigned int count = media_get_entities_count(md);
+	unsigned int i;
+	int e, found = 0;
+
+	memset(index, 0, sizeof(*index) * MD_ENT_COUNT);
+	for (i = 0; i < count && found < MD_ENT_COUNT; i++) {
+		struct media_entity *entity = media_get_entity(md, i);
+		const char *name = media_entity_get_info(entity)->name;
+
+		for (e = 0; e < MD_ENT_COUNT; e++) {
+			if (index[e])
+				continue;
+			if (md_entity_names[e].prefix
+					? strncmp(name, md_entity_names[e].name, strlen(md_entity_names[e].name))
+					: strcmp(name, md_entity_names[e].name))
+				continue;
+			index[e] = entity;
+			found++;
+			break;
+		}
+	}
 
-	ret = set_fmt(md, adv_pa, 720, 288, s->in_fourcc, s->interlaced, 0);
-	//ret = set_fmt(md, adv_pa, s->iw, s->ih, s->in_fourcc, s->interlaced, 0);
-	BYE_ON(ret, "Cannot set format for entity %s[%d]\n", adv_pa, 0);
+	for (e = 0; e < MD_ENT_COUNT; e++) {
+		if (!index[e]) {
+			printf("Cannot find entity %s\n", md_entity_names[e].name);
+			return -1;
+		}
+	}
+	return 0;
+}
 
-	ret = set_fmt(md, adv_binner, 720, 288, s->in_fourcc, s->interlaced, 0);
-	//ret = set_fmt(md, adv_binner, s->iw, s->ih, s->in_fourcc, s->interlaced, 0);
-	BYE_ON(ret, "Cannot set format for entity %s[%d]\n", adv_binner, 0);
+enum md_step_type {
+	MD_STEP_ROUTING,
+	MD_STEP_FMT,
+	MD_STEP_COMPOSE
+};
 
-	ret = set_fmt(md, "Intel IPU4 CSI2 BE SOC", 720, 240, s->in_fourcc, s->interlaced,  0);
-	BYE_ON(ret, "Cannot set format for entity Intel IPU4 CSI2 BE SOC[0]\n");
+struct md_step {
+	enum md_step_type type;
+	unsigned int width, height;
+	unsigned int pad;
+};
 
-	ret = set_fmt(md, "Intel IPU4 CSI2 BE SOC", 720, 240, s->in_fourcc, s->interlaced,  8);
-	BYE_ON(ret, "Cannot set format for entity Intel IPU4 CSI2 BE SOC[8]\n");
+/* Steps on one sub-device, applied in order. Chains on different
+ * sub-devices do not depend on each other and run concurrently. */
+struct md_chain {
+	struct media_entity *entity;
+	struct md_step steps[3];
+	int count;
+	int fourcc, interlaced;
+	struct timespec *done;
+	int ret;
+};
 
-	ret = set_compose(md, adv_binner, s->iw, s->ih, 0);
-	BYE_ON(ret, "Cannot set compose for entity %s[%d]\n", adv_binner, 0);
+static void *md_chain_thread(void *data)
+{
+	struct md_chain *chain = data;
+	const char *name = chain->entity->info.name;
+	int fd, i;
+
+	chain->ret = -1;
+	fd = open(media_entity_get_devname(chain->entity), O_RDWR);
+	if (fd < 0) {
+		printf("Cannot open subdev %s\n", name);
+		return NULL;
+	}
 
-	ret = set_fmt(md, adv_binner, s->iw, s->ih, s->in_fourcc, s->interlaced, 1); 
-	BYE_ON(ret, "Cannot set format for entity %s[%d]\n", adv_binner, 1);
+	for (i = 0; i < chain->count; i++) {
+		struct md_step *step = &chain->steps[i];
+		int ret = 0;
+
+		switch (step->type) {
+		case MD_STEP_ROUTING:
+			ret = subdev_set_routing(fd);
+			break;
+		case MD_STEP_FMT:
+			ret = subdev_set_fmt(fd, step->width, step->height,
+					chain->fourcc, chain->interlaced, step->pad);
+			break;
+		case MD_STEP_COMPOSE:
+			ret = subdev_set_compose(fd, step->width, step->height, step->pad);
+			break;
+		}
+		if (WARN_ON(ret, "%s: step %d on pad %u failed\n", name, i, step->pad)) {
+			close(fd);
+			return NULL;
+		}
+	}
 
+	close(fd);
+	GET_TS(*chain->done);
+	chain->ret = 0;
+	return NULL;
+}
 
-	ret = setup_link(md, adv_pa, 0, adv_binner, 0, 0);
-	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n", adv_pa, 0, adv_binner, 0);
+static int media_controller_init(struct setup* s)
+{
+	int ret, i, started;
+	struct media_device* md = NULL;
+	struct media_entity *ent[MD_ENT_COUNT];
+	pthread_t threads[4];
+	md = media_device_new("/dev/media0");
+	BYE_ON(!md, "Cannot create media device\n");
 
-	ret = setup_link(md, adv_binner, 1, ipu4_csi, 0, 0);
-	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n", adv_binner, 1, ipu4_csi, 0);
+	ret = media_device_enumerate(md);
+	BYE_ON(ret, "Cannot enumerate media device\n");
 
-	ret = setup_link(md, ipu4_csi, 1, "Intel IPU4 CSI2 BE SOC", 0, MEDIA_LNK_FL_DYNAMIC);
-	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n", ipu4_csi, 1, "Intel IPU4 CSI2 BE SOC", 4);
+	ret = md_index_entities(md, ent);
+	BYE_ON(ret, "Cannot find pixel array and binner entities\n");
+	GET_TS(time_measurements.md_enum_time);
+
+	struct md_chain chains[4] = {
+		{
+			.entity = ent[MD_ENT_BE_SOC],
+			.steps = {
+				{ MD_STEP_ROUTING, 0, 0, 0 },
+				{ MD_STEP_FMT, 720, 240, 0 },
+				{ MD_STEP_FMT, 720, 240, 8 },
+			},
+			.count = 3,
+			.done = &time_measurements.md_chain_time[0],
+		}, {
+			.entity = ent[MD_ENT_CSI],
+			.steps = {
+				{ MD_STEP_FMT, 720, 240, 0 },
+			},
+			.count = 1,
+			.done = &time_measurements.md_chain_time[1],
+		}, {
+			.entity = ent[MD_ENT_ADV_PA],
+			.steps = {
+				{ MD_STEP_FMT, 720, 288, 0 },
+			},
+			.count = 1,
+			.done = &time_measurements.md_chain_time[2],
+		}, {
+			.entity = ent[MD_ENT_ADV_BINNER],
+			.steps = {
+				{ MD_STEP_FMT, 720, 288, 0 },
+				{ MD_STEP_COMPOSE, s->iw, s->ih, 0 },
+				{ MD_STEP_FMT, s->iw, s->ih, 1 },
+			},
+			.count = 3,
+			.done = &time_measurements.md_chain_time[3],
+		},
+	};
 
-	ret = setup_link(md, "Intel IPU4 CSI2 BE SOC", 8, "Intel IPU4 BE SOC capture 0", 0, MEDIA_LNK_FL_DYNAMIC );
-	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n", "Intel IPU4 CSI2 BE SOC", 8, "Intel IPU4 BE SOC capture 0", 0);
+	for (started = 0; started < (int) ARRAY_SIZE(chains); started++) {
+		chains[started].fourcc = s->in_fourcc;
+		chains[started].interlaced = s->interlaced;
+		if (WARN_ON(pthread_create(&threads[started], NULL, md_chain_thread,
+						&chains[started]), "Cannot start media setup thread\n"))
+			break;
+	}
+	/* every started thread is joined before any error returns */
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	BYE_ON(started < (int) ARRAY_SIZE(chains), "Not every media setup thread started\n");
+	for (i = 0; i < (int) ARRAY_SIZE(chains); i++)
+		BYE_ON(chains[i].ret, "Cannot set formats for entity %s\n", chains[i].entity->info.name);
+	GET_TS(time_measurements.md_fmt_time);
+
+	/* links go through the media device, after every pad is configured */
+	ret = setup_entity_link(md, ent[MD_ENT_ADV_PA], 0, ent[MD_ENT_ADV_BINNER], 0, 0);
+	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n",
+			ent[MD_ENT_ADV_PA]->info.name, 0, ent[MD_ENT_ADV_BINNER]->info.name, 0);
+
+	ret = setup_entity_link(md, ent[MD_ENT_ADV_BINNER], 1, ent[MD_ENT_CSI], 0, 0);
+	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n",
+			ent[MD_ENT_ADV_BINNER]->info.name, 1, ent[MD_ENT_CSI]->info.name, 0);
+
+	ret = setup_entity_link(md, ent[MD_ENT_CSI], 1, ent[MD_ENT_BE_SOC], 0, MEDIA_LNK_FL_DYNAMIC);
+	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n",
+			ent[MD_ENT_CSI]->info.name, 1, ent[MD_ENT_BE_SOC]->info.name, 0);
+
+	ret = setup_entity_link(md, ent[MD_ENT_BE_SOC], 8, ent[MD_ENT_CAPTURE], 0, MEDIA_LNK_FL_DYNAMIC);
+	BYE_ON(ret, "Cannot settup link between %s[%d] -> %s[%d]\n",
+			ent[MD_ENT_BE_SOC]->info.name, 8, ent[MD_ENT_CAPTURE]->info.name, 0);
 
 	if (strlen(s->video) == 0) {
-		strncpy(s->video, get_entity_devname(md, "Intel IPU4 BE SOC capture 0"), 31);
+		strncpy(s->video, media_entity_get_devname(ent[MD_ENT_CAPTURE]), 31);
 	}
 
 	media_device_unref(md);
-	free(adv_pa);
-	free(adv_binner);
 	return 0;
 }
 
@@ -1631,45 +2018,150 @@ static void v4l2_init(struct v4l2_device *dev, struct setup s)
 	dev->format = fmt.fmt.pix;
 }
 
+#define WATCHDOG_STALL_FRAMES	8	/* frame periods without a frame */
+#define WATCHDOG_MIN_TIMEOUT_MS	100
+#define WATCHDOG_IDLE_TIMEOUT_MS	500	/* before the first frame */
+#define WATCHDOG_RETRIES	3
+
+/* Poll timeout: a few frame periods once the stream has delivered */
+static int watchdog_timeout(const struct watchdog *wd)
+{
+	uint64_t ms;
+
+	if (!wd->last_frame_ns)
+		return WATCHDOG_IDLE_TIMEOUT_MS;
+	ms = wd->frame_period_ns * WATCHDOG_STALL_FRAMES / 1000000;
+	return ms < WATCHDOG_MIN_TIMEOUT_MS ? WATCHDOG_MIN_TIMEOUT_MS :
+		ms > WATCHDOG_IDLE_TIMEOUT_MS ? WATCHDOG_IDLE_TIMEOUT_MS : (int) ms;
+}
+
+static void watchdog_frame(struct watchdog *wd, uint64_t now)
+{
+	if (wd->last_frame_ns) {
+		uint64_t period = now - wd->last_frame_ns;
+
+		/* 1/8 weight, enough to ride over a single late frame */
+		wd->frame_period_ns = wd->frame_period_ns ?
+			wd->frame_period_ns - wd->frame_period_ns / 8 + period / 8 : period;
+	}
+	wd->last_frame_ns = now;
+	wd->unanswered = 0;
+}
+
+/*
+ * Restarts streaming on the open video node. Only buffers the driver
+ * owned are queued again; whatever sits in the mailboxes or on screen
+ * stays there, so the last good frame is shown until new ones arrive.
+ */
+static int camera_restart_stream(struct display *display)
+{
+	struct v4l2_device *v4l2 = display->v4l2;
+	int type = display->s->mplane_type;
+	unsigned int i;
+	int ret;
+
+	pthread_mutex_lock(&display->watchdog.qbuf_lock);
+	ret = ioctl(v4l2->fd, VIDIOC_STREAMOFF, &type);
+	WARN_ON(ret < 0, "STREAMOFF failed: %s\n", ERRSTR);
+	for (i = 0; ret == 0 && i < display->s->buffer_count; i++) {
+		if (__atomic_load_n(&display->buffers[i].owner, __ATOMIC_ACQUIRE) ==
+				BUF_OWNER_DRIVER)
+			ret = v4l2_queue_buffer(v4l2, &display->buffers[i]);
+	}
+	if (ret == 0)
+		ret = ioctl(v4l2->fd, VIDIOC_STREAMON, &type);
+	pthread_mutex_unlock(&display->watchdog.qbuf_lock);
+
+	return ret;
+}
+
+static int camera_recover(struct display *display, enum watchdog_reason reason)
+{
+	struct watchdog *wd = &display->watchdog;
+	struct timespec start, end;
+	int attempt = 0;
+
+	GET_TS(start);
+	/* a sensor that stays silent after restarts needs the full reopen */
+	if (wd->unanswered++ >= WATCHDOG_RETRIES)
+		attempt = WATCHDOG_RETRIES;
+	for (; attempt < WATCHDOG_RETRIES; attempt++) {
+		if (camera_restart_stream(display) == 0)
+			break;
+	}
+	GET_TS(end);
+	__atomic_store_n(&wd->request, WATCHDOG_NONE, __ATOMIC_RELAXED);
+
+	if (attempt == WATCHDOG_RETRIES) {
+		fprintf(stderr, "camera %s: in-place recovery failed, reopening device\n",
+				watchdog_reasons[reason]);
+		return -1;
+	}
+
+	wd->recoveries++;
+	wd->last_recovery_ms = clock_diff(start, end);
+	if (wd->last_recovery_ms > wd->max_recovery_ms)
+		wd->max_recovery_ms = wd->last_recovery_ms;
+	/* the stall is measured again from the restart */
+	wd->last_frame_ns = cam_telemetry_now();
+	wd->flag_next = CAM_FRAME_RECOVERED;
+	fprintf(stderr, "camera %s: stream restarted in %.3f ms (%u so far)\n",
+			watchdog_reasons[reason], wd->last_recovery_ms, wd->recoveries);
+	return 0;
+}
+
 static void polling_thread(void *data)
 {
 	struct display *display = (struct display *)data;
+	struct watchdog *wd = &display->watchdog;
 	struct pollfd fd;
-	unsigned int received_frames;
 	unsigned int total_received_frames;
-	struct timeval prev_time, curr_time;
-	struct timeval time_diff;
-	struct timeval tmp;
-	float time_diff_secs;
-	int poll_res;
+	int poll_res, reason;
 
 	fd.fd = display->v4l2->fd;
 	fd.events = POLLIN;
 
-	gettimeofday(&prev_time, NULL);
-	received_frames = 0;
 	total_received_frames = 0;
+	wd->last_frame_ns = 0;
+	wd->unanswered = 0;
 	while(running) {
-		poll_res = poll(&fd, 1, 500);
+		poll_res = poll(&fd, 1, watchdog_timeout(wd));
+		reason = __atomic_load_n(&wd->request, __ATOMIC_ACQUIRE);
 		if (poll_res < 0) {
+			if (errno == EINTR)
+				continue;
 			signal_int(0);
 			return;
-		} else if (poll_res > 0) {
-			if (fd.revents & POLLERR){
-				printf("Received IPU error - recovering\n");
+		} else if (poll_res == 0 && wd->last_frame_ns) {
+			reason = WATCHDOG_STALL;
+		} else if (poll_res > 0 && (fd.revents & POLLERR)) {
+			reason = WATCHDOG_IPU_ERROR;
+		}
+
+		if (reason != WATCHDOG_NONE) {
+			if (camera_recover(display, reason) < 0) {
 				error_recovery = 1;
 				signal_int(0);
 				return;
-			} else if(fd.revents & POLLIN) {
+			}
+			continue;
+		}
+
+		if (poll_res > 0) {
+			if(fd.revents & POLLIN) {
 				struct buffer *buf = v4l2_dequeue_buffer(display->v4l2, display->buffers);
 				if(buf) {
-					v4l2_queue_buffer(display->v4l2,
-							&display->buffers[buf->index]);
-
+					watchdog_frame(wd, cam_telemetry_now());
+					/* recorded before the buffer can reach redraw */
+					buf->frame_id = cam_telemetry_capture(csi_telemetry,
+							buf->capture_ns, buf->index,
+							(buf->field_type == FIELD_TYPE_BOTTOM ?
+							 CAM_FRAME_BOTTOM : 0) | wd->flag_next);
+					wd->flag_next = 0;
 					if (buf->field_type == FIELD_TYPE_BOTTOM) {
-						cur_bottom_buffer = buf;
+						mailbox_post(display, &display->mb_bottom, buf);
 					} else {
-						cur_top_buffer = buf;
+						mailbox_post(display, &display->mb_top, buf);
 					}
 				}
 				if (first_csi_frame_received == 0) {
@@ -1677,26 +2169,10 @@ static void polling_thread(void *data)
 					GET_TS(time_measurements.first_frame_time);
 				}
 
-				received_frames++;
 				total_received_frames++;
 				if (display->s->frames_count != 0 && total_received_frames >= display->s->frames_count) {
 					running = 0;
 				}
-				gettimeofday(&curr_time, NULL);
-				timersub(&curr_time, &prev_time, &time_diff);
-				time_diff_secs = (time_diff.tv_sec * 1000 + time_diff.tv_usec / 1000) / 1000;
-
-				if (time_diff_secs >= TARGET_NUM_SECONDS) {
-					fprintf(stdout, "Received %d frames from IPU in %6.3f seconds = %6.3f FPS\n",
-							received_frames, time_diff_secs, received_frames / time_diff_secs);
-					fflush(stdout);
-
-					received_frames = 0;
-
-					tmp = prev_time;
-					prev_time = curr_time;
-					curr_time = tmp;
-				}
 			}
 		}
 	}
@@ -1789,7 +2265,7 @@ create_surface(struct window *window)
 		wl_shell_surface_set_title(window->shell_surface, "csi_dma-test");
 	}
 
-	if (display->s->render_type != RENDER_TYPE_WL) {
+	if (render_uses_egl(display->s)) {
 		window->native =
 			wl_egl_window_create(window->surface,
 					window->window_size.width,
@@ -1810,91 +2286,31 @@ create_surface(struct window *window)
 static void
 init_gl_shaders(struct window *window)
 {
-	GLint status;
-	GLuint frag, vert;
-	FILE* pf;
-	GLint shader_size;
-	GLenum shader_format;
-	char *shader_binary;
-	unsigned int got_binary_shader = 0;
-	unsigned int color_format;
-
-	window->gl.program = glCreateProgram();
-
-	if (clr_glProgramBinaryOES) {
-		pf = fopen("shader.bin", "rb");
-		if (pf) {
-			fread(&shader_size, sizeof(shader_size), 1, pf);
-			fread(&shader_format, sizeof(shader_format), 1, pf);
-			fread(&color_format, sizeof(color_format), 1, pf);
-
-			if (color_format == window->display->s->in_fourcc) { 
-				shader_binary = malloc(shader_size);
-
-				fread(shader_binary, shader_size, 1, pf);
-
-				clr_glProgramBinaryOES(window->gl.program,
-						   shader_format,
-						   shader_binary,
-						   shader_size);
-
-				free(shader_binary);
-				got_binary_shader = 1;
-			}
-			fclose(pf);
-		};
-	}
-	if (!got_binary_shader) {
-		vert = create_shader(window, vert_shader_text, GL_VERTEX_SHADER);
-		if (window->display->s->in_fourcc == V4L2_MBUS_FMT_UYVY8_1X16) {
-			frag = create_shader(window, frag_shader_text_UYVY, GL_FRAGMENT_SHADER);
-		} else if (window->display->s->in_fourcc == V4L2_MBUS_FMT_YUYV8_1X16 &&
-				window->display->s->render_type != RENDER_TYPE_GL_DMA) {
-			/* Use YUVY shader only when imporing data as RGBA888
-			 * texuture (ie. using RENDER_TYPE_GL), if texture is
-			 * being created directly from DMA buffer,
-			 * UFO will automatically convert YUYV into RGB when sampling,
-			 * so in that case regular RGB shader needs to be used
-			 */
-			frag = create_shader(window, frag_shader_text_YUYV, GL_FRAGMENT_SHADER);
-		} else {
-			frag = create_shader(window, frag_shader_text_RGB, GL_FRAGMENT_SHADER);
-		}
+	struct setup *s = window->display->s;
+	const char *frag = frag_shader_text_RGB;
+	const char *name = "csi-rgb";
 
-		glAttachShader(window->gl.program, frag);
-		glAttachShader(window->gl.program, vert);
-		glLinkProgram(window->gl.program);
-	}
-
-	glGetProgramiv(window->gl.program, GL_LINK_STATUS, &status);
-	if (!status) {
-		char log[1000];
-		GLsizei len;
-		glGetProgramInfoLog(window->gl.program, 1000, &len, log);
-		fprintf(stderr, "Error: linking:\n%*s\n", len, log);
-		exit(1);
-	}
-
-	if (clr_glProgramBinaryOES && !got_binary_shader) {
-		glGetProgramiv(window->gl.program, GL_PROGRAM_BINARY_LENGTH_OES,
-			       &shader_size);
-
-		shader_binary = malloc(shader_size);
-
-		clr_glGetProgramBinaryOES(window->gl.program, shader_size, NULL,
-				      &shader_format, shader_binary);
-
-		pf = fopen("shader.bin", "wb");
-		if (pf) {
-			fwrite(&shader_size, sizeof(shader_size), 1, pf);
-			fwrite(&shader_format, sizeof(shader_format), 1, pf);
-			fwrite(&window->display->s->in_fourcc, sizeof(window->display->s->in_fourcc), 1, pf);
-			fwrite(shader_binary, 1, shader_size, pf);
+	/* still linked in the pool's context from the last engagement */
+	if (window->gl.program)
+		return;
 
-			fclose(pf);
-		}
-		free(shader_binary);
-	}
+	if (s->in_fourcc == V4L2_MBUS_FMT_UYVY8_1X16) {
+		frag = frag_shader_text_UYVY;
+		name = "csi-uyvy";
+	} else if (s->in_fourcc == V4L2_MBUS_FMT_YUYV8_1X16 &&
+			s->render_type != RENDER_TYPE_GL_DMA) {
+		/* Use YUVY shader only when imporing data as RGBA888
+		 * texuture (ie. using RENDER_TYPE_GL), if texture is
+		 * being created directly from DMA buffer,
+		 * UFO will automatically convert YUYV into RGB when sampling,
+		 * so in that case regular RGB shader needs to be used
+		 */
+		frag = frag_shader_text_YUYV;
+		name = "csi-yuyv";
+	}
+
+	window->gl.program = gl_program_cached(name, vert_shader_text, frag, NULL);
+	BYE_ON(!window->gl.program, "building the %s program failed\n", name);
 }
 
 static void
@@ -1905,7 +2321,6 @@ init_gl(struct window *window)
 	const GLfloat HMI_H = 1.f;
 	const GLfloat HMI_Z = 0.f;
 	const char* gl_extensions = NULL;
-	GLint num_binary_program_formats = 0;
 
 	/*
 	 * If input stream width was changed becasue it was not multiply of 32, crop additionaly added pixels
@@ -1915,14 +2330,6 @@ init_gl(struct window *window)
 
 	gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
 
-	if (strstr(gl_extensions, "GL_OES_get_program_binary")) {
-		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS_OES, &num_binary_program_formats);
-		if (num_binary_program_formats) {
-			clr_glProgramBinaryOES = (PFNGLPROGRAMBINARYOESPROC) eglGetProcAddress("glProgramBinaryOES");
-			clr_glGetProgramBinaryOES = (PFNGLGETPROGRAMBINARYOESPROC) eglGetProcAddress("glGetProgramBinaryOES");
-		}
-	}
-
 	if (strstr(gl_extensions, "GL_OES_EGL_image_external")) {
 		glEGLImageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
 	}
@@ -2096,10 +2503,66 @@ int initCsiWlConnection(void)
         return 0;
 }
 
+/* DMABUFs, their EGLImages and the objects they depend on, kept across
+ * reverse camera engagements when the caller owns the pool */
+struct csi_buffer_pool {
+	unsigned int buffer_count;	/* requested size, 0 for the default */
+	int ready;			/* buffers allocated and exported */
+	unsigned int reused;
+	struct setup s;			/* setup the buffers were sized for */
+	struct v4l2_device v4l2;
+	int drm_fd;
+	dri_bufmgr *bufmgr;
+	struct buffer *buffers;
+	struct wl_display *wl;
+	EGLDisplay egl_dpy;
+	EGLContext egl_ctx;
+	EGLConfig egl_conf;
+	GLuint gl_program;		/* lives in egl_ctx */
+};
+
+static void buffer_pool_release(struct csi_buffer_pool *pool)
+{
+	unsigned int i;
+
+	if (pool->ready) {
+		for (i = 0; i < pool->buffer_count; i++) {
+			struct buffer *buf = &pool->buffers[i];
+
+			if (buf->khrImage)
+				eglDestroyImageKHR(pool->egl_dpy, buf->khrImage);
+			drm_intel_bo_unmap(buf->bo);
+			close(buf->dbuf_fd);
+			drm_intel_bo_unreference(buf->bo);
+		}
+		free(pool->buffers);
+		drm_intel_bufmgr_destroy(pool->bufmgr);
+		drmClose(pool->drm_fd);
+		close(pool->v4l2.fd);
+	}
+
+	if (pool->egl_dpy) {
+		eglDestroyContext(pool->egl_dpy, pool->egl_ctx);
+		eglTerminate(pool->egl_dpy);
+	}
+	if (pool->wl)
+		wl_display_disconnect(pool->wl);
+
+	pool->ready = 0;
+	pool->reused = 0;
+	pool->buffers = NULL;
+	pool->wl = NULL;
+	pool->egl_dpy = NULL;
+	pool->gl_program = 0;
+}
+
 int CsiStartDisplay(struct  set_up param, void *gpioclass, int start)
 {
 	GET_TS(time_measurements.app_start_time);
-	struct v4l2_device v4l2;
+	struct csi_buffer_pool local_pool = { 0 };
+	struct csi_buffer_pool *pool = param.pool ? param.pool : &local_pool;
+	struct v4l2_device *v4l2 = &pool->v4l2;
+	struct buffer *buffers;
 	//struct setup s;
 	struct sigaction sigint;
 	struct display display = { 0 };
@@ -2107,37 +2570,58 @@ int CsiStartDisplay(struct  set_up param, void *gpioclass, int start)
 	int i, ret = 0;
 	unsigned int src_size;
 	pthread_t poll_thread;
-	struct stat tmp;
-	char wayland_path[255];
+	struct timespec alloc_start, alloc_end;
 	g_gpioclass = gpioclass;
 
 	GET_TS(time_measurements.before_md_init_time);
+
+	if (!csi_telemetry) {
+		csi_telemetry = cam_telemetry_create("csi");
+		WARN_ON(!csi_telemetry, "camera telemetry disabled: %s\n", ERRSTR);
+	}
 	
 	parse_input_args(&s);
+	if (pool->buffer_count)
+		s.buffer_count = pool->buffer_count;
+	if (param.cpu_convert) {
+		BYE_ON(s.in_fourcc != V4L2_MBUS_FMT_UYVY8_1X16 &&
+				s.in_fourcc != V4L2_MBUS_FMT_YUYV8_1X16,
+				"CPU conversion needs UYVY or YUYV input\n");
+		s.render_type = RENDER_TYPE_SHM;
+	}
+
+	/* the pool keeps the configured pipeline and video node open */
+	if (pool->ready) {
+		s = pool->s;
+		GET_TS(time_measurements.md_init_time);
+		GET_TS(time_measurements.v4l2_init_time);
+		goto setup_display;
+	}
+
 	media_controller_init(&s);
 
-	memset(&v4l2, 0, sizeof v4l2);
-	v4l2.devname = s.video;
+	memset(v4l2, 0, sizeof(*v4l2));
+	v4l2->devname = s.video;
 
 	if (s.use_wh) {
-		v4l2.format.width = s.iw;
-		v4l2.format.height = s.ih;
+		v4l2->format.width = s.iw;
+		v4l2->format.height = s.ih;
 	}
 	if(!s.ow || !s.oh) {
 		s.ow = s.iw;
 		s.oh = s.ih;
 	}
 	if (s.in_fourcc)
-		v4l2.format.pixelformat = s.in_fourcc;
+		v4l2->format.pixelformat = s.in_fourcc;
 
 	if(s.exporter) {
-		v4l2.is_exporter = 1;
+		v4l2->is_exporter = 1;
 	} else {
-		v4l2.is_exporter = 0;
+		v4l2->is_exporter = 0;
 	}
 
 	GET_TS(time_measurements.md_init_time);
-	v4l2_init(&v4l2, s);
+	v4l2_init(v4l2, s);
 
 	GET_TS(time_measurements.v4l2_init_time);
 	
@@ -2149,14 +2633,9 @@ int CsiStartDisplay(struct  set_up param, void *gpioclass, int start)
 	if (s.iw % 32 != 0) {
 		s.iw += (s.iw % 32);
 	}
+	pool->s = s;
 
-	struct buffer buffers[s.buffer_count];
-	memset(buffers, 0, sizeof(struct buffer) * s.buffer_count);
-
-	for(i = 0; i < (int) s.buffer_count; i++) {
-		buffers[i].index = i;
-	}
-
+setup_display:
 	window.display = &display;
 	display.window = &window;
 	window.window_size.width  = s.ow;
@@ -2166,8 +2645,8 @@ int CsiStartDisplay(struct  set_up param, void *gpioclass, int start)
 	window.print_fps = 1;
 	display.s = &s;
 
-	display.buffers = buffers;
-	display.v4l2 = &v4l2;
+	display.v4l2 = v4l2;
+	pthread_mutex_init(&display.watchdog.qbuf_lock, NULL);
 
 	if (s.in_fourcc == V4L2_MBUS_FMT_UYVY8_1X16 ||
 			s.in_fourcc == V4L2_MBUS_FMT_YUYV8_1X16) {
@@ -2176,31 +2655,55 @@ int CsiStartDisplay(struct  set_up param, void *gpioclass, int start)
 		src_size = s.iw * s.ih * 4;
 	}
 
-	ret = init_gem(&display);
-	if(ret < 0) {
-		return ret;
-	}
+	GET_TS(alloc_start);
+	if (!pool->ready) {
+		ret = init_gem(&display);
+		if(ret < 0) {
+			return ret;
+		}
+		pool->drm_fd = display.fd;
+		pool->bufmgr = display.bufmgr;
 
-	for(i = 0; i < (int) s.buffer_count; i++) {
-		if(v4l2.is_exporter) {
-			v4l2_expbuffer(&v4l2, i, &buffers[i]);
-			ret = drm_buffer_to_prime(&display, &buffers[i], src_size);
-			if(ret < 0) {
-				return ret;
-			}
-		} else {
-			ret = create_buffer(&display, &buffers[i], src_size);
-			if(ret < 0) {
-				destroy_gem(&display);
-				return ret;
+		pool->buffers = calloc(s.buffer_count, sizeof(struct buffer));
+		BYE_ON(!pool->buffers, "Cannot allocate memory: %m\n");
+		pool->buffer_count = s.buffer_count;
+
+		for(i = 0; i < (int) s.buffer_count; i++) {
+			pool->buffers[i].index = i;
+			if(v4l2->is_exporter) {
+				v4l2_expbuffer(v4l2, i, &pool->buffers[i]);
+				ret = drm_buffer_to_prime(&display, &pool->buffers[i], src_size);
+				if(ret < 0) {
+					return ret;
+				}
+			} else {
+				ret = create_buffer(&display, &pool->buffers[i], src_size);
+				if(ret < 0) {
+					destroy_gem(&display);
+					return ret;
+				}
 			}
 		}
+		pool->ready = 1;
+	} else {
+		display.fd = pool->drm_fd;
+		display.bufmgr = pool->bufmgr;
+	}
+	GET_TS(alloc_end);
+	printf("CSI buffer pool: %u buffers %s in %.3f ms\n", s.buffer_count,
+			pool->reused++ ? "reused" : "allocated", clock_diff(alloc_start, alloc_end));
+
+	buffers = pool->buffers;
+	display.buffers = buffers;
 
-		v4l2_queue_buffer(&v4l2, &buffers[i]);
+	for(i = 0; i < (int) s.buffer_count; i++) {
+		if (v4l2_queue_buffer(v4l2, &buffers[i]) < 0)
+			watchdog_kick(&display, WATCHDOG_QBUF);
 	}
+	mailbox_reset(&display);
 	
 	int type = s.mplane_type;
-	ret = ioctl(v4l2.fd, VIDIOC_STREAMON, &type);
+	ret = ioctl(v4l2->fd, VIDIOC_STREAMON, &type);
 	BYE_ON(ret < 0, "STREAMON failed: %s\n", ERRSTR);
 	GET_TS(time_measurements.streamon_time);
 
@@ -2211,14 +2714,17 @@ int CsiStartDisplay(struct  set_up param, void *gpioclass, int start)
 		printf("Couldn't create polling thread\n");
 	}
 	
-	snprintf(wayland_path, 255, "%s/wayland-0", getenv("XDG_RUNTIME_DIR"));
-	while (stat(wayland_path, &tmp) != 0) {
-		usleep(100);
+	if (!pool->wl) {
+		if (param.kms_preview)
+			kms_preview(&display);
+		WaylandReady_wait();
+		pool->wl = wl_display_connect(NULL);
 	}
 
 	GET_TS(time_measurements.weston_init_time);
 
-	display.display = wl_display_connect(NULL);
+	/* kept with the pool, the cached EGLImages belong to its EGLDisplay */
+	display.display = pool->wl;
 	assert(display.display);
 	wl_list_init(&display.output_list);
 
@@ -2228,18 +2734,33 @@ int CsiStartDisplay(struct  set_up param, void *gpioclass, int start)
 
 	wl_display_dispatch(display.display);
 	wl_display_roundtrip(display.display);
-	if (s.render_type != RENDER_TYPE_WL) {
-		init_egl(&display, window.opaque);
+	if (render_uses_egl(&s)) {
+		if (!pool->egl_dpy) {
+			init_egl(&display, window.opaque);
+			pool->egl_dpy = display.egl.dpy;
+			pool->egl_ctx = display.egl.ctx;
+			pool->egl_conf = display.egl.conf;
+		} else {
+			display.egl.dpy = pool->egl_dpy;
+			display.egl.ctx = pool->egl_ctx;
+			display.egl.conf = pool->egl_conf;
+		}
 	}
 
 	create_surface(&window);
 
-	if (s.render_type != RENDER_TYPE_WL) {
+	if (render_uses_egl(&s)) {
+		window.gl.program = pool->gl_program;
 		init_gl(&window);
+		pool->gl_program = window.gl.program;
+	} else if (s.render_type == RENDER_TYPE_SHM) {
+		BYE_ON(shm_frame_create(display.shm, display.shm_buffers,
+					s.ow, s.oh, "csi") < 0,
+				"Cannot set up the CPU render buffers\n");
 	}
 restart:
 	for(i = 0; i < (int) s.buffer_count; i++) {
-		if (s.render_type == RENDER_TYPE_WL) {
+		if (s.render_type == RENDER_TYPE_WL && !buffers[i].buf) {
 			if (s.in_fourcc == V4L2_MBUS_FMT_UYVY8_1X16 ||
                             s.in_fourcc == MEDIA_BUS_FMT_RGB565_1X16) {
 				//UYVY cannot be displayed using direct fliping it is possible only with YUYV
@@ -2252,7 +2773,9 @@ restart:
 				buffers[i].buf = wl_drm_create_buffer(display.wl_drm, buffers[i].flink_name, s.iw, s.ih,
 					                              s.iw*4, WL_DRM_FORMAT_XRGB8888);
 			}
-		} else if (s.render_type == RENDER_TYPE_GL_DMA) {
+			/* captured frames go back to the IPU on wl_buffer.release */
+			wl_buffer_add_listener(buffers[i].buf, &buffer_listener, &display);
+		} else if (s.render_type == RENDER_TYPE_GL_DMA && !buffers[i].khrImage) {
 			if (s.in_fourcc == V4L2_MBUS_FMT_YUYV8_1X16) {
 				EGLint imageAttributes[] = {
 				  EGL_WIDTH, s.iw,
@@ -2323,7 +2846,11 @@ restart:
 		ret = wl_display_dispatch(display.display);
 	}
 
-	fprintf(stderr, "\ncsi-test finishing loop\n");
+	fprintf(stderr, "\ncsi-test finishing loop, %u frames shown, %u dropped, "
+			"%u recoveries (last %.3f ms, max %.3f ms)\n",
+			display.frames_shown, display.frames_dropped,
+			display.watchdog.recoveries, display.watchdog.last_recovery_ms,
+			display.watchdog.max_recovery_ms);
 
 	pthread_join(poll_thread, NULL);
 
@@ -2331,8 +2858,10 @@ restart:
 		for(i = 0; i < (int) s.buffer_count; i++) {
 			if (s.render_type == RENDER_TYPE_WL) {
 				wl_buffer_destroy(buffers[i].buf);
+				buffers[i].buf = NULL;
 			} else if (s.render_type == RENDER_TYPE_GL_DMA) {
 				eglDestroyImageKHR(display.egl.dpy, buffers[i].khrImage);
+				buffers[i].khrImage = 0;
 			}
 			ret = drm_intel_bo_unmap(buffers[i].bo);
 			close(buffers[i].dbuf_fd);
@@ -2340,19 +2869,20 @@ restart:
 		}
 
 		/* Close and reopen IPU device */
-		close(v4l2.fd);
+		close(v4l2->fd);
 		s.iw = s.original_iw;
-		v4l2_init(&v4l2, s);
+		v4l2_init(v4l2, s);
 		running = 1;
 		error_recovery = 0;
 
 		if (s.iw % 32 != 0) {
 			s.iw += (s.iw % 32);
 		}
+		pool->s = s;
 
 		for(i = 0; i < (int) s.buffer_count; i++) {
-			if(v4l2.is_exporter) {
-				v4l2_expbuffer(&v4l2, i, &buffers[i]);
+			if(v4l2->is_exporter) {
+				v4l2_expbuffer(v4l2, i, &buffers[i]);
 				ret = drm_buffer_to_prime(&display, &buffers[i], src_size);
 				if(ret < 0) {
 					return ret;
@@ -2365,10 +2895,12 @@ restart:
 				}
 			}
 
-			v4l2_queue_buffer(&v4l2, &buffers[i]);
+			if (v4l2_queue_buffer(v4l2, &buffers[i]) < 0)
+				watchdog_kick(&display, WATCHDOG_QBUF);
 		}
+		mailbox_reset(&display);
 		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		ret = ioctl(v4l2.fd, VIDIOC_STREAMON, &type);
+		ret = ioctl(v4l2->fd, VIDIOC_STREAMON, &type);
 		BYE_ON(ret < 0, "STREAMON failed: %s\n", ERRSTR);
 		GET_TS(time_measurements.streamon_time);
 
@@ -2380,15 +2912,17 @@ restart:
 		goto restart;
 	} else if (s.loops_count--) {
 		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		ret = ioctl(v4l2.fd, VIDIOC_STREAMOFF, &type);
+		ret = ioctl(v4l2->fd, VIDIOC_STREAMOFF, &type);
 		BYE_ON(ret < 0, "STREAMOFF failed: %s\n", ERRSTR);
 		running = 1;
 
 		for(i = 0; i < (int) s.buffer_count; i++) {
-			v4l2_queue_buffer(&v4l2, &buffers[i]);
+			if (v4l2_queue_buffer(v4l2, &buffers[i]) < 0)
+				watchdog_kick(&display, WATCHDOG_QBUF);
 		}
+		mailbox_reset(&display);
 
-		ret = ioctl(v4l2.fd, VIDIOC_STREAMON, &type);
+		ret = ioctl(v4l2->fd, VIDIOC_STREAMON, &type);
 		if (ret < 0) {
 			printf("STREAMON ERROR\n");
 			running = 0;
@@ -2403,9 +2937,24 @@ restart:
 
 		goto restart;
 	}
-	destroy_gem(&display);
+	/* buffers go back to the pool, the next engagement queues them again */
+	type = s.mplane_type;
+	ret = ioctl(v4l2->fd, VIDIOC_STREAMOFF, &type);
+	WARN_ON(ret < 0, "STREAMOFF failed: %s\n", ERRSTR);
+
+	if (s.render_type == RENDER_TYPE_WL) {
+		/* their release listener points at this session's display */
+		for(i = 0; i < (int) s.buffer_count; i++) {
+			if (buffers[i].buf)
+				wl_buffer_destroy(buffers[i].buf);
+			buffers[i].buf = NULL;
+		}
+	}
+
 	destroy_surface(&window);
-	close(v4l2.fd);
+
+	if (s.render_type == RENDER_TYPE_SHM)
+		shm_frame_destroy(display.shm_buffers);
 
 	free(curr_time);
 	free(prev_time);
@@ -2423,13 +2972,38 @@ restart:
 	if(display.compositor) {
 		wl_compositor_destroy(display.compositor);
 	}
+	if(display.shm) {
+		wl_shm_destroy(display.shm);
+	}
 
 	wl_display_flush(display.display);
-	wl_display_disconnect(display.display);
+
+	if (pool == &local_pool)
+		buffer_pool_release(pool);
+	pthread_mutex_destroy(&display.watchdog.qbuf_lock);
 
 	return 0;
 }
 
+struct csi_buffer_pool *CsiCreateBufferPool(unsigned int buffer_count)
+{
+	struct csi_buffer_pool *pool = calloc(1, sizeof(*pool));
+
+	if (pool)
+		pool->buffer_count = buffer_count;
+	return pool;
+}
+
+void CsiDestroyBufferPool(struct csi_buffer_pool *pool)
+{
+	if (!pool)
+		return;
+
+	buffer_pool_release(pool);
+	free(pool);
+}
+
+
 void CsiStopDisplay(int stop)
 {
 	running = stop;
@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SHM_FRAME_H_
+#define _SHM_FRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+#include "yuv2rgb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One XRGB8888 wl_shm buffer of a camera's CPU converted output */
+struct shm_buffer {
+	struct wl_buffer *buf;
+	uint32_t *pixels;
+	size_t size;
+	int busy;		/* attached, waiting for wl_buffer.release */
+};
+
+/* Two buffers of width x height from one pool in XDG_RUNTIME_DIR.
+ * tag names the pool file and the log line. Returns 0 or -1. */
+int shm_frame_create(struct wl_shm *shm, struct shm_buffer bufs[2],
+		int width, int height, const char *tag);
+void shm_frame_destroy(struct shm_buffer bufs[2]);
+
+/* Converts src (and bottom, a second field to weave, when not NULL) into
+ * a buffer the compositor is not holding and commits it on surface,
+ * scaled to the buffer size. If both are still held or the conversion
+ * fails, the surface is committed without a new buffer so a frame
+ * callback already requested on it still fires.
+ * Returns 0 when a new frame was attached, -1 otherwise. */
+int shm_frame_present(struct wl_surface *surface, struct shm_buffer bufs[2],
+		const struct yuv_image *src, const struct yuv_image *bottom,
+		unsigned int width, unsigned int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _YUV2RGB_H_
+#define _YUV2RGB_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum yuv_format {
+	YUV_FORMAT_UYVY,
+	YUV_FORMAT_YUYV,
+	YUV_FORMAT_NV12,
+};
+
+/* plane[1]/pitch[1] are only used by NV12 (interleaved CbCr plane) */
+struct yuv_image {
+	enum yuv_format format;
+	const uint8_t *plane[2];
+	unsigned int pitch[2];
+	unsigned int width, height;
+};
+
+struct rgb_image {
+	uint32_t *pixels;	/* XRGB8888, alpha forced to 0xff */
+	unsigned int pitch;	/* in bytes */
+	unsigned int width, height;
+};
+
+/* Converts a frame to XRGB8888 with BT.601 limited range coefficients.
+ * When bottom is not NULL, src and bottom are the two fields of an
+ * interlaced frame and are woven line by line first. The result is
+ * scaled (nearest neighbour) to the size of dst. Keeps scratch memory
+ * between calls, so it must not be called from several threads at once.
+ * Returns 0 on success, -1 on bad arguments or allocation failure. */
+int yuv_to_xrgb(const struct yuv_image *src, const struct yuv_image *bottom,
+		struct rgb_image *dst);
+
+/* Name of the row converter picked for this CPU ("avx2", "sse4.1", "c") */
+const char *yuv2rgb_backend(void);
+
+/* Forces the portable converter, used to compare against the SIMD ones */
+void yuv2rgb_force_scalar(int enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shm_frame.h"
+
+static void
+shm_buffer_release(void *data, struct wl_buffer *wl_buf)
+{
+	struct shm_buffer *buf = data;
+
+	buf->busy = 0;
+}
+
+static const struct wl_buffer_listener shm_buffer_listener = {
+	shm_buffer_release
+};
+
+int shm_frame_create(struct wl_shm *shm, struct shm_buffer bufs[2],
+		int width, int height, const char *tag)
+{
+	char path[255];
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	struct wl_shm_pool *shm_pool;
+	size_t stride = width * 4, size = stride * height;
+	unsigned int i;
+	uint8_t *data;
+	int fd;
+
+	if (!shm) {
+		fprintf(stderr, "%s: compositor doesn't expose wl_shm\n", tag);
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/%s-shm-XXXXXX", dir ? dir : "/tmp", tag);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		fprintf(stderr, "%s: cannot create %s: %m\n", tag, path);
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	unlink(path);
+	if (ftruncate(fd, 2 * size) < 0) {
+		fprintf(stderr, "%s: ftruncate failed: %m\n", tag);
+		close(fd);
+		return -1;
+	}
+
+	data = mmap(NULL, 2 * size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "%s: mmap failed: %m\n", tag);
+		close(fd);
+		return -1;
+	}
+
+	shm_pool = wl_shm_create_pool(shm, fd, 2 * size);
+	for (i = 0; i < 2; i++) {
+		struct shm_buffer *buf = &bufs[i];
+
+		buf->pixels = (uint32_t *) (data + i * size);
+		buf->size = size;
+		buf->busy = 0;
+		buf->buf = wl_shm_pool_create_buffer(shm_pool, i * size, width,
+				height, stride, WL_SHM_FORMAT_XRGB8888);
+		wl_buffer_add_listener(buf->buf, &shm_buffer_listener, buf);
+	}
+	wl_shm_pool_destroy(shm_pool);
+	close(fd);
+
+	printf("%s render: converting on the CPU (%s)\n", tag, yuv2rgb_backend());
+	return 0;
+}
+
+void shm_frame_destroy(struct shm_buffer bufs[2])
+{
+	unsigned int i;
+
+	for (i = 0; i < 2; i++) {
+		if (bufs[i].buf)
+			wl_buffer_destroy(bufs[i].buf);
+		bufs[i].buf = NULL;
+	}
+	/* both buffers share one mapping */
+	if (bufs[0].pixels)
+		munmap(bufs[0].pixels, 2 * bufs[0].size);
+	memset(bufs, 0, 2 * sizeof(*bufs));
+}
+
+int shm_frame_present(struct wl_surface *surface, struct shm_buffer bufs[2],
+		const struct yuv_image *src, const struct yuv_image *bottom,
+		unsigned int width, unsigned int height)
+{
+	struct shm_buffer *out = NULL;
+	struct rgb_image dst;
+	unsigned int i;
+
+	for (i = 0; i < 2 && !out; i++) {
+		if (!bufs[i].busy)
+			out = &bufs[i];
+	}
+
+	if (out) {
+		dst.pixels = out->pixels;
+		dst.width = width;
+		dst.height = height;
+		dst.pitch = width * 4;
+		if (yuv_to_xrgb(src, bottom, &dst) < 0) {
+			fprintf(stderr, "YUV to RGB conversion failed\n");
+			out = NULL;
+		}
+	}
+
+	/* without a free buffer the current frame stays on screen, but the
+	 * commit is still needed for the frame callback to come back */
+	if (out) {
+		out->busy = 1;
+		wl_surface_attach(surface, out->buf, 0, 0);
+		wl_surface_damage(surface, 0, 0, width, height);
+	}
+	wl_surface_commit(surface);
+	return out ? 0 : -1;
+}
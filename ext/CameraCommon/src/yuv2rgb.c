@@ -0,0 +1,443 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "yuv2rgb.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV2RGB_X86 1
+#include <immintrin.h>
+#endif
+
+/* Converts one line of width pixels. p1 is the CbCr line for NV12. */
+typedef void (*row_fn)(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width);
+
+static inline int clamp8(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* BT.601 limited range, 8 bit fixed point */
+static inline uint32_t pack_xrgb(int y, int u, int v)
+{
+	int c = (y - 16) * 298 + 128;
+	int d = u - 128;
+	int e = v - 128;
+
+	return 0xff000000u |
+		(uint32_t) clamp8((c + 409 * e) >> 8) << 16 |
+		(uint32_t) clamp8((c - 100 * d - 208 * e) >> 8) << 8 |
+		(uint32_t) clamp8((c + 516 * d) >> 8);
+}
+
+static void row_uyvy_c(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; x + 1 < width; x += 2, p0 += 4) {
+		dst[x] = pack_xrgb(p0[1], p0[0], p0[2]);
+		dst[x + 1] = pack_xrgb(p0[3], p0[0], p0[2]);
+	}
+	if (x < width)
+		dst[x] = pack_xrgb(p0[1], p0[0], p0[2]);
+}
+
+static void row_yuyv_c(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; x + 1 < width; x += 2, p0 += 4) {
+		dst[x] = pack_xrgb(p0[0], p0[1], p0[3]);
+		dst[x + 1] = pack_xrgb(p0[2], p0[1], p0[3]);
+	}
+	if (x < width)
+		dst[x] = pack_xrgb(p0[0], p0[1], p0[3]);
+}
+
+static void row_nv12_c(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; x < width; x++)
+		dst[x] = pack_xrgb(p0[x], p1[x & ~1u], p1[x | 1u]);
+}
+
+#ifdef YUV2RGB_X86
+
+#define Z 0x80	/* pshufb: zero the byte */
+
+/* pshufb masks that zero extend the Y, Cb and Cr samples of 4 pixels into
+ * 32 bit lanes, for the first (bytes 0-7) and second (8-15) half of a
+ * 16 byte load */
+#define LANES(a, b, c, d) a, Z, Z, Z, b, Z, Z, Z, c, Z, Z, Z, d, Z, Z, Z
+#define HI(a, b, c, d) LANES(a + 8, b + 8, c + 8, d + 8)
+
+static const int8_t uyvy_y[2][16] = { { LANES(1, 3, 5, 7) }, { HI(1, 3, 5, 7) } };
+static const int8_t uyvy_u[2][16] = { { LANES(0, 0, 4, 4) }, { HI(0, 0, 4, 4) } };
+static const int8_t uyvy_v[2][16] = { { LANES(2, 2, 6, 6) }, { HI(2, 2, 6, 6) } };
+static const int8_t yuyv_y[2][16] = { { LANES(0, 2, 4, 6) }, { HI(0, 2, 4, 6) } };
+static const int8_t yuyv_u[2][16] = { { LANES(1, 1, 5, 5) }, { HI(1, 1, 5, 5) } };
+static const int8_t yuyv_v[2][16] = { { LANES(3, 3, 7, 7) }, { HI(3, 3, 7, 7) } };
+/* NV12 CbCr, 8 bytes cover 8 pixels */
+static const int8_t nv12_u[2][16] = { { LANES(0, 0, 2, 2) }, { LANES(4, 4, 6, 6) } };
+static const int8_t nv12_v[2][16] = { { LANES(1, 1, 3, 3) }, { LANES(5, 5, 7, 7) } };
+
+#undef HI
+#undef LANES
+#undef Z
+
+#define SSE_MASK(m) _mm_loadu_si128((const __m128i *) (m))
+
+__attribute__((target("sse4.1")))
+static inline __m128i pack_xrgb_sse(__m128i y, __m128i u, __m128i v)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(255);
+	__m128i c, d, e, r, g, b;
+
+	c = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(y, _mm_set1_epi32(16)),
+				_mm_set1_epi32(298)), _mm_set1_epi32(128));
+	d = _mm_sub_epi32(u, _mm_set1_epi32(128));
+	e = _mm_sub_epi32(v, _mm_set1_epi32(128));
+
+	r = _mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(409)));
+	g = _mm_sub_epi32(_mm_sub_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(100))),
+			_mm_mullo_epi32(e, _mm_set1_epi32(208)));
+	b = _mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(516)));
+
+	r = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(r, 8), zero), max);
+	g = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(g, 8), zero), max);
+	b = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(b, 8), zero), max);
+
+	return _mm_or_si128(_mm_or_si128(_mm_set1_epi32((int) 0xff000000),
+				_mm_slli_epi32(r, 16)),
+			_mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+__attribute__((target("sse4.1")))
+static void row_packed_sse41(const uint8_t *p0, uint32_t *dst, unsigned int width,
+		const int8_t (*my)[16], const int8_t (*mu)[16], const int8_t (*mv)[16])
+{
+	unsigned int x;
+	int h;
+
+	for (x = 0; x + 8 <= width; x += 8, p0 += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *) p0);
+
+		for (h = 0; h < 2; h++) {
+			__m128i px = pack_xrgb_sse(_mm_shuffle_epi8(in, SSE_MASK(my[h])),
+					_mm_shuffle_epi8(in, SSE_MASK(mu[h])),
+					_mm_shuffle_epi8(in, SSE_MASK(mv[h])));
+			_mm_storeu_si128((__m128i *) (dst + x + 4 * h), px);
+		}
+	}
+}
+
+__attribute__((target("sse4.1")))
+static void row_uyvy_sse41(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int done = width & ~7u;
+
+	row_packed_sse41(p0, dst, width, uyvy_y, uyvy_u, uyvy_v);
+	row_uyvy_c(p0 + 2 * done, NULL, dst + done, width - done);
+}
+
+__attribute__((target("sse4.1")))
+static void row_yuyv_sse41(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int done = width & ~7u;
+
+	row_packed_sse41(p0, dst, width, yuyv_y, yuyv_u, yuyv_v);
+	row_yuyv_c(p0 + 2 * done, NULL, dst + done, width - done);
+}
+
+__attribute__((target("sse4.1")))
+static void row_nv12_sse41(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int x;
+	int h;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m128i y = _mm_loadl_epi64((const __m128i *) (p0 + x));
+		__m128i uv = _mm_loadl_epi64((const __m128i *) (p1 + x));
+
+		for (h = 0; h < 2; h++) {
+			__m128i px = pack_xrgb_sse(_mm_cvtepu8_epi32(y),
+					_mm_shuffle_epi8(uv, SSE_MASK(nv12_u[h])),
+					_mm_shuffle_epi8(uv, SSE_MASK(nv12_v[h])));
+			_mm_storeu_si128((__m128i *) (dst + x + 4 * h), px);
+			y = _mm_srli_si128(y, 4);
+		}
+	}
+	row_nv12_c(p0 + x, p1 + x, dst + x, width - x);
+}
+
+/* Each 128 bit lane takes one half of a broadcast 16 byte load */
+#define AVX_MASK(m) _mm256_inserti128_si256(_mm256_castsi128_si256(SSE_MASK((m)[0])), \
+		SSE_MASK((m)[1]), 1)
+
+__attribute__((target("avx2")))
+static inline __m256i pack_xrgb_avx2(__m256i y, __m256i u, __m256i v)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(255);
+	__m256i c, d, e, r, g, b;
+
+	c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(16)),
+				_mm256_set1_epi32(298)), _mm256_set1_epi32(128));
+	d = _mm256_sub_epi32(u, _mm256_set1_epi32(128));
+	e = _mm256_sub_epi32(v, _mm256_set1_epi32(128));
+
+	r = _mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409)));
+	g = _mm256_sub_epi32(_mm256_sub_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(100))),
+			_mm256_mullo_epi32(e, _mm256_set1_epi32(208)));
+	b = _mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516)));
+
+	r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 8), zero), max);
+	g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 8), zero), max);
+	b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 8), zero), max);
+
+	return _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32((int) 0xff000000),
+				_mm256_slli_epi32(r, 16)),
+			_mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+__attribute__((target("avx2")))
+static void row_packed_avx2(const uint8_t *p0, uint32_t *dst, unsigned int width,
+		const int8_t (*my)[16], const int8_t (*mu)[16], const int8_t (*mv)[16])
+{
+	const __m256i sy = AVX_MASK(my);
+	const __m256i su = AVX_MASK(mu);
+	const __m256i sv = AVX_MASK(mv);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= width; x += 8, p0 += 16) {
+		__m256i in = _mm256_broadcastsi128_si256(
+				_mm_loadu_si128((const __m128i *) p0));
+		__m256i px = pack_xrgb_avx2(_mm256_shuffle_epi8(in, sy),
+				_mm256_shuffle_epi8(in, su),
+				_mm256_shuffle_epi8(in, sv));
+
+		_mm256_storeu_si256((__m256i *) (dst + x), px);
+	}
+}
+
+__attribute__((target("avx2")))
+static void row_uyvy_avx2(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int done = width & ~7u;
+
+	row_packed_avx2(p0, dst, width, uyvy_y, uyvy_u, uyvy_v);
+	row_uyvy_c(p0 + 2 * done, NULL, dst + done, width - done);
+}
+
+__attribute__((target("avx2")))
+static void row_yuyv_avx2(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	unsigned int done = width & ~7u;
+
+	row_packed_avx2(p0, dst, width, yuyv_y, yuyv_u, yuyv_v);
+	row_yuyv_c(p0 + 2 * done, NULL, dst + done, width - done);
+}
+
+__attribute__((target("avx2")))
+static void row_nv12_avx2(const uint8_t *p0, const uint8_t *p1,
+		uint32_t *dst, unsigned int width)
+{
+	const __m256i su = AVX_MASK(nv12_u);
+	const __m256i sv = AVX_MASK(nv12_v);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i y = _mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((const __m128i *) (p0 + x)));
+		__m256i uv = _mm256_broadcastsi128_si256(
+				_mm_loadl_epi64((const __m128i *) (p1 + x)));
+		__m256i px = pack_xrgb_avx2(y, _mm256_shuffle_epi8(uv, su),
+				_mm256_shuffle_epi8(uv, sv));
+
+		_mm256_storeu_si256((__m256i *) (dst + x), px);
+	}
+	row_nv12_c(p0 + x, p1 + x, dst + x, width - x);
+}
+
+#undef AVX_MASK
+#undef SSE_MASK
+
+#endif /* YUV2RGB_X86 */
+
+enum backend {
+	BACKEND_C,
+	BACKEND_SSE41,
+	BACKEND_AVX2,
+	BACKEND_COUNT
+};
+
+static const char *const backend_names[BACKEND_COUNT] = { "c", "sse4.1", "avx2" };
+
+static const row_fn row_fns[BACKEND_COUNT][3] = {
+	[BACKEND_C] = { row_uyvy_c, row_yuyv_c, row_nv12_c },
+#ifdef YUV2RGB_X86
+	[BACKEND_SSE41] = { row_uyvy_sse41, row_yuyv_sse41, row_nv12_sse41 },
+	[BACKEND_AVX2] = { row_uyvy_avx2, row_yuyv_avx2, row_nv12_avx2 },
+#endif
+};
+
+static int force_scalar;
+
+static enum backend pick_backend(void)
+{
+	static int detected = -1;
+
+	if (force_scalar)
+		return BACKEND_C;
+
+	if (detected < 0) {
+		detected = BACKEND_C;
+#ifdef YUV2RGB_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			detected = BACKEND_AVX2;
+		else if (__builtin_cpu_supports("sse4.1"))
+			detected = BACKEND_SSE41;
+#endif
+	}
+	return detected;
+}
+
+const char *yuv2rgb_backend(void)
+{
+	return backend_names[pick_backend()];
+}
+
+void yuv2rgb_force_scalar(int enable)
+{
+	force_scalar = enable;
+}
+
+/* Scratch kept between frames, sized for the last geometry seen */
+static struct {
+	uint32_t *line;		/* one converted source line before scaling */
+	unsigned int *xmap;	/* source column of every destination column */
+	unsigned int src_w, dst_w;
+} scratch;
+
+static int scratch_prepare(unsigned int src_w, unsigned int dst_w)
+{
+	unsigned int x;
+
+	if (scratch.src_w == src_w && scratch.dst_w == dst_w)
+		return 0;
+
+	free(scratch.line);
+	free(scratch.xmap);
+	scratch.line = malloc(src_w * sizeof(*scratch.line));
+	scratch.xmap = malloc(dst_w * sizeof(*scratch.xmap));
+	if (!scratch.line || !scratch.xmap) {
+		free(scratch.line);
+		free(scratch.xmap);
+		memset(&scratch, 0, sizeof(scratch));
+		return -1;
+	}
+
+	for (x = 0; x < dst_w; x++)
+		scratch.xmap[x] = (unsigned int) ((uint64_t) x * src_w / dst_w);
+	scratch.src_w = src_w;
+	scratch.dst_w = dst_w;
+	return 0;
+}
+
+int yuv_to_xrgb(const struct yuv_image *src, const struct yuv_image *bottom,
+		struct rgb_image *dst)
+{
+	row_fn row;
+	unsigned int src_h, y, x, prev_sy = ~0u;
+	uint32_t *out, *prev_out = NULL;
+
+	if (!src || !dst || !dst->pixels || !src->width || !src->height ||
+			(unsigned int) src->format > YUV_FORMAT_NV12)
+		return -1;
+	/* CbCr pairs cover two columns */
+	if (src->format == YUV_FORMAT_NV12 && (src->width & 1))
+		return -1;
+	if (bottom && (bottom->format != src->format ||
+				bottom->width != src->width ||
+				bottom->height != src->height))
+		return -1;
+
+	row = row_fns[pick_backend()][src->format];
+	src_h = bottom ? 2 * src->height : src->height;
+
+	if (dst->width != src->width && scratch_prepare(src->width, dst->width) < 0)
+		return -1;
+
+	for (y = 0; y < dst->height; y++) {
+		unsigned int sy = (unsigned int) ((uint64_t) y * src_h / dst->height);
+		const struct yuv_image *field = src;
+		const uint8_t *p0, *p1 = NULL;
+
+		out = (uint32_t *) ((uint8_t *) dst->pixels + (size_t) y * dst->pitch);
+
+		/* downscaled or repeated source line, already converted */
+		if (sy == prev_sy) {
+			memcpy(out, prev_out, dst->width * sizeof(*out));
+			continue;
+		}
+
+		/* weave: even lines from the top field, odd from the bottom */
+		if (bottom) {
+			field = (sy & 1) ? bottom : src;
+			sy >>= 1;
+		}
+		p0 = field->plane[0] + (size_t) sy * field->pitch[0];
+		if (field->format == YUV_FORMAT_NV12)
+			p1 = field->plane[1] + (size_t) (sy >> 1) * field->pitch[1];
+
+		if (dst->width == src->width) {
+			row(p0, p1, out, dst->width);
+		} else {
+			row(p0, p1, scratch.line, src->width);
+			for (x = 0; x < dst->width; x++)
+				out[x] = scratch.line[scratch.xmap[x]];
+		}
+
+		prev_sy = (unsigned int) ((uint64_t) y * src_h / dst->height);
+		prev_out = out;
+	}
+
+	return 0;
+}
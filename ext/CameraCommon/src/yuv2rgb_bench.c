@@ -0,0 +1,142 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+/* Times yuv_to_xrgb for the camera formats and checks the SIMD row
+ * converters against the portable one.
+ * usage: yuv2rgb_bench [width height [out_width out_height [iterations]]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "yuv2rgb.h"
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void fill_image(struct yuv_image *img, enum yuv_format format,
+		unsigned int w, unsigned int h, uint8_t *data)
+{
+	memset(img, 0, sizeof(*img));
+	img->format = format;
+	img->width = w;
+	img->height = h;
+	img->plane[0] = data;
+	if (format == YUV_FORMAT_NV12) {
+		img->pitch[0] = w;
+		img->pitch[1] = w;
+		img->plane[1] = data + (size_t) w * h;
+	} else {
+		img->pitch[0] = w * 2;
+	}
+}
+
+static int run(const char *name, enum yuv_format format, int interlaced,
+		unsigned int iw, unsigned int ih, unsigned int ow, unsigned int oh,
+		unsigned int iterations)
+{
+	size_t size = (size_t) iw * ih * 2;
+	uint8_t *top = malloc(size), *bot = malloc(size);
+	struct rgb_image dst = { NULL, ow * 4, ow, oh };
+	uint32_t *ref = malloc((size_t) ow * oh * 4);
+	struct yuv_image src, field;
+	double start, ms;
+	unsigned int i;
+	int ret = -1;
+
+	dst.pixels = malloc((size_t) ow * oh * 4);
+	if (!top || !bot || !ref || !dst.pixels)
+		goto out;
+
+	for (i = 0; i < size; i++) {
+		top[i] = rand();
+		bot[i] = rand();
+	}
+	fill_image(&src, format, iw, ih, top);
+	fill_image(&field, format, iw, ih, bot);
+
+	yuv2rgb_force_scalar(1);
+	start = now_ms();
+	for (i = 0; i < iterations; i++)
+		yuv_to_xrgb(&src, interlaced ? &field : NULL, &dst);
+	ms = (now_ms() - start) / iterations;
+	memcpy(ref, dst.pixels, (size_t) ow * oh * 4);
+	printf("%-16s %-7s %8.3f ms/frame\n", name, "c", ms);
+
+	yuv2rgb_force_scalar(0);
+	start = now_ms();
+	for (i = 0; i < iterations; i++)
+		yuv_to_xrgb(&src, interlaced ? &field : NULL, &dst);
+	ms = (now_ms() - start) / iterations;
+	printf("%-16s %-7s %8.3f ms/frame\n", name, yuv2rgb_backend(), ms);
+
+	ret = memcmp(ref, dst.pixels, (size_t) ow * oh * 4) ? -1 : 0;
+	if (ret)
+		printf("%-16s MISMATCH between c and %s\n", name, yuv2rgb_backend());
+out:
+	free(top);
+	free(bot);
+	free(ref);
+	free(dst.pixels);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int iw = 720, ih = 240, ow = 1920, oh = 1080, iterations = 100;
+	int ret = 0;
+
+	if (argc > 2) {
+		iw = atoi(argv[1]);
+		ih = atoi(argv[2]);
+	}
+	if (argc > 4) {
+		ow = atoi(argv[3]);
+		oh = atoi(argv[4]);
+	}
+	if (argc > 5)
+		iterations = atoi(argv[5]);
+	if (!iw || !ih || !ow || !oh || !iterations) {
+		fprintf(stderr, "usage: %s [width height [out_width out_height [iterations]]]\n",
+				argv[0]);
+		return 1;
+	}
+
+	printf("%ux%u -> %ux%u, %u iterations\n", iw, ih, ow, oh, iterations);
+	ret |= run("uyvy", YUV_FORMAT_UYVY, 0, iw, ih, ow, oh, iterations);
+	ret |= run("uyvy interlaced", YUV_FORMAT_UYVY, 1, iw, ih, ow, oh, iterations);
+	ret |= run("yuyv", YUV_FORMAT_YUYV, 0, iw, ih, ow, oh, iterations);
+	ret |= run("nv12", YUV_FORMAT_NV12, 0, iw, ih, ow, oh, iterations);
+	ret |= run("uyvy 1:1", YUV_FORMAT_UYVY, 0, iw, ih, iw, ih, iterations);
+
+	return ret ? 1 : 0;
+}
@@ -37,6 +37,7 @@ typedef unsigned char __u8;
 
 int iciStartDisplay(struct setup, int, int, void*, int*);
 void iciStopDisplay(int);
+void iciReleaseDisplay(void);
 
 int initWlConnection(void);
 int disconnectWlConnection(void);
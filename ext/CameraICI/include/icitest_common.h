@@ -52,7 +52,10 @@ struct setup {
 	unsigned int port;
 	unsigned int fullscreen;
 	unsigned int interlaced;
+	unsigned int deinterlace;	/* enum deint_mode, when interlaced */
 	unsigned int frames_count;
+	unsigned int epoll_loop;	/* capture and render from one thread */
+	unsigned int cpu_convert;	/* YUV to RGB on the CPU into wl_shm buffers */
 	enum input stream_input;
 	int mem_type;
 };
@@ -66,6 +69,10 @@ extern int running;
 extern struct timeval *curr_time, *prev_time;
 #endif
 
+/* frame timing for earlyapp-camstat, NULL when shm is not available */
+struct cam_telemetry;
+extern struct cam_telemetry *ici_telemetry;
+
 #define _ISP_MODE_PREVIEW       0x8000
 #define _ISP_MODE_STILL         0x2000
 #define _ISP_MODE_VIDEO         0x4000
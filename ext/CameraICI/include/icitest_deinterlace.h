@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef ICITEST_DEINTERLACE_H
+#define ICITEST_DEINTERLACE_H
+
+#include <stdint.h>
+
+enum deint_mode {
+	DEINT_WEAVE,	/* interleave both fields as they are */
+	DEINT_BOB,	/* one field, missing lines interpolated */
+	DEINT_MOTION,	/* weave where still, interpolate where moving */
+};
+
+/*
+ * Builds progressive frames from the packed (UYVY) fields of an
+ * alternating field stream. Frames are twice the field height, top
+ * field on the even lines.
+ */
+struct deinterlacer {
+	enum deint_mode mode;
+	unsigned int line_bytes;	/* bytes per line, multiple of 4 */
+	unsigned int pitch;		/* bytes between field lines */
+	unsigned int field_lines;
+	unsigned int threshold;		/* per byte difference seen as motion */
+	uint8_t *frame;
+	uint8_t *prev_bottom;		/* previous bottom field, for motion */
+	int have_prev;
+};
+
+/* d must be zeroed or set up by an earlier deint_init */
+int deint_init(struct deinterlacer *d, enum deint_mode mode,
+		unsigned int line_bytes, unsigned int pitch,
+		unsigned int field_lines);
+void deint_fini(struct deinterlacer *d);
+
+/* Returns the progressive frame. A field without its partner is passed
+ * as both top and bottom and is always bobbed. */
+const uint8_t *deint_frame(struct deinterlacer *d, const uint8_t *top,
+		const uint8_t *bottom);
+
+#endif /*ICITEST_DEINTERLACE_H*/
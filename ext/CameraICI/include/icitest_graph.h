@@ -45,6 +45,8 @@
 #include <xf86drmMode.h>
 
 //#include "icitest_common.h"
+#include "icitest_deinterlace.h"
+#include "shm_frame.h"
 #include "wayland-drm-client-protocol.h"
 
 #define TARGET_NUM_SECONDS 5
@@ -52,8 +54,6 @@
 PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
-PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES;
-PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES;
 
 struct buffer {
 	drm_intel_bo *bo;
@@ -66,6 +66,7 @@ struct buffer {
 	void *start;
 	size_t length;
 	int is_top;
+	uint64_t frame_id;	/* telemetry record of the frame it holds */
 };
 
 struct output {
@@ -80,13 +81,17 @@ struct display {
 	struct wl_compositor *compositor;
 	struct wl_shell *wl_shell;
 	struct wl_drm *wl_drm;
+	struct wl_shm *shm;
+	struct shm_buffer shm_buffers[2];	/* when setup.cpu_convert is set */
 	struct window *window;
 	struct wl_list output_list;
 	int	strm_fd;
 	int drm_fd;
 	dri_bufmgr *bufmgr;
 	struct buffer *buffers;
+	/* top and bottom field, the same buffer when one arrived alone */
 	struct buffer *disp_bufs[2];
+	struct deinterlacer deint;
 	struct setup *s;
 	struct {
 		EGLDisplay dpy;
@@ -143,12 +148,14 @@ const struct wl_callback_listener frame_listener;
 const struct wl_registry_listener registry_listener;
 
 void destroy_surface(struct window *window);
+void redraw(void *data, struct wl_callback *callback, uint32_t time);
 void init_gl(struct window *window);
 void init_egl(struct display *display, int opaque);
 int init_gem(struct display *display);
 int drm_buffer_to_prime(struct display *display, struct buffer *buffer,
 		unsigned int size);
 void create_surface(struct window *window, void *gpioclass);
+int create_shm_buffers(struct display *display, int width, int height);
 void destroy_gem(struct display *display);
 int create_buffer(struct display *display, struct buffer *buffer,
 		unsigned int size);
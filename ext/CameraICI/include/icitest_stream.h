@@ -49,7 +49,8 @@ void free_buffers(struct buffer* buffers, int n_buffers, int mem_type);
 int queue_buffer(int dev_fd, struct buffer* buffers, int mem_type);
 int queue_buffers(int dev_fd, int buffer_count,
 		struct buffer* buffers, int mem_type);
-int dequeue_buffer(int dev_fd, int mem_type, int *is_top);
+int dequeue_buffer(int dev_fd, int mem_type, int *is_top,
+		struct timeval *timestamp);
 int stream_on(int dev_fd);
 void cleanup(int fd);
 
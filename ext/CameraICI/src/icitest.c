@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <linux/input.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <pthread.h>
@@ -43,6 +44,14 @@
 #include "icitest_time.h"
 #include "icitest_graph.h"
 #include "icitest_stream.h"
+#include "cam_telemetry.h"
+
+/* stream poll period while draining frames before the compositor is up */
+#define ICI_WAYLAND_POLL_MS 10
+
+extern void WaylandReady_wait(void);
+extern int WaylandReady_isReady(void);
+extern int WaylandReady_pollFd(void);
 
 int first_frame_received = 0;
 int first_frame_rendered = 0;
@@ -56,87 +65,195 @@ int pixelformat;
 int stream_id=-1;
 int m_ICIEnabled = 1;
 struct wl_display *g_display_connection = NULL;
+struct cam_telemetry *ici_telemetry = NULL;
+
+/* Pairing of alternating fields into frames */
+enum field_state {
+	FIELD_WAIT_TOP,		/* next frame starts with a top field */
+	FIELD_HAVE_TOP,		/* top field held, waiting for its bottom */
+};
+
+struct capture_state {
+	unsigned int total_received_frames;
+	int is_topbuf;
+	enum field_state field_state;
+	int top_idx;
+};
+
+static void capture_init(struct capture_state *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->is_topbuf = 1;
+	st->field_state = FIELD_WAIT_TOP;
+	st->top_idx = -1;
+}
+
+static void publish_fields(struct display *display, int top_idx, int bottom_idx)
+{
+	display->disp_bufs[0] = &display->buffers[top_idx];
+	display->disp_bufs[1] = &display->buffers[bottom_idx];
+	if (top_idx == bottom_idx)
+		cam_telemetry_flag(ici_telemetry, display->buffers[top_idx].frame_id,
+				CAM_FRAME_LONE_FIELD);
+}
+
+/*
+ * A field whose partner was lost is still shown on its own (as both
+ * fields, the renderer bobs it) rather than stalling the output until the
+ * stream gets back in step.
+ */
+static void pair_field(struct display *display, struct capture_state *st,
+		int buf_idx)
+{
+	if (st->is_topbuf) {
+		if (st->field_state == FIELD_HAVE_TOP)
+			publish_fields(display, st->top_idx, st->top_idx);
+		st->top_idx = buf_idx;
+		st->field_state = FIELD_HAVE_TOP;
+	} else if (st->field_state == FIELD_HAVE_TOP) {
+		publish_fields(display, st->top_idx, buf_idx);
+		st->top_idx = -1;
+		st->field_state = FIELD_WAIT_TOP;
+	} else {
+		publish_fields(display, buf_idx, buf_idx);
+	}
+}
+
+/* Dequeues one frame from the stream and publishes it in disp_bufs */
+static int capture_frame(struct display *display, struct capture_state *st)
+{
+	struct timeval timestamp;
+	int buf_idx = dequeue_buffer(display->strm_fd, display->s->mem_type,
+			&st->is_topbuf, &timestamp);
+
+	if(buf_idx > display->s->buffer_count || buf_idx < 0)
+	{
+		fprintf(stderr,"Failed to Deque Buffer\n");
+		return -1;
+	}
+
+	display->buffers[buf_idx].is_top = st->is_topbuf;
+	/* recorded before the buffer is published to redraw */
+	display->buffers[buf_idx].frame_id = cam_telemetry_capture(ici_telemetry,
+			cam_telemetry_tv_ns(&timestamp), buf_idx,
+			st->is_topbuf ? 0 : CAM_FRAME_BOTTOM);
+	if(display->s->interlaced){
+		pair_field(display, st, buf_idx);
+	} else {
+			display->disp_bufs[0] = &display->buffers[buf_idx];
+	}
+	queue_buffer(display->strm_fd, &display->buffers[buf_idx],
+			display->s->mem_type);
+	if (first_frame_received == 0) {
+		first_frame_received = 1;
+		GET_TS(time_measurements.first_frame_time);
+	}
+
+	st->total_received_frames++;
+	if (display->s->frames_count != 0 &&
+			st->total_received_frames >= display->s->frames_count) {
+		running = 0;
+	}
+	return 0;
+}
 
 static void polling_thread(void *data)
 {
 	struct display *display = (struct display *)data;
+	struct capture_state st;
 	struct pollfd fd;
-	unsigned int received_frames;
-	unsigned int total_received_frames;
-	struct timeval prev_time_th, curr_time_th;
-	struct timeval time_diff;
-	struct timeval tmp;
-	float time_diff_secs;
-	int is_topbuf = 1;
-	int prev_top_idx = -1;
 	fd.fd = display->strm_fd;
 	fd.events = POLLIN;
 
-	gettimeofday(&prev_time_th, NULL);
-	received_frames = 0;
-	total_received_frames = 0;
+	capture_init(&st);
 	while(running) {
 		if(poll(&fd, 1, 5000) > 0) {
 			if(fd.revents & POLLIN) {
-				int buf_idx = dequeue_buffer(fd.fd, display->s->mem_type,
-						&is_topbuf);
-
-				if(buf_idx > display->s->buffer_count || buf_idx < 0)
-				{
-					fprintf(stderr,"Failed to Deque Buffer\n");
+				if(capture_frame(display, &st) < 0)
 					break;
-				}
-
-				display->buffers[buf_idx].is_top = is_topbuf;
-				if(display->s->interlaced){
-					if(is_topbuf)
-						prev_top_idx = buf_idx;
-					else {
-						if(prev_top_idx < 0)
-							printf("***Warning Top buffer not received ****\n");
-						else {
-							display->disp_bufs[0] = &display->buffers[prev_top_idx];
-							display->disp_bufs[1] = &display->buffers[buf_idx];
-							prev_top_idx=-1;
-						}
-					}
-				} else {
-						display->disp_bufs[0] = &display->buffers[buf_idx];
-				}
-				queue_buffer(fd.fd, &display->buffers[buf_idx],
-						display->s->mem_type);
-				if (first_frame_received == 0) {
-					first_frame_received = 1;
-					GET_TS(time_measurements.first_frame_time);
-				}
-
-				received_frames++;
-				total_received_frames++;
-				if (display->s->frames_count != 0 &&
-						total_received_frames >= display->s->frames_count) {
-					running = 0;
-				}
-				gettimeofday(&curr_time_th, NULL);
-				timersub(&curr_time_th, &prev_time_th, &time_diff);
-				time_diff_secs = (time_diff.tv_sec * 1000 +
-						time_diff.tv_usec / 1000) / 1000;
-
-				if (time_diff_secs >= TARGET_NUM_SECONDS) {
-					fprintf(stdout, "Received %d frames from IPU in %6.3f seconds = %6.3f FPS\n",
-							received_frames, time_diff_secs, received_frames / time_diff_secs);
-					fflush(stdout);
-
-					received_frames = 0;
-
-					tmp = prev_time_th;
-					prev_time_th = curr_time_th;
-					curr_time_th = tmp;
-				}
 			}
 		}
 	}
 }
 
+/*
+ * Single threaded alternative to polling_thread + wl_display_dispatch: the
+ * stream fd and the wayland fd share one epoll set, so a frame dequeued
+ * here is drawn by the very next frame callback on the same thread.
+ */
+static int event_loop(struct display *display, struct capture_state *st)
+{
+	struct wl_display *wl = display->display;
+	struct epoll_event ev, events[2];
+	int wl_fd = wl_display_get_fd(wl);
+	int capturing = 1;
+	int efd, n, i, wl_ready;
+	int ret = 0;
+
+	efd = epoll_create1(EPOLL_CLOEXEC);
+	if(efd < 0) {
+		fprintf(stderr, "epoll_create1 failed: %s\n", ERRSTR);
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = display->strm_fd;
+	if(epoll_ctl(efd, EPOLL_CTL_ADD, display->strm_fd, &ev) < 0) {
+		fprintf(stderr, "epoll_ctl stream failed: %s\n", ERRSTR);
+		close(efd);
+		return -1;
+	}
+	ev.data.fd = wl_fd;
+	if(epoll_ctl(efd, EPOLL_CTL_ADD, wl_fd, &ev) < 0) {
+		fprintf(stderr, "epoll_ctl wayland failed: %s\n", ERRSTR);
+		close(efd);
+		return -1;
+	}
+
+	while (running && ret != -1) {
+		while (wl_display_prepare_read(wl) != 0)
+			wl_display_dispatch_pending(wl);
+
+		if (wl_display_flush(wl) < 0 && errno != EAGAIN) {
+			wl_display_cancel_read(wl);
+			ret = -1;
+			break;
+		}
+
+		n = epoll_wait(efd, events, 2, 5000);
+		if (n < 0) {
+			wl_display_cancel_read(wl);
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "epoll_wait failed: %s\n", ERRSTR);
+			ret = -1;
+			break;
+		}
+
+		/* take the new frame before dispatching the frame callback */
+		wl_ready = 0;
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == wl_fd) {
+				wl_ready = 1;
+			} else if (capturing && capture_frame(display, st) < 0) {
+				epoll_ctl(efd, EPOLL_CTL_DEL, display->strm_fd, NULL);
+				capturing = 0;
+			}
+		}
+
+		if (wl_ready)
+			ret = wl_display_read_events(wl);
+		else
+			wl_display_cancel_read(wl);
+
+		if (ret != -1)
+			ret = wl_display_dispatch_pending(wl);
+	}
+
+	close(efd);
+	return ret;
+}
 
 void format_setup(struct setup *s)
 {
@@ -229,107 +346,223 @@ int disconnectWlConnection(void)
 	return 0;
 }
 
-int iciStartDisplay(struct setup param, int io_stream_id, int start, void *gpioclass, int *ici_rdy)
-{
-	GET_TS(time_measurements.app_start_time);
+/* Everything that is kept alive between reverse camera sessions */
+struct ici_session {
+	struct setup s;
+	struct display display;
+	struct window window;
+	struct buffer *buffers;
+	int dev_fd;
+	int render_ready;
+};
 
-	struct setup s = param;
-	struct display display = { 0 };
-	struct window  window  = { 0 };
-	int ret = 0;
-	pthread_t poll_thread;
-	struct stat tmp;
-	char wayland_path[255];
+static struct ici_session session = { .dev_fd = -1 };
+
+static int session_open(struct ici_session *ss, struct setup param)
+{
+	struct display *display = &ss->display;
+	struct window *window = &ss->window;
 	unsigned long buf_size = 0;
-	int dev_fd;
-	/* if ici still not ready let us wait it till ready*/
-	/* with new earlyapp-fastboot, ipu4 modules will finish init
-	 * in 950ms after kernel start
-	 * */
-	if (!(*ici_rdy))
-		*ici_rdy = ConfigureICI(true);
 
-	stream_id = io_stream_id;
-	format_setup(&s);
+	ss->s = param;
+	format_setup(&ss->s);
+	if (ss->s.cpu_convert && ss->s.in_fourcc != ICI_FORMAT_UYVY) {
+		WARN_ON(1, "CPU conversion needs UYVY input, using GLES\n");
+		ss->s.cpu_convert = 0;
+	}
 
 	/* open the device */
-	dev_fd = open_device(s.stream);
-	if(dev_fd == -1)
+	ss->dev_fd = open_device(ss->s.stream);
+	if(ss->dev_fd == -1)
 	{
 		fprintf(stderr,"Failed to open device");
-		return 0;
+		return -1;
 	}
 
 	/* Do any specific intilization */
-	ret = init_stream(dev_fd);
-	if(ret) {
-		close_device(dev_fd);
+	if(init_stream(ss->dev_fd)) {
+		close_device(ss->dev_fd);
+		ss->dev_fd = -1;
 		fprintf(stderr,"Stream Init Failed\n");
-		return 0;
+		return -1;
 	}
 
-    s.stride_width = stream_fmt.pfmt.plane_fmt[0].bytesperline /
+	ss->s.stride_width = stream_fmt.pfmt.plane_fmt[0].bytesperline /
 		(stream_fmt.pfmt.plane_fmt[0].bpp >> 3);
 
 	/* Setup Buffers */
-	struct buffer buffers[s.buffer_count];
-	memset(buffers, 0, sizeof(struct buffer) * s.buffer_count);
+	ss->buffers = calloc(ss->s.buffer_count, sizeof(struct buffer));
+	if(!ss->buffers) {
+		fprintf(stderr, "Cannot allocate memory: %m\n");
+		close_device(ss->dev_fd);
+		ss->dev_fd = -1;
+		return -1;
+	}
 
-	if (s.mem_type == ICI_MEM_DMABUF)
-		init_gem(&display);
+	if (ss->s.mem_type == ICI_MEM_DMABUF)
+		init_gem(display);
 
 	buf_size = stream_fmt.pfmt.plane_fmt[0].sizeimage;
 	printf("bufsize: %lu\n", buf_size);
-	allocate_buffers(buffers, buf_size, s.buffer_count, s.mem_type, &display);
-
-	window.display = &display;
-	display.window = &window;
-	window.window_size.width  = s.ow;
-	window.window_size.height = s.oh;
-	window.fullscreen = s.fullscreen;
-	window.output = 0;
-	window.print_fps = 1;
-	display.s = &s;
-	display.strm_fd = dev_fd;
-	display.buffers = buffers;
+	allocate_buffers(ss->buffers, buf_size, ss->s.buffer_count,
+			ss->s.mem_type, display);
+
+	window->display = display;
+	display->window = window;
+	window->window_size.width  = ss->s.ow;
+	window->window_size.height = ss->s.oh;
+	window->fullscreen = ss->s.fullscreen;
+	window->output = 0;
+	window->print_fps = 1;
+	display->s = &ss->s;
+	display->strm_fd = ss->dev_fd;
+	display->buffers = ss->buffers;
+
+	return 0;
+}
+
+static void session_init_render(struct ici_session *ss, void *gpioclass)
+{
+	struct display *display = &ss->display;
+	struct window *window = &ss->window;
+
+	display->display = g_display_connection;
+	assert(display->display);
+	wl_list_init(&display->output_list);
+
+	display->registry = wl_display_get_registry(display->display);
+	wl_registry_add_listener(display->registry,
+			&registry_listener, display);
+
+	wl_display_dispatch(display->display);
+	wl_display_roundtrip(display->display);
+
+	if (ss->s.cpu_convert &&
+			create_shm_buffers(display, ss->s.ow, ss->s.oh) < 0) {
+		WARN_ON(1, "CPU conversion unavailable, using GLES\n");
+		ss->s.cpu_convert = 0;
+	}
+
+	if (!ss->s.cpu_convert)
+		init_egl(display, window->opaque);
+	create_surface(window, gpioclass);
+	if (!ss->s.cpu_convert)
+		init_gl(window);
+
+	ss->render_ready = 1;
+}
+
+/* Puts the kept surface back on screen from the calling thread */
+static void session_show(struct ici_session *ss)
+{
+	struct window *window = &ss->window;
+	EGLBoolean ret;
+
+	if (!ss->s.cpu_convert) {
+		ret = eglMakeCurrent(ss->display.egl.dpy, window->egl_surface,
+				window->egl_surface, ss->display.egl.ctx);
+		assert(ret == EGL_TRUE);
+	}
+
+	/* restart the frame callback chain */
+	redraw(window, NULL, 0);
+}
+
+/* Unmaps the surface but keeps the EGL surface, context and shaders, or
+ * the shm buffers */
+static void session_hide(struct ici_session *ss)
+{
+	struct window *window = &ss->window;
+
+	if (window->callback) {
+		wl_callback_destroy(window->callback);
+		window->callback = NULL;
+	}
+
+	wl_surface_attach(window->surface, NULL, 0, 0);
+	wl_surface_commit(window->surface);
+
+	if (!ss->s.cpu_convert)
+		eglMakeCurrent(ss->display.egl.dpy, EGL_NO_SURFACE,
+				EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	wl_display_flush(ss->display.display);
+}
+
+int iciStartDisplay(struct setup param, int io_stream_id, int start, void *gpioclass, int *ici_rdy)
+{
+	GET_TS(time_measurements.app_start_time);
+
+	struct ici_session *ss = &session;
+	struct display *display = &ss->display;
+	int ret = 0;
+	pthread_t poll_thread;
+	struct capture_state st;
+	struct pollfd strm_pfd[2];
+	/* if ici still not ready let us wait it till ready*/
+	/* with new earlyapp-fastboot, ipu4 modules will finish init
+	 * in 950ms after kernel start
+	 * */
+	if (!(*ici_rdy))
+		*ici_rdy = ConfigureICI(true);
+
+	if (!ici_telemetry) {
+		ici_telemetry = cam_telemetry_create("ici");
+		WARN_ON(!ici_telemetry, "camera telemetry disabled: %s\n", ERRSTR);
+	}
+
+	/* the stream, its buffers and the surface outlive a session */
+	if (ss->dev_fd == -1) {
+		stream_id = io_stream_id;
+		if (session_open(ss, param) < 0)
+			return 0;
+	}
+
+	display->disp_bufs[0] = NULL;
+	display->disp_bufs[1] = NULL;
 
 	/* IPU4_ICI Prepare for streaming */
-	if(queue_buffers(dev_fd, s.buffer_count, buffers, s.mem_type) < 0)
-		goto cleanup0;
+	if(queue_buffers(ss->dev_fd, ss->s.buffer_count, ss->buffers,
+				ss->s.mem_type) < 0)
+		goto release;
 
-	if(stream_on(dev_fd) < 0)
-		goto cleanup0;
+	if(stream_on(ss->dev_fd) < 0)
+		goto release;
 
 	running = start;
 	GET_TS(time_measurements.streamon_time);
 
 	/* IPU4_ICI Start Streaming*/
-	if(pthread_create(&poll_thread, NULL,
-				(void *) &polling_thread, (void *) &display)) {
+	if(!ss->s.epoll_loop && pthread_create(&poll_thread, NULL,
+				(void *) &polling_thread, (void *) display)) {
 		printf("Couldn't create polling thread\n");
 	}
 
-	snprintf(wayland_path, 255, "%s/wayland-0", getenv("XDG_RUNTIME_DIR"));
-	while (stat(wayland_path, &tmp) != 0) {
-		usleep(100);
-	}
-
-	GET_TS(time_measurements.weston_init_time);
-
-	display.display = g_display_connection;
-	assert(display.display);
-	wl_list_init(&display.output_list);
-
-	display.registry = wl_display_get_registry(display.display);
-	wl_registry_add_listener(display.registry,
-			&registry_listener, &display);
+	capture_init(&st);
+
+	if (!ss->render_ready) {
+		strm_pfd[0].fd = ss->dev_fd;
+		strm_pfd[0].events = POLLIN;
+		/* isReady() only connects to the socket once this fired */
+		strm_pfd[1].fd = WaylandReady_pollFd();
+		strm_pfd[1].events = POLLIN;
+
+		if (ss->s.epoll_loop) {
+			/* keep the stream drained until there is somewhere to draw */
+			while (!WaylandReady_isReady()) {
+				if (poll(strm_pfd, 2, ICI_WAYLAND_POLL_MS) > 0 &&
+						(strm_pfd[0].revents & POLLIN))
+					capture_frame(display, &st);
+			}
+		} else {
+			WaylandReady_wait();
+		}
 
-	wl_display_dispatch(display.display);
-	wl_display_roundtrip(display.display);
+		GET_TS(time_measurements.weston_init_time);
 
-	init_egl(&display, window.opaque);
-	create_surface(&window, gpioclass);
-	init_gl(&window);
+		session_init_render(ss, gpioclass);
+	} else {
+		session_show(ss);
+	}
 
 	GET_TS(time_measurements.rendering_init_time);
 
@@ -349,39 +582,69 @@ int iciStartDisplay(struct setup param, int io_stream_id, int start, void *gpioc
 
 	/* Main display loop */
 
-	while (running && ret != -1) {
-		ret = wl_display_dispatch(display.display);
+	if(ss->s.epoll_loop) {
+		event_loop(display, &st);
+	} else {
+		while (running && ret != -1) {
+			ret = wl_display_dispatch(display->display);
+		}
 	}
 
 	fprintf(stderr, "\nici-test exiting\n");
 	printf("\nici-test existing running = %d\n", running);
 
-	pthread_join(poll_thread, NULL);
+	if(!ss->s.epoll_loop)
+		pthread_join(poll_thread, NULL);
 
 	free(curr_time);
 	free(prev_time);
 
-	cleanup(dev_fd);
+	cleanup(ss->dev_fd);
+	session_hide(ss);
 
-cleanup0:
-	free_buffers(buffers, s.buffer_count, s.mem_type);
+	return 0;
 
-	if (s.mem_type == ICI_MEM_DMABUF)
-		destroy_gem(&display);
+release:
+	iciReleaseDisplay();
 
-	destroy_surface(&window);
+	return 0;
+}
 
-	close_device(dev_fd);
+void iciReleaseDisplay(void)
+{
+	struct ici_session *ss = &session;
+	struct display *display = &ss->display;
 
-	wl_shell_destroy(display.wl_shell);
-	printf("WL_SHELL destroy\n");
+	if (ss->dev_fd == -1)
+		return;
 
-	printf("WL_COMPOSITOR destroy\n");
-	wl_compositor_destroy(display.compositor);
+	free_buffers(ss->buffers, ss->s.buffer_count, ss->s.mem_type);
+	free(ss->buffers);
 
-	wl_display_flush(display.display);
+	if (ss->s.mem_type == ICI_MEM_DMABUF)
+		destroy_gem(display);
 
-	return 0;
+	close_device(ss->dev_fd);
+
+	if (ss->render_ready) {
+		deint_fini(&display->deint);
+		destroy_surface(&ss->window);
+		if (ss->s.cpu_convert)
+			shm_frame_destroy(display->shm_buffers);
+		if (display->shm)
+			wl_shm_destroy(display->shm);
+
+		wl_shell_destroy(display->wl_shell);
+		printf("WL_SHELL destroy\n");
+
+		printf("WL_COMPOSITOR destroy\n");
+		wl_compositor_destroy(display->compositor);
+
+		wl_display_flush(display->display);
+	}
+
+	memset(ss, 0, sizeof(*ss));
+	ss->dev_fd = -1;
 }
 
 void iciStopDisplay(int stop)
@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "icitest_deinterlace.h"
+
+/* Below this, a byte change between two bottom fields is treated as noise */
+#define DEINT_DEFAULT_THRESHOLD 12
+
+/* dst = (a + b + 1) / 2, the rounding of pavgb */
+static void line_avg(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		unsigned int n)
+{
+	unsigned int i = 0;
+
+#ifdef __SSE2__
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_avg_epu8(va, vb));
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = (a[i] + b[i] + 1) >> 1;
+}
+
+/*
+ * Bottom line of a motion adaptive frame. Every UYVY macropixel (4 bytes)
+ * that changed by more than thr since the previous bottom field is
+ * replaced by the average of the top lines around it, the rest is woven.
+ */
+static void line_motion(uint8_t *dst, const uint8_t *cur, const uint8_t *prev,
+		const uint8_t *above, const uint8_t *below, unsigned int n,
+		unsigned int thr)
+{
+	unsigned int i = 0, j;
+
+#ifdef __SSE2__
+	const __m128i vthr = _mm_set1_epi8((char) thr);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi32(-1);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *) (cur + i));
+		__m128i p = _mm_loadu_si128((const __m128i *) (prev + i));
+		__m128i interp = _mm_avg_epu8(
+				_mm_loadu_si128((const __m128i *) (above + i)),
+				_mm_loadu_si128((const __m128i *) (below + i)));
+		__m128i diff = _mm_or_si128(_mm_subs_epu8(c, p), _mm_subs_epu8(p, c));
+		/* 0xff for every byte within the threshold ... */
+		__m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(diff, vthr), zero);
+
+		/* ... and the macropixel is still only if all four are */
+		still = _mm_cmpeq_epi32(still, ones);
+		_mm_storeu_si128((__m128i *) (dst + i),
+				_mm_or_si128(_mm_and_si128(still, c),
+					_mm_andnot_si128(still, interp)));
+	}
+#endif
+	for (; i + 4 <= n; i += 4) {
+		int moving = 0;
+
+		for (j = i; j < i + 4; j++)
+			moving |= abs(cur[j] - prev[j]) > (int) thr;
+		for (j = i; j < i + 4; j++)
+			dst[j] = moving ? (above[j] + below[j] + 1) >> 1 : cur[j];
+	}
+}
+
+int deint_init(struct deinterlacer *d, enum deint_mode mode,
+		unsigned int line_bytes, unsigned int pitch,
+		unsigned int field_lines)
+{
+	deint_fini(d);
+
+	if (!line_bytes || (line_bytes & 3) || pitch < line_bytes || !field_lines)
+		return -1;
+
+	d->frame = malloc((size_t) line_bytes * field_lines * 2);
+	d->prev_bottom = malloc((size_t) line_bytes * field_lines);
+	if (!d->frame || !d->prev_bottom) {
+		deint_fini(d);
+		return -1;
+	}
+
+	d->mode = mode;
+	d->line_bytes = line_bytes;
+	d->pitch = pitch;
+	d->field_lines = field_lines;
+	d->threshold = DEINT_DEFAULT_THRESHOLD;
+	return 0;
+}
+
+void deint_fini(struct deinterlacer *d)
+{
+	free(d->frame);
+	free(d->prev_bottom);
+	memset(d, 0, sizeof(*d));
+}
+
+const uint8_t *deint_frame(struct deinterlacer *d, const uint8_t *top,
+		const uint8_t *bottom)
+{
+	const unsigned int n = d->line_bytes;
+	enum deint_mode mode = d->mode;
+	unsigned int r;
+
+	if (!d->frame)
+		return NULL;
+
+	/* a lone field, nothing to weave it with */
+	if (top == bottom)
+		mode = DEINT_BOB;
+	/* motion needs the previous bottom field, weave until there is one */
+	else if (mode == DEINT_MOTION && !d->have_prev)
+		mode = DEINT_WEAVE;
+
+	for (r = 0; r < d->field_lines; r++) {
+		const uint8_t *t = top + (size_t) r * d->pitch;
+		const uint8_t *t_next = r + 1 < d->field_lines ? t + d->pitch : t;
+		const uint8_t *b = bottom + (size_t) r * d->pitch;
+		uint8_t *even = d->frame + (size_t) 2 * r * n;
+		uint8_t *odd = even + n;
+
+		memcpy(even, t, n);
+		switch (mode) {
+		case DEINT_WEAVE:
+			memcpy(odd, b, n);
+			break;
+		case DEINT_BOB:
+			line_avg(odd, t, t_next, n);
+			break;
+		case DEINT_MOTION:
+			line_motion(odd, b, d->prev_bottom + (size_t) r * n,
+					t, t_next, n, d->threshold);
+			break;
+		}
+	}
+
+	if (d->mode == DEINT_MOTION && top != bottom) {
+		for (r = 0; r < d->field_lines; r++)
+			memcpy(d->prev_bottom + (size_t) r * n,
+					bottom + (size_t) r * d->pitch, n);
+		d->have_prev = 1;
+	}
+
+	return d->frame;
+}
@@ -37,14 +37,14 @@
 #include "icitest_common.h"
 #include "icitest_time.h"
 #include "icitest_graph.h"
+#include "cam_telemetry.h"
+#include "gl_program_cache.h"
+#include "shm_frame.h"
 
 extern void GPIOControl_outputPattern(void*);
 void * g_GpioClass = NULL;
 static int g_triggerOnce = 1;
 
-PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES = NULL;
-PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES = NULL;
-
 /* UYVY Interlace*/
 static const char *frag_shader_text_UYVY_interlaced  =
   "uniform sampler2D u_texture;"\
@@ -77,6 +77,36 @@ static const char *frag_shader_text_UYVY_interlaced  =
   "  gl_FragColor=resultcolor;"\
   "}";
 
+/* UYVY bob, only the top field, bottom lines interpolated */
+static const char *frag_shader_text_UYVY_bob  =
+  "uniform sampler2D u_texture;"\
+  "uniform bool swap_rb;"\
+  "varying mediump vec2 texcoord;"\
+  "varying mediump vec2 texsize;"\
+  "void main(void) {"\
+  "  mediump float y, u, v, tmp;"\
+  "  mediump vec4 resultcolor;"\
+  "  mediump vec4 raw = texture2D(u_texture, texcoord);"\
+  "	if (fract(texcoord.y * texsize.y) < 0.5)"\
+  "		raw = mix(raw, texture2D(u_texture,"\
+  "			texcoord - vec2(0.0, 1.0 / texsize.y)), 0.5);"\
+  "  if (fract(texcoord.x * texsize.x) < 0.5)"\
+  "    raw.a = raw.g;"\
+  "  u = raw.b-0.5;"\
+  "  v = raw.r-0.5;"\
+  "  if (swap_rb) {"\
+  "    tmp = u;"\
+  "    u = v;"\
+  "    v = tmp;"\
+  "  }"\
+  "  y = 1.1643*(raw.a-0.0625);"\
+  "  resultcolor.r = (y+1.5958*(v));"\
+  "  resultcolor.g = (y-0.39173*(u)-0.81290*(v));"\
+  "  resultcolor.b = (y+2.017*(u));"\
+  "  resultcolor.a = 1.0;"\
+  "  gl_FragColor=resultcolor;"\
+  "}";
+
   /* UYVY */
 static const char *frag_shader_text_UYVY  =
   "uniform sampler2D u_texture;"\
@@ -163,6 +193,20 @@ static const char *vert_shader_text =
   "}";
 
 
+/* Weave and bob run in the shader, motion adaptive on the CPU */
+static int deint_on_cpu(const struct setup *s)
+{
+	return s->interlaced && s->in_fourcc == ICI_FORMAT_UYVY &&
+		s->deinterlace == DEINT_MOTION;
+}
+
+/* Both fields go to the GPU, which samples one or both of them */
+static int deint_on_gpu(const struct setup *s)
+{
+	return s->interlaced && s->in_fourcc == ICI_FORMAT_UYVY &&
+		!deint_on_cpu(s);
+}
+
 void handle_ping(void *data, struct wl_shell_surface *shell_surface,
 		uint32_t serial);
 void handle_configure(void *data, struct wl_shell_surface *shell_surface,
@@ -209,32 +253,6 @@ get_default_output(struct display *display)
 	return NULL;
 }
 
-GLuint
-create_shader(struct window *window, const char *source, GLenum shader_type)
-{
-	GLuint shader;
-	GLint status;
-
-	shader = glCreateShader(shader_type);
-	assert(shader != 0);
-
-	glShaderSource(shader, 1, (const char **) &source, NULL);
-	glCompileShader(shader);
-
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-	if (!status) {
-		char log[1000];
-		GLsizei len;
-		glGetShaderInfoLog(shader, 1000, &len, log);
-		fprintf(stderr, "Error: compiling %s: %*s\n",
-				shader_type == GL_VERTEX_SHADER ? "vertex" : "fragment",
-				len, log);
-		exit(1);
-	}
-
-	return shader;
-}
-
 void handle_ping(void *data, struct wl_shell_surface *shell_surface,
 		uint32_t serial)
 {
@@ -296,13 +314,15 @@ void toggle_fullscreen(struct window *window, int fullscreen)
 
 void destroy_surface(struct window *window)
 {
-	/* Required, otherwise segfault in egl_dri2.c: dri2_make_current()
-	 * on eglReleaseThread(). */
-	eglMakeCurrent(window->display->egl.dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
-		       EGL_NO_CONTEXT);
-
-	eglDestroySurface(window->display->egl.dpy, window->egl_surface);
-	wl_egl_window_destroy(window->native);
+	if (!window->display->s->cpu_convert) {
+		/* Required, otherwise segfault in egl_dri2.c: dri2_make_current()
+		 * on eglReleaseThread(). */
+		eglMakeCurrent(window->display->egl.dpy, EGL_NO_SURFACE,
+				EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+		eglDestroySurface(window->display->egl.dpy, window->egl_surface);
+		wl_egl_window_destroy(window->native);
+	}
 	wl_shell_surface_destroy(window->shell_surface);
 	wl_surface_destroy(window->surface);
 
@@ -366,6 +386,9 @@ void redraw_egl_way(struct window *window, struct buffer *buf,
 
 	width = window->display->s->stride_width;
 	height = window->display->s->ih;
+	/* the CPU deinterlacer hands over full frames */
+	if (deint_on_cpu(window->display->s))
+		height *= 2;
 
 	if (window->display->s->in_fourcc == ICI_FORMAT_UYVY) {
 		width /= 2;
@@ -382,8 +405,8 @@ void redraw_egl_way(struct window *window, struct buffer *buf,
 	} else {
 		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
 			GL_RGBA, GL_UNSIGNED_BYTE, start);
-		if(window->display->s->in_fourcc == ICI_FORMAT_UYVY &&
-				window->display->s->interlaced && buf2_start) {
+		if(deint_on_gpu(window->display->s) &&
+				window->display->s->deinterlace == DEINT_WEAVE && buf2_start) {
 			glActiveTexture(GL_TEXTURE0 + 1);
 			glBindTexture(GL_TEXTURE_2D, window->gl.gl_tex_name[1]);
 			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
@@ -420,6 +443,59 @@ void redraw_egl_way(struct window *window, struct buffer *buf,
 	}
 }
 
+int create_shm_buffers(struct display *display, int width, int height)
+{
+	struct setup *s = display->s;
+
+	if (shm_frame_create(display->shm, display->shm_buffers, width, height,
+				"ici") < 0)
+		return -1;
+
+	/* init_gl sets this up on the GLES path */
+	if (deint_on_cpu(s))
+		BYE_ON(deint_init(&display->deint, DEINT_MOTION,
+					s->stride_width * 2, s->stride_width * 2,
+					s->ih) < 0,
+				"Cannot set up the deinterlacer\n");
+	return 0;
+}
+
+/*
+ * start is a full frame when the CPU deinterlacer ran. Otherwise woven
+ * fields are converted as a pair and bobbed ones as the top field alone,
+ * which the scaler doubles.
+ */
+static void redraw_shm_way(struct window *window, unsigned char *start,
+		unsigned char *buf2_start)
+{
+	struct display *display = window->display;
+	struct setup *s = display->s;
+	struct yuv_image top = { 0 }, bottom;
+	int weave;
+
+	top.format = YUV_FORMAT_UYVY;
+	top.plane[0] = start;
+	top.pitch[0] = s->stride_width * 2;
+	top.width = s->iw;
+	top.height = deint_on_cpu(s) ? s->ih * 2 : s->ih;
+	bottom = top;
+	bottom.plane[0] = buf2_start;
+	weave = deint_on_gpu(s) && s->deinterlace == DEINT_WEAVE && buf2_start;
+
+	if (shm_frame_present(window->surface, display->shm_buffers, &top,
+				weave ? &bottom : NULL, s->ow, s->oh) < 0)
+		return;
+
+	if(g_triggerOnce && g_GpioClass)
+		GPIOControl_outputPattern(g_GpioClass);
+
+	if (first_frame_received == 1 && first_frame_rendered == 0) {
+		first_frame_rendered = 1;
+		GET_TS(time_measurements.first_frame_rendered_time);
+		print_time_measurements();
+	}
+}
+
 void redraw(void *data, struct wl_callback *callback, uint32_t time)
 {
 	struct window *window = data;
@@ -447,7 +523,22 @@ void redraw(void *data, struct wl_callback *callback, uint32_t time)
 
 	update_fps(window);
 
-	redraw_egl_way(window, buf, start, buf2_start);
+	if (deint_on_cpu(disp->s)) {
+		/* until a bottom field shows up, bob the top one */
+		start = (unsigned char *) deint_frame(&disp->deint, start,
+				buf2_start ? buf2_start : start);
+		buf2_start = NULL;
+	}
+
+	if (disp->s->cpu_convert)
+		redraw_shm_way(window, start, buf2_start);
+	else
+		redraw_egl_way(window, buf, start, buf2_start);
+
+	if (disp->disp_bufs[0])
+		cam_telemetry_render(ici_telemetry, disp->disp_bufs[0]->frame_id);
+	if (disp->disp_bufs[1] && disp->disp_bufs[1] != disp->disp_bufs[0])
+		cam_telemetry_render(ici_telemetry, disp->disp_bufs[1]->frame_id);
 }
 
 void display_add_output(struct display *d, uint32_t id)
@@ -483,6 +574,9 @@ void registry_handle_global(void *data, struct wl_registry *registry,
 	} else if (!strcmp(interface, "wl_drm")) {
 		d->wl_drm =
 			wl_registry_bind(registry, name, &wl_drm_interface, 1);
+	} else if (!strcmp(interface, "wl_shm")) {
+		d->shm =
+			wl_registry_bind(registry, name, &wl_shm_interface, 1);
 	}
 }
 
@@ -556,6 +650,12 @@ void create_surface(struct window *window, void *gpioClass)
 
 	wl_shell_surface_set_title(window->shell_surface, "icitest");
 
+	/* frames are attached as wl_shm buffers, no EGL surface */
+	if (display->s->cpu_convert) {
+		toggle_fullscreen(window, window->fullscreen);
+		return;
+	}
+
 	window->native =
 		wl_egl_window_create(window->surface,
 				window->window_size.width,
@@ -574,91 +674,27 @@ void create_surface(struct window *window, void *gpioClass)
 
 void init_gl_shaders(struct window *window)
 {
-	GLint status;
-	GLuint frag, vert;
-	FILE* pf;
-	GLint shader_size;
-	GLenum shader_format;
-	char *shader_binary;
-	unsigned int got_binary_shader = 0;
-	unsigned int color_format;
-
-	window->gl.program = glCreateProgram();
-
-	if (glProgramBinaryOES) {
-		pf = fopen("shader.bin", "rb");
-		if (pf) {
-			fread(&shader_size, sizeof(shader_size), 1, pf);
-			fread(&shader_format, sizeof(shader_format), 1, pf);
-			fread(&color_format, sizeof(color_format), 1, pf);
-
-			if (color_format == window->display->s->in_fourcc) { 
-				shader_binary = malloc(shader_size);
-
-				fread(shader_binary, shader_size, 1, pf);
-
-				glProgramBinaryOES(window->gl.program,
-						   shader_format,
-						   shader_binary,
-						   shader_size);
-
-				free(shader_binary);
-				got_binary_shader = 1;
-			}
-			fclose(pf);
-		};
-	}
-	if (!got_binary_shader) {
-		vert = create_shader(window, vert_shader_text, GL_VERTEX_SHADER);
-
-		if (window->display->s->in_fourcc == ICI_FORMAT_UYVY) {
-			if(window->display->s->interlaced)
-				frag = create_shader(window,
-						frag_shader_text_UYVY_interlaced,
-						GL_FRAGMENT_SHADER);
-			else
-				frag = create_shader(window, frag_shader_text_UYVY, GL_FRAGMENT_SHADER);
-		} else if (window->display->s->in_fourcc == ICI_FORMAT_SGRBG8) {
-			frag = create_shader(window, frag_shader_text_SGRBG8, GL_FRAGMENT_SHADER);
-		} else {
-			frag = create_shader(window, frag_shader_text_RGB, GL_FRAGMENT_SHADER);
+	struct setup *s = window->display->s;
+	const char *frag = frag_shader_text_RGB;
+	const char *name = "ici-rgb";
+
+	if (s->in_fourcc == ICI_FORMAT_UYVY) {
+		frag = frag_shader_text_UYVY;
+		name = "ici-uyvy";
+		if (deint_on_gpu(s) && s->deinterlace == DEINT_BOB) {
+			frag = frag_shader_text_UYVY_bob;
+			name = "ici-uyvy-bob";
+		} else if (deint_on_gpu(s)) {
+			frag = frag_shader_text_UYVY_interlaced;
+			name = "ici-uyvy-weave";
 		}
-
-		glAttachShader(window->gl.program, frag);
-		glAttachShader(window->gl.program, vert);
-		glLinkProgram(window->gl.program);
+	} else if (s->in_fourcc == ICI_FORMAT_SGRBG8) {
+		frag = frag_shader_text_SGRBG8;
+		name = "ici-sgrbg8";
 	}
 
-	glGetProgramiv(window->gl.program, GL_LINK_STATUS, &status);
-	if (!status) {
-		char log[1000];
-		GLsizei len;
-		glGetProgramInfoLog(window->gl.program, 1000, &len, log);
-		fprintf(stderr, "Error: linking:\n%*s\n", len, log);
-		exit(1);
-	}
-
-	if (glProgramBinaryOES && !got_binary_shader) {
-		glGetProgramiv(window->gl.program, GL_PROGRAM_BINARY_LENGTH_OES,
-			       &shader_size);
-
-		shader_binary = malloc(shader_size);
-
-		glGetProgramBinaryOES(window->gl.program, shader_size, NULL,
-				      &shader_format, shader_binary);
-
-		pf = fopen("shader.bin", "wb");
-		if (pf) {
-			fwrite(&shader_size, sizeof(shader_size), 1, pf);
-			fwrite(&shader_format, sizeof(shader_format), 1, pf);
-			fwrite(&window->display->s->in_fourcc,
-					sizeof(window->display->s->in_fourcc), 1, pf);
-			fwrite(shader_binary, 1, shader_size, pf);
-
-			fclose(pf);
-		}
-		free(shader_binary);
-	}
+	window->gl.program = gl_program_cached(name, vert_shader_text, frag, NULL);
+	BYE_ON(!window->gl.program, "building the %s program failed\n", name);
 }
 
 
@@ -669,20 +705,10 @@ void init_gl(struct window *window)
 	const GLfloat HMI_H = 1.f;
 	const GLfloat HMI_Z = 0.f;
 	const char* gl_extensions = NULL;
-	GLint num_binary_program_formats = 0;
 	GLfloat u_max = 1.f;
 	
 	gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
 
-	if (strstr(gl_extensions, "GL_OES_get_program_binary")) {
-		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS_OES,
-				&num_binary_program_formats);
-		if (num_binary_program_formats) {
-			glProgramBinaryOES = (PFNGLPROGRAMBINARYOESPROC) eglGetProcAddress("glProgramBinaryOES");
-			glGetProgramBinaryOES = (PFNGLGETPROGRAMBINARYOESPROC) eglGetProcAddress("glGetProgramBinaryOES");
-		}
-	}
-
 	if (strstr(gl_extensions, "GL_OES_EGL_image_external")) {
 		glEGLImageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
 	}
@@ -717,10 +743,18 @@ void init_gl(struct window *window)
 	glActiveTexture(GL_TEXTURE0 + 0);
 	glBindTexture(GL_TEXTURE_2D, window->gl.gl_tex_name[0]);
 
-	if (window->display->s->in_fourcc == ICI_FORMAT_UYVY) {
+	if (deint_on_cpu(window->display->s)) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_width,
+				window->display->s->ih * 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		BYE_ON(deint_init(&window->display->deint, DEINT_MOTION,
+					window->display->s->stride_width * 2,
+					window->display->s->stride_width * 2,
+					window->display->s->ih) < 0,
+				"Cannot set up the deinterlacer\n");
+	} else if (window->display->s->in_fourcc == ICI_FORMAT_UYVY) {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_width,
 				window->display->s->ih, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-		if(window->display->s->interlaced) {
+		if(deint_on_gpu(window->display->s)) {
 			window->gl.gl_tex_sampler[1] = glGetUniformLocation(window->gl.program, "u_texture_bottom");
 			glUniform1i(window->gl.gl_tex_sampler[1], 1);
 
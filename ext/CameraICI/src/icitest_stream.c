@@ -187,7 +187,8 @@ int queue_buffers(int dev_fd, int buffer_count,
 	return 0;
 }
 
-int dequeue_buffer(int dev_fd, int mem_type, int *is_top)
+int dequeue_buffer(int dev_fd, int mem_type, int *is_top,
+		struct timeval *timestamp)
 {
 	struct ici_frame_info rcv_buf = {0};
 	rcv_buf.mem_type = mem_type;
@@ -200,6 +201,7 @@ int dequeue_buffer(int dev_fd, int mem_type, int *is_top)
 		*is_top = 0;
 	else
 		*is_top = 1;
+	*timestamp = rcv_buf.frame_timestamp;
 
 	return rcv_buf.frame_buf_id;
 }
@@ -37,6 +37,7 @@
 #include <sys/ioctl.h>
 #include <asm/types.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "ici.h"
 
@@ -50,6 +51,61 @@
 #define ARRAY_SIZE(array)	(sizeof(array) / sizeof((array)[0]))
 static int fd = -1;
 
+/* Media graph description, one "r", "f node:pad [ffmt:...]" or
+ * "l src:pad sink:pad [enabled]" command per line, '#' starts a comment */
+#define GRAPH_DESC_FILE "/usr/share/earlyapp/ici_graph.conf"
+/* The description resolved to node ids and pad indices, kept with the
+ * other runtime caches */
+#ifndef EARLYAPP_CACHE_DIR
+#define EARLYAPP_CACHE_DIR "/var/cache/earlyapp"
+#endif
+#define GRAPH_BLOB_FILE EARLYAPP_CACHE_DIR "/ici_graph.bin"
+#define GRAPH_BLOB_MAGIC 0x47494145 /* 'EAIG' */
+#define GRAPH_BLOB_VERSION 2
+
+/* GP2.0 ADV7481 CVBS graph, used when there is no description file */
+static const char default_graph_desc[] =
+	"r\n"
+	"f Intel IPU4 CSI2 BE SOC 0:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]\n"
+	"f Intel IPU4 CSI2 BE SOC 0:1 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]\n"
+	"f Intel IPU4 CSI-2 4 VC 0:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]\n"
+	"f Intel IPU4 CSI-2 4 VC 0:1 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]\n"
+	"f adv7481 cvbs binner:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]\n"
+	"f adv7481 cvbs binner:1 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]\n"
+	"f adv7481 cvbs pixel array:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]\n"
+	"l adv7481 cvbs pixel array:0 adv7481 cvbs binner:0 [enabled]\n"
+	"l adv7481 cvbs binner:1 Intel IPU4 CSI-2 4 VC 0:0 [enabled]\n"
+	"l Intel IPU4 CSI-2 4 VC 0:1 Intel IPU4 CSI2 BE SOC 0:0 [enabled]\n"
+	"l Intel IPU4 CSI2 BE SOC 0:1 Intel IPU4 CSI2 BE SOC 0 Stream:0 [enabled]\n";
+
+enum graph_op_type {
+	GRAPH_OP_LINK = 1,
+	GRAPH_OP_FORMAT
+};
+
+struct graph_op {
+	__u32 type;
+	union {
+		struct ici_link_desc link;
+		struct ici_pad_framefmt ffmt;
+	} u;
+};
+
+struct graph_blob_header {
+	__u32 magic;
+	__u32 version;
+	uint64_t desc_hash;	/* FNV-1a of the description it was compiled from */
+	uint64_t node_hash;	/* FNV-1a of the node name -> id table it resolved against */
+	__u32 op_count;
+	__u32 reserved;
+};
+
+struct graph {
+	struct graph_op *ops;
+	__u32 op_count;
+	__u32 op_alloc;
+};
+
 static char* find_node_by_id(int node);
 void get_node_list();
 void set_link(int pipeline_fd,
@@ -172,6 +228,46 @@ static void print_pad_props(struct ici_pad_framefmt *props)
 			props->ffmt.colorspace, props->ffmt.flags);
 }
 
+static struct graph_op *graph_add_op(struct graph *g, __u32 type);
+
+/* Adds a disabling link op for every link enabled right now */
+static int collect_active_links(struct graph *g)
+{
+	int i;
+	struct ici_node_desc *node_info;
+
+	if(!node_list)
+		get_node_list();
+
+	for (i=0; i < nodes_num; i++) {
+		int p;
+		node_info = &node_list[i];
+		for (p = 0; p < node_info->nr_pads; p++) {
+			int f;
+			struct ici_links_query links_query = {0};
+
+			links_query.pad.node_id = node_info->node_id;
+			links_query.pad.pad_idx = node_info->node_pad[p].pad_idx;
+
+			if (xioctl(fd, ICI_IOC_ENUM_LINKS, &links_query) < 0)
+				return -1;
+
+			for (f = 0; f < links_query.links_cnt; f++ ) {
+				if ((links_query.links[f].flags & ICI_LINK_FLAG_ENABLED)
+					&& !(links_query.links[f].flags & ICI_LINK_FLAG_BACKLINK))
+				{
+					struct graph_op *op = graph_add_op(g, GRAPH_OP_LINK);
+					if (!op)
+						return -1;
+					op->u.link = links_query.links[f];
+					op->u.link.flags = 0;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
 static void reset_active_links(void)
 {
 	int i;
@@ -431,20 +527,27 @@ static void parse_formats(char *ffmt_str,
 			ffmt->colorspace, ffmt->flags);
 }
 
-static void parse_pad_desc(char *pad_str, struct ici_pad_desc *pad_desc)
+static int parse_pad_desc(char *pad_str, struct ici_pad_desc *pad_desc)
 {
 	/*Get the pad values*/
 	char *toks[2];
+	int node;
 
 	memset(toks,0,(sizeof(char*)*2));
 	if (tokenize(pad_str, ":", 2, toks) != 2)
 		errno_exit("Incomplete number of node args \n", EINVAL);
 
-	pad_desc->node_id = find_node_by_name(toks[0]);
+	node = find_node_by_name(toks[0]);
+	if (node < 0) {
+		fprintf(stderr, "Unknown node '%s'\n", toks[0]);
+		return -1;
+	}
+	pad_desc->node_id = node;
 	pad_desc->pad_idx = get_pad_id(toks[1]);
 
 	PRINT_DBG("\nPad desc %d:%d \n", pad_desc->node_id,
 			pad_desc->pad_idx);
+	return 0;
 }
 
 static void get_arg_val(const char * src, const char *arg_name,
@@ -476,9 +579,8 @@ static void get_arg_val(const char * src, const char *arg_name,
 	PRINT_DBG("Arg val %s \n", arg_val);
 }
 
-static void do_setformat(char *opt_arg)
+static int parse_setformat(char *opt_arg, struct ici_pad_framefmt *pad_props)
 {
-	struct ici_pad_framefmt pad_props = {0};
 	char arg_name[250] = {0};
 
 	char *pos = strchr(opt_arg, '[');
@@ -488,11 +590,21 @@ static void do_setformat(char *opt_arg)
 
 	/* Get and parse pad*/
 	strncpy(arg_name, opt_arg, pos - opt_arg);
-	parse_pad_desc(arg_name, &pad_props.pad);
+	if (parse_pad_desc(arg_name, &pad_props->pad) < 0)
+		return -1;
 
 	/* Get and parse ffmt*/
 	get_arg_val(opt_arg, "ffmt:", ']', arg_name);
-	parse_formats(arg_name, &pad_props.ffmt);
+	parse_formats(arg_name, &pad_props->ffmt);
+	return 0;
+}
+
+static void do_setformat(char *opt_arg)
+{
+	struct ici_pad_framefmt pad_props = {0};
+
+	if (parse_setformat(opt_arg, &pad_props) < 0)
+		return;
 
 	if(open_pipe_device(false))
         {
@@ -501,9 +613,8 @@ static void do_setformat(char *opt_arg)
 }
 
 #define MAX_NUM_SET_FORMAT_ARGS 10
-void do_setlink(char *opt_arg)
+static int parse_setlink(char *opt_arg, struct ici_link_desc *link_desc)
 {
-	struct ici_link_desc link_desc = {0};
 	int num = 2;
 	char *toks[4];
 	char arg_val[250], src_node[250], dest_node[250];
@@ -512,6 +623,7 @@ void do_setlink(char *opt_arg)
 	int length = 0;
 	int idx = 0;
 	int arg_length = strlen(opt_arg);
+	int source, sink;
 
 	if(pos && pos2) {
 		length = pos2 - (pos+1);
@@ -519,13 +631,13 @@ void do_setlink(char *opt_arg)
 		arg_val[length] = '\0';
 
 		if(strstr(arg_val, "enabled"))
-			link_desc.flags |= ICI_LINK_FLAG_ENABLED;
+			link_desc->flags |= ICI_LINK_FLAG_ENABLED;
 		else
 			errno_exit("Flags not set\n", EINVAL);
 
 		arg_length = pos - opt_arg;
 	} else if(pos) {
-		link_desc.flags |= ICI_LINK_FLAG_ENABLED;
+		link_desc->flags |= ICI_LINK_FLAG_ENABLED;
 		arg_length = pos - opt_arg;
 	}
 
@@ -562,10 +674,26 @@ void do_setlink(char *opt_arg)
 		errno_exit("Incomplete number of args \n", EINVAL);
 	}
 
-	link_desc.source.node_id = find_node_by_name(toks[0]);
-	link_desc.source.pad_idx = get_pad_id(toks[1]);
-	link_desc.sink.node_id = find_node_by_name(toks[2]);
-	link_desc.sink.pad_idx = get_pad_id(toks[3]);
+	source = find_node_by_name(toks[0]);
+	sink = find_node_by_name(toks[2]);
+	if (source < 0 || sink < 0) {
+		fprintf(stderr, "Unknown node '%s'\n", source < 0 ? toks[0] : toks[2]);
+		return -1;
+	}
+
+	link_desc->source.node_id = source;
+	link_desc->source.pad_idx = get_pad_id(toks[1]);
+	link_desc->sink.node_id = sink;
+	link_desc->sink.pad_idx = get_pad_id(toks[3]);
+	return 0;
+}
+
+void do_setlink(char *opt_arg)
+{
+	struct ici_link_desc link_desc = {0};
+
+	if (parse_setlink(opt_arg, &link_desc) < 0)
+		return;
 
         if(open_pipe_device(false))
         {
@@ -595,25 +723,236 @@ void parse_args(char argc, char *strtext)
 	}
 }
 
-int ConfigureICI(bool w4pipline)
+static struct graph_op *graph_add_op(struct graph *g, __u32 type)
 {
-	// this configuration is for GP2.0 ici
-    if(open_pipe_device(w4pipline))
-    {
-        parse_args('r',"");
-        parse_args('f',"Intel IPU4 CSI2 BE SOC 0:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]");
-        parse_args('f',"Intel IPU4 CSI2 BE SOC 0:1 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]");
-        parse_args('f',"Intel IPU4 CSI-2 4 VC 0:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]");
-        parse_args('f',"Intel IPU4 CSI-2 4 VC 0:1 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]");
-        parse_args('f',"adv7481 cvbs binner:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]");
-        parse_args('f',"adv7481 cvbs binner:1 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]");
-        parse_args('f',"adv7481 cvbs pixel array:0 [ffmt:720x288,ICI_FORMAT_UYVY,ICI_FIELD_NONE,0,0]");
-        parse_args('l',"adv7481 cvbs pixel array:0 adv7481 cvbs binner:0 [enabled]");
-        parse_args('l',"adv7481 cvbs binner:1 Intel IPU4 CSI-2 4 VC 0:0 [enabled]");
-        parse_args('l',"Intel IPU4 CSI-2 4 VC 0:1 Intel IPU4 CSI2 BE SOC 0:0 [enabled]");
-        parse_args('l',"Intel IPU4 CSI2 BE SOC 0:1 Intel IPU4 CSI2 BE SOC 0 Stream:0 [enabled]");
-        return 1;
-    }
+	struct graph_op *op;
+
+	if (g->op_count == g->op_alloc) {
+		__u32 n = g->op_alloc ? g->op_alloc * 2 : 16;
+		struct graph_op *ops = realloc(g->ops, n * sizeof(*ops));
+		if (!ops)
+			return NULL;
+		g->ops = ops;
+		g->op_alloc = n;
+	}
+	op = &g->ops[g->op_count++];
+	memset(op, 0, sizeof(*op));
+	op->type = type;
+	return op;
+}
+
+#define GRAPH_HASH_INIT 0xcbf29ce484222325ULL
 
+static uint64_t graph_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* Returns the description text, to be freed by the caller */
+static char *graph_load_desc(void)
+{
+	struct stat st;
+	char *desc = NULL;
+	FILE *f = fopen(GRAPH_DESC_FILE, "r");
+
+	if (f && fstat(fileno(f), &st) == 0 && st.st_size > 0) {
+		desc = calloc(1, st.st_size + 1);
+		if (desc && fread(desc, 1, st.st_size, f) != (size_t) st.st_size) {
+			free(desc);
+			desc = NULL;
+		}
+	}
+	if (f)
+		fclose(f);
+
+	return desc ? desc : strdup(default_graph_desc);
+}
+
+/* Node ids depend on the order the drivers probed in, so a blob is only
+ * valid for the exact name -> id table it was resolved against */
+static uint64_t graph_node_hash(void)
+{
+	uint64_t hash = GRAPH_HASH_INIT;
+	int i;
+
+	if (!node_list)
+		get_node_list();
+
+	for (i = 0; i < nodes_num; i++) {
+		hash = graph_hash(hash, &node_list[i].node_id, sizeof(node_list[i].node_id));
+		hash = graph_hash(hash, node_list[i].name,
+				strnlen(node_list[i].name, sizeof(node_list[i].name)) + 1);
+	}
+	return hash;
+}
+
+/* Resolves every command to node ids and pad indices */
+static int graph_compile(char *desc, struct graph *g)
+{
+	char *line, *save = NULL;
+
+	for (line = strtok_r(desc, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		struct graph_op *op;
+		char cmd;
+
+		while (isspace(*line))
+			line++;
+		if (*line == '\0' || *line == '#')
+			continue;
+
+		cmd = *line++;
+		while (isspace(*line))
+			line++;
+
+		switch (cmd) {
+			case 'r':
+				if (collect_active_links(g) < 0)
+					return -1;
+			break;
+			case 'l':
+				op = graph_add_op(g, GRAPH_OP_LINK);
+				if (!op)
+					return -1;
+				if (parse_setlink(line, &op->u.link) < 0) {
+					fprintf(stderr, "Unknown node in link '%s'\n", line);
+					return -1;
+				}
+			break;
+			case 'f':
+				op = graph_add_op(g, GRAPH_OP_FORMAT);
+				if (!op)
+					return -1;
+				if (parse_setformat(line, &op->u.ffmt) < 0) {
+					fprintf(stderr, "Unknown node in format '%s'\n", line);
+					return -1;
+				}
+			break;
+			default:
+				fprintf(stderr, "Unknown graph command '%c'\n", cmd);
+				return -1;
+		}
+	}
 	return 0;
 }
+
+static int graph_apply(const struct graph *g)
+{
+	__u32 i;
+
+	for (i = 0; i < g->op_count; i++) {
+		struct graph_op op = g->ops[i];
+		int ret;
+
+		if (op.type == GRAPH_OP_LINK)
+			ret = xioctl(fd, ICI_IOC_SETUP_PIPE, &op.u.link);
+		else
+			ret = xioctl(fd, ICI_IOC_SET_FRAMEFMT, &op.u.ffmt);
+		if (ret < 0) {
+			fprintf(stderr, "graph op %u failed: %s\n", i, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int graph_read_blob(uint64_t desc_hash, uint64_t node_hash, struct graph *g)
+{
+	struct graph_blob_header hdr;
+	int ret = -1;
+	FILE *f = fopen(GRAPH_BLOB_FILE, "rb");
+
+	if (!f)
+		return -1;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+			hdr.magic == GRAPH_BLOB_MAGIC &&
+			hdr.version == GRAPH_BLOB_VERSION &&
+			hdr.desc_hash == desc_hash &&
+			hdr.node_hash == node_hash &&
+			hdr.op_count > 0) {
+		g->ops = calloc(hdr.op_count, sizeof(struct graph_op));
+		if (g->ops && fread(g->ops, sizeof(struct graph_op), hdr.op_count, f)
+				== hdr.op_count) {
+			g->op_count = g->op_alloc = hdr.op_count;
+			ret = 0;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static void graph_write_blob(uint64_t desc_hash, uint64_t node_hash, const struct graph *g)
+{
+	struct graph_blob_header hdr = {0};
+	char tmp_name[] = GRAPH_BLOB_FILE ".tmp";
+	FILE *f;
+
+	mkdir(EARLYAPP_CACHE_DIR, 0755);
+	f = fopen(tmp_name, "wb");
+
+	if (!f)
+		return;
+
+	hdr.magic = GRAPH_BLOB_MAGIC;
+	hdr.version = GRAPH_BLOB_VERSION;
+	hdr.desc_hash = desc_hash;
+	hdr.node_hash = node_hash;
+	hdr.op_count = g->op_count;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+			fwrite(g->ops, sizeof(struct graph_op), g->op_count, f) != g->op_count ||
+			fflush(f) != 0 || fsync(fileno(f)) != 0) {
+		fclose(f);
+		unlink(tmp_name);
+		return;
+	}
+	fclose(f);
+
+	if (rename(tmp_name, GRAPH_BLOB_FILE) != 0)
+		unlink(tmp_name);
+}
+
+int ConfigureICI(bool w4pipline)
+{
+	static int configured = 0;
+	struct graph g = {0};
+	uint64_t desc_hash, node_hash;
+	char *desc;
+
+	// links and formats stay set up for later sessions
+	if(configured)
+		return 1;
+
+	if(!open_pipe_device(w4pipline))
+		return 0;
+
+	desc = graph_load_desc();
+	if(!desc)
+		return 0;
+	desc_hash = graph_hash(GRAPH_HASH_INIT, desc, strlen(desc));
+	node_hash = graph_node_hash();
+
+	// fast path: apply the graph compiled on an earlier boot
+	if(graph_read_blob(desc_hash, node_hash, &g) == 0 && graph_apply(&g) == 0) {
+		configured = 1;
+	} else {
+		free(g.ops);
+		memset(&g, 0, sizeof(g));
+
+		if(graph_compile(desc, &g) == 0 && fd != -1 && graph_apply(&g) == 0) {
+			graph_write_blob(desc_hash, node_hash, &g);
+			configured = 1;
+		}
+	}
+
+	free(g.ops);
+	free(desc);
+	return configured;
+}
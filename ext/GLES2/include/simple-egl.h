@@ -3,7 +3,7 @@
 extern "C" {
 #endif
 //int simple_egl_main(int argc, char **argv);
-int simple_egl_main(void *gles_GpioClass);
+int simple_egl_main(void *gles_GpioClass, unsigned int swap_interval);
 #ifdef __cplusplus
 }
 #endif
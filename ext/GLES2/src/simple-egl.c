@@ -30,6 +30,7 @@
 #include <math.h>
 #include <assert.h>
 #include <signal.h>
+#include <time.h>
 
 #include <linux/input.h>
 
@@ -54,7 +55,9 @@
 #include "shared/weston-egl-ext.h"
 
 #include "simple-egl.h"
+#include "gl_program_cache.h"
 void * g_GlesGpioClass = NULL;
+extern void WaylandReady_wait(void);
 
 struct window;
 struct seat;
@@ -95,6 +98,9 @@ struct geometry {
 	int width, height;
 };
 
+/* Frame interval histogram, 1 ms per bucket, the last one collects the rest. */
+#define FRAME_HIST_BUCKETS 64
+
 struct window {
 	struct display *display;
 	struct geometry geometry, window_size;
@@ -105,6 +111,8 @@ struct window {
 	} gl;
 
 	uint32_t benchmark_time, frames;
+	uint64_t last_frame_us;
+	uint32_t frame_hist[FRAME_HIST_BUCKETS];
 	struct wl_egl_window *native;
 	struct wl_surface *surface;
 	struct ias_surface *shell_surface;
@@ -114,7 +122,12 @@ struct window {
 	EGLSurface egl_surface;
 	struct wl_callback *callback;
 	int fullscreen, maximized, opaque, buffer_size, frame_sync, output, delay;
+	int swap_interval;
 	bool wait_for_configure;
+	/* Size or fullscreen state changed: the next frame resets the
+	 * opaque region and damages the whole surface. */
+	bool resized;
+	bool presented;
 };
 
 static const char *vert_shader_text =
@@ -232,8 +245,9 @@ init_egl(struct display *display, struct window *window)
 
 	display->swap_buffers_with_damage = NULL;
 	extensions = eglQueryString(display->egl.dpy, EGL_EXTENSIONS);
-	if (extensions &&
-	    weston_check_egl_extension(extensions, "EGL_EXT_buffer_age")) {
+	/* Every frame clears the whole buffer, so the damage only has to
+	 * describe the change to the compositor and buffer age is not needed. */
+	if (extensions) {
 		for (i = 0; i < (int) ARRAY_LENGTH(swap_damage_ext_to_entrypoint); i++) {
 			if (weston_check_egl_extension(extensions,
 						       swap_damage_ext_to_entrypoint[i].extension)) {
@@ -247,7 +261,7 @@ init_egl(struct display *display, struct window *window)
 	}
 
 	if (display->swap_buffers_with_damage)
-		printf("has EGL_EXT_buffer_age and %s\n", swap_damage_ext_to_entrypoint[i].extension);
+		printf("has %s\n", swap_damage_ext_to_entrypoint[i].extension);
 
 }
 
@@ -258,65 +272,22 @@ fini_egl(struct display *display)
 	eglReleaseThread();
 }
 
-static GLuint
-create_shader(struct window *window, const char *source, GLenum shader_type)
-{
-	GLuint shader;
-	GLint status;
-
-	shader = glCreateShader(shader_type);
-	assert(shader != 0);
-
-	glShaderSource(shader, 1, (const char **) &source, NULL);
-	glCompileShader(shader);
-
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-	if (!status) {
-		char log[1000];
-		GLsizei len;
-		glGetShaderInfoLog(shader, 1000, &len, log);
-		fprintf(stderr, "Error: compiling %s: %*s\n",
-			shader_type == GL_VERTEX_SHADER ? "vertex" : "fragment",
-			len, log);
-		exit(1);
-	}
-
-	return shader;
-}
-
 static void
 init_gl(struct window *window)
 {
-	GLuint frag, vert;
+	/* bound to locations 0 and 1 */
+	static const char *const attribs[] = { "pos", "color", NULL };
 	GLuint program;
-	GLint status;
-
-	frag = create_shader(window, frag_shader_text, GL_FRAGMENT_SHADER);
-	vert = create_shader(window, vert_shader_text, GL_VERTEX_SHADER);
-
-	program = glCreateProgram();
-	glAttachShader(program, frag);
-	glAttachShader(program, vert);
-	glLinkProgram(program);
-
-	glGetProgramiv(program, GL_LINK_STATUS, &status);
-	if (!status) {
-		char log[1000];
-		GLsizei len;
-		glGetProgramInfoLog(program, 1000, &len, log);
-		fprintf(stderr, "Error: linking:\n%*s\n", len, log);
+
+	program = gl_program_cached("simple-egl", vert_shader_text, frag_shader_text, attribs);
+	if (!program)
 		exit(1);
-	}
 
 	glUseProgram(program);
 
 	window->gl.pos = 0;
 	window->gl.col = 1;
 
-	glBindAttribLocation(program, window->gl.pos, "pos");
-	glBindAttribLocation(program, window->gl.col, "color");
-	glLinkProgram(program);
-
 	window->gl.rotation_uniform =
 		glGetUniformLocation(program, "rotation");
 }
@@ -373,6 +344,7 @@ handle_toplevel_configure(void *data, struct zxdg_toplevel_v6 *toplevel,
 		wl_egl_window_resize(window->native,
 				     window->geometry.width,
 				     window->geometry.height, 0, 0);
+	window->resized = true;
 }
 
 static void
@@ -404,6 +376,7 @@ ias_handle_configure(void *data, struct ias_surface *ias_surface,
 
 	window->geometry.width = width;
 	window->geometry.height = height;
+	window->resized = true;
 
 	if (!window->fullscreen)
 		window->window_size = window->geometry;
@@ -424,6 +397,7 @@ handle_ivi_surface_configure(void *data, struct ivi_surface *ivi_surface,
 
 	window->geometry.width = width;
 	window->geometry.height = height;
+	window->resized = true;
 
 	if (!window->fullscreen)
 		window->window_size = window->geometry;
@@ -519,8 +493,8 @@ create_surface(struct window *window)
 			     window->egl_surface, window->display->egl.ctx);
 	assert(ret == EGL_TRUE);
 
-	if (!window->frame_sync)
-		eglSwapInterval(display->egl.dpy, 0);
+	eglSwapInterval(display->egl.dpy, window->swap_interval);
+	window->resized = true;
 
 	if (!display->shell)
 		return;
@@ -556,6 +530,85 @@ destroy_surface(struct window *window)
 		wl_callback_destroy(window->callback);
 }
 
+static const struct wl_callback_listener frame_listener;
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+frame_hist_add(struct window *window, uint64_t now)
+{
+	uint64_t ms;
+
+	if (window->last_frame_us) {
+		ms = (now - window->last_frame_us) / 1000;
+		if (ms >= FRAME_HIST_BUCKETS)
+			ms = FRAME_HIST_BUCKETS - 1;
+		window->frame_hist[ms]++;
+	}
+	window->last_frame_us = now;
+}
+
+static void
+frame_hist_print(struct window *window)
+{
+	static const uint32_t pct[] = { 50, 90, 99 };
+	uint32_t total = 0, seen = 0;
+	int i, p = 0, max = 0;
+
+	for (i = 0; i < FRAME_HIST_BUCKETS; i++) {
+		total += window->frame_hist[i];
+		if (window->frame_hist[i])
+			max = i;
+	}
+	if (total == 0)
+		return;
+
+	printf("frame time");
+	for (i = 0; i < FRAME_HIST_BUCKETS && p < (int) ARRAY_LENGTH(pct); i++) {
+		seen += window->frame_hist[i];
+		while (p < (int) ARRAY_LENGTH(pct) && seen * 100 >= total * pct[p])
+			printf(" p%u %s%d ms,", pct[p++],
+			       i == FRAME_HIST_BUCKETS - 1 ? ">=" : "<",
+			       i == FRAME_HIST_BUCKETS - 1 ? i : i + 1);
+	}
+	printf(" max %s%d ms\n", max == FRAME_HIST_BUCKETS - 1 ? ">=" : "<",
+	       max == FRAME_HIST_BUCKETS - 1 ? max : max + 1);
+
+	for (i = 0; i < FRAME_HIST_BUCKETS; i++) {
+		if (!window->frame_hist[i])
+			continue;
+		if (i == FRAME_HIST_BUCKETS - 1)
+			printf("  >=%2d ms: %u\n", i, window->frame_hist[i]);
+		else
+			printf("  %2d-%2d ms: %u\n", i, i + 1, window->frame_hist[i]);
+	}
+	memset(window->frame_hist, 0, sizeof(window->frame_hist));
+}
+
+static void
+update_opaque_region(struct window *window)
+{
+	struct wl_region *region;
+
+	if (window->opaque || window->fullscreen) {
+		region = wl_compositor_create_region(window->display->compositor);
+		wl_region_add(region, 0, 0,
+			      window->geometry.width,
+			      window->geometry.height);
+		wl_surface_set_opaque_region(window->surface, region);
+		wl_region_destroy(region);
+	} else {
+		wl_surface_set_opaque_region(window->surface, NULL);
+	}
+}
+
 static void
 redraw(void *data, struct wl_callback *callback, uint32_t time)
 {
@@ -579,10 +632,8 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 		{ 0, 0, 0, 1 }
 	};
 	static const uint32_t speed_div = 5, benchmark_interval = 5;
-	struct wl_region *region;
 	EGLint rect[4];
-	EGLint buffer_age = 0;
-	struct timeval tv;
+	uint64_t now;
 
 	assert(window->callback == callback);
 	window->callback = NULL;
@@ -590,8 +641,9 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 	if (callback)
 		wl_callback_destroy(callback);
 
-	gettimeofday(&tv, NULL);
-	time = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	now = now_us();
+	frame_hist_add(window, now);
+	time = now / 1000;
 	if (window->frames == 0)
 		window->benchmark_time = time;
 	if (time - window->benchmark_time > (benchmark_interval * 1000)) {
@@ -599,6 +651,7 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 		       window->frames,
 		       benchmark_interval,
 		       (float) window->frames / benchmark_interval);
+		frame_hist_print(window);
 		window->benchmark_time = time;
 		window->frames = 0;
 	}
@@ -609,10 +662,6 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 	rotation[2][0] = -sin(angle);
 	rotation[2][2] =  cos(angle);
 
-	if (display->swap_buffers_with_damage)
-		eglQuerySurface(display->egl.dpy, window->egl_surface,
-				EGL_BUFFER_AGE_EXT, &buffer_age);
-
 	glViewport(0, 0, window->geometry.width, window->geometry.height);
 
 	glUniformMatrix4fv(window->gl.rotation_uniform, 1, GL_FALSE,
@@ -631,37 +680,48 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 	glDisableVertexAttribArray(window->gl.pos);
 	glDisableVertexAttribArray(window->gl.col);
 
-	usleep(window->delay);
-
-	if (window->opaque || window->fullscreen) {
-		region = wl_compositor_create_region(window->display->compositor);
-		wl_region_add(region, 0, 0,
-			      window->geometry.width,
-			      window->geometry.height);
-		wl_surface_set_opaque_region(window->surface, region);
-		wl_region_destroy(region);
+	if (window->delay > 0)
+		usleep(window->delay);
+
+	/* Only the triangle moves, everything else stays the clear colour
+	 * once a full frame has been shown at this size. */
+	if (window->resized) {
+		update_opaque_region(window);
+		rect[0] = 0;
+		rect[1] = 0;
+		rect[2] = window->geometry.width;
+		rect[3] = window->geometry.height;
+		window->resized = false;
 	} else {
-		wl_surface_set_opaque_region(window->surface, NULL);
-	}
-
-	if (display->swap_buffers_with_damage && buffer_age > 0) {
 		rect[0] = window->geometry.width / 4 - 1;
 		rect[1] = window->geometry.height / 4 - 1;
 		rect[2] = window->geometry.width / 2 + 2;
 		rect[3] = window->geometry.height / 2 + 2;
+	}
+
+	if (window->frame_sync) {
+		window->callback = wl_surface_frame(window->surface);
+		wl_callback_add_listener(window->callback, &frame_listener, window);
+	}
+
+	if (display->swap_buffers_with_damage)
 		display->swap_buffers_with_damage(display->egl.dpy,
 						  window->egl_surface,
 						  rect, 1);
-	} else {
+	else
 		eglSwapBuffers(display->egl.dpy, window->egl_surface);
-	}
 
-	if(g_GlesGpioClass)
+	if (!window->presented && g_GlesGpioClass)
 		GPIOControl_outputPattern(g_GlesGpioClass);
+	window->presented = true;
 
 	window->frames++;
 }
 
+static const struct wl_callback_listener frame_listener = {
+	redraw
+};
+
 static void
 pointer_handle_enter(void *data, struct wl_pointer *pointer,
 		     uint32_t serial, struct wl_surface *surface,
@@ -816,10 +876,12 @@ keyboard_handle_key(void *data, struct wl_keyboard *keyboard,
 				ias_shell_set_zorder(d->ias_shell,
 						d->window->shell_surface, 0);
 				d->window->fullscreen = 0;
+				d->window->resized = true;
 			} else {
 				ias_surface_set_fullscreen(d->window->shell_surface,
 						get_default_output(d)->output);
 				d->window->fullscreen = 1;
+				d->window->resized = true;
 			}
 		}
 	} else if (key == KEY_ESC && state) {
@@ -986,7 +1048,7 @@ usage(int error_code)
 }
 
 int
-simple_egl_main(void *gles_GpioClass)
+simple_egl_main(void *gles_GpioClass, unsigned int swap_interval)
 //simple_egl_main(int argc, char **argv)
 {
 	struct sigaction sigint;
@@ -994,7 +1056,6 @@ simple_egl_main(void *gles_GpioClass)
 	struct window  window  = { 0 };
 	int i, ret = 0;
 	struct output *iter, *next;
-	int repeat_delay = 50000;
 
 	window.display = &display;
 	display.window = &window;
@@ -1002,7 +1063,7 @@ simple_egl_main(void *gles_GpioClass)
 	window.geometry.height = 1000; //250;
 	window.window_size = window.geometry;
 	window.buffer_size = 32;
-	window.frame_sync = 1;
+	window.swap_interval = swap_interval;
 	window.delay = 0;
 
 	g_GlesGpioClass = gles_GpioClass;
@@ -1019,16 +1080,16 @@ simple_egl_main(void *gles_GpioClass)
 		else if (strcmp("-s", argv[i]) == 0)
 			window.buffer_size = 16;
 		else if (strcmp("-b", argv[i]) == 0)
-			window.frame_sync = 0;
+			window.swap_interval = 0;
 		else if (strcmp("-h", argv[i]) == 0)
 			usage(EXIT_SUCCESS);
 		else
 			usage(EXIT_FAILURE);
 	}
 #endif
-	while (!display.display && repeat_delay--) {
-		display.display = wl_display_connect(NULL);
-	}
+	window.frame_sync = window.swap_interval > 0;
+	WaylandReady_wait();
+	display.display = wl_display_connect(NULL);
 	assert(display.display);
 	wl_list_init(&display.output_list);
 
@@ -1050,16 +1111,22 @@ simple_egl_main(void *gles_GpioClass)
 	sigint.sa_flags = SA_RESETHAND;
 	sigaction(SIGINT, &sigint, NULL);
 
-	/* The mainloop here is a little subtle.  Redrawing will cause
-	 * EGL to read events so we can just call
-	 * wl_display_dispatch_pending() to handle any events that got
-	 * queued up as a side effect. */
+	/* The mainloop here is a little subtle.  With frame sync the first
+	 * redraw requests a frame callback and every later one is driven
+	 * by the compositor from wl_display_dispatch().  Without it we
+	 * redraw as fast as EGL lets us; redrawing will cause EGL to read
+	 * events so we can just call wl_display_dispatch_pending() to
+	 * handle any events that got queued up as a side effect. */
 	while (running && ret != -1) {
 		if (window.wait_for_configure) {
-			wl_display_dispatch(display.display);
-		} else {
-			wl_display_dispatch_pending(display.display);
+			ret = wl_display_dispatch(display.display);
+		} else if (!window.frame_sync) {
+			ret = wl_display_dispatch_pending(display.display);
 			redraw(&window, NULL, 0);
+		} else if (!window.callback) {
+			redraw(&window, NULL, 0);
+		} else {
+			ret = wl_display_dispatch(display.display);
 		}
 	}
 
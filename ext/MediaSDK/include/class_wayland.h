@@ -28,6 +28,7 @@ extern "C"
 #include <poll.h>
 #include <wayland-client.h>
 #include "wayland-drm-client-protocol.h"
+#include "mfxstructures.h"
 
 /* ShmPool Struct */
 struct ShmPool {
@@ -37,6 +38,14 @@ struct ShmPool {
     unsigned size;
 };
 
+/* wl_buffer wrapping one decoder surface.
+   Created once per surface and reused until the surface pool is freed. */
+struct wld_buffer {
+    struct wl_buffer *buffer;
+    mfxFrameSurface1 *pInSurface;
+    int handle;               // prime fd the buffer was imported from
+};
+
 class Wayland {
     public:
         Wayland();
@@ -45,7 +54,7 @@ class Wayland {
         virtual bool CreateSurface();
         virtual void FreeSurface();
         virtual void SetRenderWinPos(int x, int y);
-        virtual void RenderBuffer(struct wl_buffer *buffer
+        virtual void RenderBuffer(struct wld_buffer *buffer
             , int32_t width
             , int32_t height);
         virtual void RenderBufferWinPosSize(struct wl_buffer *buffer
@@ -74,6 +83,11 @@ class Wayland {
             , uint32_t format
             , int32_t offsets[3]
             , int32_t pitches[3]);
+        /* Route release events of a cached buffer to buffer_release */
+        void AddBufferListener(struct wld_buffer *buffer);
+        /* Dispatch pending buffer releases without blocking, so surfaces
+           get back to the decoder with no frame callback outstanding */
+        virtual void DispatchReleases();
         struct wl_display * GetDisplay() { return m_display; }
         struct wl_registry * GetRegistry() { return m_registry; }
         struct wl_compositor * GetCompositor() { return m_compositor; }
@@ -130,6 +144,7 @@ class Wayland {
         struct wl_shell_surface *m_shell_surface;
         struct wl_callback *m_callback;
         struct wl_event_queue *m_event_queue;
+        struct wl_event_queue *m_release_queue;
         volatile int m_pending_frame;
         struct ShmPool *m_shm_pool;
         int m_display_fd;
@@ -0,0 +1,84 @@
+/******************************************************************************\
+Copyright (c) 2005-2018, Intel Corporation
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**********************************************************************************/
+
+#ifndef __FRAME_CACHE_H__
+#define __FRAME_CACHE_H__
+
+#include <vector>
+
+#include "mfxstructures.h"
+#include "sample_defs.h"
+#include "vm/thread_defs.h"
+
+// Trailer of a cached frame file, the XRGB8888 pixels start at offset 0.
+struct FrameCacheTrailer
+{
+    mfxU32 magic;   // FRAME_CACHE_MAGIC
+    mfxU32 version; // FRAME_CACHE_VERSION
+    mfxU64 hash;    // identity of the stream the frame was decoded from
+    mfxU32 width;
+    mfxU32 height;
+    mfxU32 pitch;   // bytes per pixel row
+    mfxU32 reserved;
+};
+
+/** \brief First decoded frame of a stream kept as a raw XRGB8888 file.
+ *
+ * The file lives in EARLYAPP_CACHE_DIR, named after the stream, and is only
+ * trusted while the stream's inode, size, mtime and header bytes match, so it
+ * can be put on screen through wl_shm before the decoder has produced anything.
+ */
+class CFrameCache
+{
+public:
+    CFrameCache();
+    virtual ~CFrameCache();
+
+    /** \brief Identifies the stream and opens its cached frame if it is still valid. */
+    mfxStatus Open(const msdk_char* strSrcFile);
+    /** \brief Copies the given (locked) NV12 or RGB4 frame and replaces the cache
+     *  file with it on a writer thread.
+     */
+    mfxStatus Store(mfxFrameSurface1* pSurface);
+    /** \brief Waits for the writer thread and closes the cache file. */
+    void Close();
+
+    bool IsValid() const      { return m_fd >= 0; }
+    // a new frame is wanted once per run when the file was missing or stale
+    bool NeedsUpdate() const  { return m_bNeedsUpdate; }
+    int GetFd() const         { return m_fd; }
+    mfxU32 GetWidth() const   { return m_trailer.width; }
+    mfxU32 GetHeight() const  { return m_trailer.height; }
+    mfxU32 GetPitch() const   { return m_trailer.pitch; }
+
+protected:
+    static unsigned int MFX_STDCALL WriteThreadFunc(void* ctx);
+    mfxStatus Write();
+
+    int                 m_fd; // cache file, opened read-write as wl_shm maps it shared
+    bool                m_bNeedsUpdate;
+    mfxU64              m_hash;
+    FrameCacheTrailer   m_trailer;
+    msdk_char           m_strCacheFile[MSDK_MAX_FILENAME_LEN];
+    MSDKThread*         m_pWriter;
+    mfxU32              m_FourCC; // of m_frame, NV12 planes or XRGB8888 rows
+    std::vector<mfxU8>  m_frame;  // copy of the stored frame with pitch = width
+
+private:
+    CFrameCache(const CFrameCache&);
+    void operator=(const CFrameCache&);
+};
+
+#endif // __FRAME_CACHE_H__
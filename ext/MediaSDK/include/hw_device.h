@@ -35,6 +35,10 @@ public:
         mfxHDL hWindow,
         mfxU16 nViews,
         mfxU32 nAdapterNum) = 0;
+    /** Creates the output window for a device initialized with nViews == 0,
+    so rendering can be bound after decoding has already started.
+    */
+    virtual mfxStatus InitWindow() = 0;
     /// Reset device.
     virtual mfxStatus Reset() = 0;
     /// Get handle can be used for MFX session SetHandle calls
@@ -44,6 +48,12 @@ public:
     */
     virtual mfxStatus SetHandle(mfxHandleType type, mfxHDL hdl) = 0;
     virtual mfxStatus RenderFrame(mfxFrameSurface1 * pSurface, mfxFrameAllocator * pmfxAlloc) = 0;
+    /** Shows a prerendered XRGB8888 frame until the first RenderFrame replaces it.
+    @param[in] fd File holding the pixels at offset 0, mapped shared by the compositor.
+    */
+    virtual mfxStatus RenderStillFrame(int fd, mfxU32 width, mfxU32 height, mfxU32 pitch) = 0;
+    /// Drop the render lock of surfaces the display is done with, without blocking.
+    virtual void      ReleaseSurfaces() = 0;
     virtual void      UpdateTitle(double fps) = 0;
     virtual void      SetMondelloInput(bool isMondelloInputEnabled) = 0;
     virtual void      Close() = 0;
@@ -41,6 +41,7 @@ or https://software.intel.com/en-us/media-client-solutions-support.
 #include "plugin_loader.h"
 #include "general_allocator.h"
 #include "vaapi_device.h"
+#include "frame_cache.h"
 
 #include "GPIOControl.hpp"
 
@@ -48,6 +49,12 @@ or https://software.intel.com/en-us/media-client-solutions-support.
 #error MFX_VERSION not defined
 #endif
 
+// Surfaces the compositor may keep locked: the one on screen and the one pending.
+#define MSDK_RENDER_HELD_SURFACES 2
+
+// Default number of decoded frames queued ahead of the display.
+#define MSDK_PRESENT_QUEUE_DEPTH 1
+
 enum MemType {
     SYSTEM_MEMORY = 0x00,
     D3D9_MEMORY   = 0x01,
@@ -91,6 +98,7 @@ struct sInputParams
     mfxU32  numViews; // number of views for Multi-View Codec
     mfxU32  nRotation; // rotation for Motion JPEG Codec
     mfxU16  nAsyncDepth; // asyncronous queue
+    mfxU16  nPresentQueueDepth; // decoded frames waiting for the display
     mfxU16  nTimeout; // timeout in seconds
     mfxU16  gpuCopy; // GPU Copy mode (three-state option)
     mfxU16  nThreadsNum;
@@ -107,6 +115,9 @@ struct sInputParams
     bool    outI420;
 
     bool    bPerfMode;
+    bool    bDeferRender; // decode without a display until AttachRenderer() is called
+    bool    bStagedInit; // present the first frame before VPP is brought up
+    bool    bFrameCache; // show the cached first frame of strSrcFile before decoding
     bool    bRenderWin;
     mfxU32  nRenderWinX;
     mfxU32  nRenderWinY;
@@ -140,6 +151,12 @@ struct CPipelineStatistics
         m_tick_overall(0),
         m_tick_fread(0),
         m_tick_fwrite(0),
+        m_tick_init_session(0),
+        m_tick_init_header(0),
+        m_tick_init_frames(0),
+        m_tick_init_decoder(0),
+        m_tick_init_vpp(0),
+        m_tick_first_frame(0),
         m_timer_overall(m_tick_overall)
     {
     }
@@ -153,6 +170,13 @@ struct CPipelineStatistics
     msdk_tick m_tick_fread;   // part of tick_overall: time spent to receive incoming data
     msdk_tick m_tick_fwrite;  // part of tick_overall: time spent to deliver outgoing data
 
+    msdk_tick m_tick_init_session; // Init: file reader, session and library queries
+    msdk_tick m_tick_init_header;  // Init: stream header parsing
+    msdk_tick m_tick_init_frames;  // Init: HW device, allocator and surface pools
+    msdk_tick m_tick_init_decoder; // Init: decoder initialization
+    msdk_tick m_tick_init_vpp;     // VPP initialization, after the first frame in staged mode
+    msdk_tick m_tick_first_frame;  // from Init() until the first frame is handed to the display
+
     CAutoTimer m_timer_overall; // timer which corresponds to m_tick_overall
 
 private:
@@ -174,9 +198,18 @@ public:
     virtual mfxStatus ResetDecoder(sInputParams *pParams);
     virtual mfxStatus ResetDevice();
 
+    /** \brief Binds the display to a pipeline initialized with bDeferRender.
+     *
+     * Frames decoded so far stay queued and are presented once the window exists.
+     */
+    virtual mfxStatus AttachRenderer();
+    /** \brief Makes a running RunDecoding() return without presenting its queue. */
+    virtual void Abort();
+
     void SetMultiView();
     void SetExtBuffersFlag()       { m_bIsExtBuffers = true; }
     virtual void PrintInfo();
+    virtual void PrintInitStat();
     mfxU64 GetTotalBytesProcessed() { return totalBytesProcessed + m_mfxBS.DataOffset; }
 
 #if (MFX_VERSION >= 1025)
@@ -216,11 +249,17 @@ protected: // functions
 
     virtual mfxStatus InitVppParams();
     virtual mfxStatus AllocAndInitVppFilters();
+    virtual mfxStatus InitVpp();
+    virtual mfxStatus InitDeferredVpp();
     virtual bool IsVppRequired(sInputParams *pParams);
 
     virtual mfxStatus CreateAllocator();
     virtual mfxStatus CreateHWDevice(earlyapp::GPIOControl* pGPIOCtrl=nullptr);
+    virtual mfxStatus InitRenderer();
+    virtual void StoreCachedFrame(mfxFrameSurface1* frame);
     virtual mfxStatus AllocFrames();
+    virtual mfxStatus QueryVppFrames(mfxFrameAllocRequest VppRequest[2]);
+    virtual mfxStatus AllocVppFrames(mfxFrameAllocRequest& VppOutRequest);
     virtual void DeleteFrames();
     virtual void DeleteAllocator();
 
@@ -279,6 +318,7 @@ protected: // variables
     MSDKSemaphore*          m_pDeliverOutputSemaphore; // to access to DeliverOutput method
     MSDKEvent*              m_pDeliveredEvent; // to signal when output surfaces will be processed
     mfxStatus               m_error; // error returned by DeliverOutput method
+    MSDKEvent*              m_pRendererAttached; // set once the window exists, NULL if not deferred
     bool                    m_bStopDeliverLoop;
 
     eWorkMode               m_eWorkMode; // work mode for the pipeline
@@ -296,13 +336,16 @@ protected: // variables
     mfxU32                  m_nTimeout; // enables timeout for video playback, measured in seconds
     mfxU16                  m_nMaxFps; // limit of fps, if isn't specified equal 0.
     mfxU32                  m_nFrames; //limit number of output frames
+    mfxU32                  m_nPresentQueueDepth; // frames decoded ahead of the display
 
     mfxU16                  m_diMode;
     bool                    m_bVppIsUsed;
+    bool                    m_bVppDeferred; // staged init: VPP is set up once the first frame is out
     bool                    m_bVppFullColorRange;
     std::vector<msdk_tick>  m_vLatency;
 
     msdk_tick               m_startTick;
+    msdk_tick               m_initTick; // Init() entry, base of m_tick_first_frame
     msdk_tick               m_delayTicks;
 
     mfxExtVPPDoNotUse       m_VppDoNotUse;      // for disabling VPP algorithms
@@ -313,6 +356,7 @@ protected: // variables
     std::vector<mfxExtBuffer*> m_VppSurfaceExtParams;
 
     CHWDevice               *m_hwdev;
+    CFrameCache             *m_pFrameCache; // prerendered first frame, NULL if disabled
 
     bool                    m_bRenderWin;
     mfxU32                  m_nRenderWinX;
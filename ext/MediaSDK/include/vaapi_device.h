@@ -20,14 +20,17 @@ or https://software.intel.com/en-us/media-client-solutions-support.
 #ifndef __VAAPI_DEVICE_H__
 #define __VAAPI_DEVICE_H__
 
+#include <map>
 #include "hw_device.h"
 #include "vaapi_utils_drm.h"
+#include "vaapi_allocator.h"
 #include "GPIOControl.hpp"
 
 
 
 CHWDevice* CreateVAAPIDevice(earlyapp::GPIOControl* pGPIO=nullptr);
 class Wayland;
+struct wld_buffer;
 
 #define HANDLE_WAYLAND_DRIVER   (MFX_HANDLE_VA_DISPLAY << 4)
 
@@ -41,13 +44,15 @@ public:
         m_nRenderWinH = 0;
         m_isMondelloInputEnabled = false;
         m_Wayland = NULL;
+        m_StillBuffer = NULL;
         m_pGPIOCtrl = pGPIO;
         m_bGotFirstFrame = false;
     }
     virtual ~CVAAPIDeviceWayland(void);
 
     virtual mfxStatus Init(mfxHDL hWindow, mfxU16 nViews, mfxU32 nAdapterNum);
-    virtual mfxStatus Reset(void) { return MFX_ERR_NONE; }
+    virtual mfxStatus InitWindow(void);
+    virtual mfxStatus Reset(void);
     virtual void Close(void);
 
     virtual mfxStatus SetHandle(mfxHandleType type, mfxHDL hdl) { return MFX_ERR_UNSUPPORTED; }
@@ -63,6 +68,8 @@ public:
     return MFX_ERR_UNSUPPORTED;
     }
     virtual mfxStatus RenderFrame(mfxFrameSurface1 * pSurface, mfxFrameAllocator * pmfxAlloc);
+    virtual mfxStatus RenderStillFrame(int fd, mfxU32 width, mfxU32 height, mfxU32 pitch);
+    virtual void ReleaseSurfaces(void);
     virtual void UpdateTitle(double fps) { }
 
     virtual void SetMondelloInput(bool isMondelloInputEnabled)
@@ -81,6 +88,15 @@ private:
 
     bool m_isMondelloInputEnabled;
 
+    // wl_buffer per decoder surface, created on first render of the surface.
+    std::map<vaapiMemId*, wld_buffer*> m_BufferCache;
+    wld_buffer* GetCachedBuffer(mfxFrameSurface1 * pSurface);
+    void FreeCachedBuffers(void);
+
+    // wl_shm buffer of the still frame shown before the first decoded one.
+    wld_buffer* m_StillBuffer;
+    void FreeStillBuffer(void);
+
     // Measure KPI number for the first frame.
     bool m_bGotFirstFrame = false;
     earlyapp::GPIOControl* m_pGPIOCtrl = nullptr;
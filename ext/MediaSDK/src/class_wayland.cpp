@@ -55,6 +55,7 @@ Wayland::Wayland()
     , m_shell_surface(NULL)
     , m_callback(NULL)
     , m_event_queue(NULL)
+    , m_release_queue(NULL)
     , m_pending_frame(0)
     , m_shm_pool(NULL)
     , m_display_fd(-1)
@@ -90,6 +91,9 @@ bool Wayland::InitDisplay()
     m_event_queue = wl_display_create_queue(m_display);
     if(NULL == m_event_queue)
         return false;
+    m_release_queue = wl_display_create_queue(m_display);
+    if(NULL == m_release_queue)
+        return false;
 
     m_poll.fd = m_display_fd;
     m_poll.events = POLLIN;
@@ -168,16 +172,17 @@ void Wayland::SetRenderWinPos(int x, int y)
     m_x = x; m_y = y;
 }
 
-void Wayland::RenderBuffer(struct wl_buffer *buffer
+void Wayland::RenderBuffer(struct wld_buffer *buffer
      , int32_t width
      , int32_t height)
 {
-    wl_surface_attach(m_surface, buffer, 0, 0);
+    /* The buffer listener and queue are set once in AddBufferListener,
+       so a frame only costs attach/commit. Throttling happens in the
+       caller, which waits for the previous frame callback (Sync) and
+       gets surfaces back through wl_buffer.release. */
+    wl_surface_attach(m_surface, buffer->buffer, 0, 0);
     wl_surface_damage(m_surface, m_x, m_y, width, height);
 
-    wl_proxy_set_queue((struct wl_proxy *) buffer, m_event_queue);
-
-    wl_buffer_add_listener(buffer, &buffer_listener, NULL);
     m_pending_frame=1;
     if (m_perf_mode)
         m_callback = wl_display_sync(m_display);
@@ -186,12 +191,7 @@ void Wayland::RenderBuffer(struct wl_buffer *buffer
     wl_callback_add_listener(m_callback, &frame_listener, this);
     wl_proxy_set_queue((struct wl_proxy *) m_callback, m_event_queue);
     wl_surface_commit(m_surface);
-    wl_display_dispatch_queue(m_display, m_event_queue);
-    /* Force a Sync before and after render to ensure client handles
-      wayland events in a timely fashion. This also fixes the one time
-      flicker issue on wl_shell_surface pointer enter */
-    Sync();
-
+    wl_display_flush(m_display);
 }
 
 void Wayland::RenderBufferWinPosSize(struct wl_buffer *buffer
@@ -231,6 +231,9 @@ void Wayland::DestroyCallback()
 //ShmPool
 bool  Wayland::CreateShmPool(int fd, int32_t size, int prot)
 {
+    if(NULL == m_shm)
+        return false;
+
     m_shm_pool = new struct ShmPool;
     if (NULL == m_shm_pool)
         return false;
@@ -248,6 +251,7 @@ bool  Wayland::CreateShmPool(int fd, int32_t size, int prot)
     if (MAP_FAILED == m_shm_pool->memory)
     {
         delete m_shm_pool;
+        m_shm_pool = NULL;
         return false;
     }
 
@@ -258,6 +262,7 @@ bool  Wayland::CreateShmPool(int fd, int32_t size, int prot)
     {
         munmap(m_shm_pool->memory, size);
         delete m_shm_pool;
+        m_shm_pool = NULL;
         return false;
     }
     wl_shm_pool_set_user_data(m_pool, m_shm_pool);
@@ -267,9 +272,14 @@ bool  Wayland::CreateShmPool(int fd, int32_t size, int prot)
 
 void Wayland::FreeShmPool()
 {
+    if(NULL == m_pool)
+        return;
+
     wl_shm_pool_destroy(m_pool);
     munmap(m_shm_pool->memory, m_shm_pool->capacity);
     delete m_shm_pool;
+    m_pool = NULL;
+    m_shm_pool = NULL;
 }
 
 
@@ -352,6 +362,30 @@ struct wl_buffer * Wayland::CreatePrimeBuffer(uint32_t name
     return buffer;
 }
 
+void Wayland::AddBufferListener(struct wld_buffer *buffer)
+{
+    /* Releases have their own queue: they are dispatched by the thread
+       looking for free surfaces, frame callbacks by the one in Sync() */
+    wl_proxy_set_queue((struct wl_proxy *) buffer->buffer, m_release_queue);
+    wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+}
+
+void Wayland::DispatchReleases()
+{
+    struct pollfd pfd = m_poll;
+
+    while(wl_display_prepare_read_queue(m_display, m_release_queue) < 0)
+        wl_display_dispatch_queue_pending(m_display, m_release_queue);
+
+    wl_display_flush(m_display);
+
+    if(poll(&pfd, 1, 0) > 0)
+        wl_display_read_events(m_display);
+    else
+        wl_display_cancel_read(m_display);
+    wl_display_dispatch_queue_pending(m_display, m_release_queue);
+}
+
 Wayland::~Wayland()
 {
     if(NULL != m_shell)
@@ -365,6 +399,8 @@ Wayland::~Wayland()
         wl_compositor_destroy(m_compositor);
     if(NULL != m_event_queue)
         wl_event_queue_destroy(m_event_queue);
+    if(NULL != m_release_queue)
+        wl_event_queue_destroy(m_release_queue);
     if(NULL != m_registry)
         wl_registry_destroy(m_registry);
     if(NULL != m_display)
@@ -391,6 +427,12 @@ void Wayland::RegistryGlobal(struct wl_registry *registry
             , name
             , &wl_shell_interface
             , version));
+    else if(0 == strcmp(interface, "wl_shm"))
+        m_shm = static_cast<wl_shm*>
+            (wl_registry_bind(registry
+            , name
+            , &wl_shm_interface
+            , 1));
     else if(0 == strcmp(interface, "wl_drm")) {
         static const struct wl_drm_listener drm_listener = {
             drm_handle_device,
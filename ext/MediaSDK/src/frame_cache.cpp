@@ -0,0 +1,286 @@
+/******************************************************************************\
+Copyright (c) 2005-2018, Intel Corporation
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**********************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "frame_cache.h"
+
+#define FRAME_CACHE_MAGIC   0x43464145 // "EAFC"
+#define FRAME_CACHE_VERSION 2
+#define FRAME_CACHE_SUFFIX  ".frame"
+
+#ifndef EARLYAPP_CACHE_DIR
+#define EARLYAPP_CACHE_DIR "/var/cache/earlyapp"
+#endif
+// stream header bytes included in the key, enough for the sequence headers
+#define FRAME_CACHE_HEAD    4096
+
+static mfxU64 Fnv1a(mfxU64 hash, const void* pData, size_t size)
+{
+    const mfxU8* p = (const mfxU8*)pData;
+    while (size--)
+    {
+        hash ^= *p++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// FNV-1a over the stream's inode, size, mtime and first bytes. Reading the
+// whole stream here would put it on the boot path the cache is meant to cut.
+static mfxStatus HashFile(const msdk_char* strFile, mfxU64* pHash)
+{
+    int fd = open(strFile, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return MFX_ERR_NOT_FOUND;
+
+    struct stat st;
+    mfxU8 head[FRAME_CACHE_HEAD];
+    ssize_t n = -1;
+    if (fstat(fd, &st) == 0)
+        n = pread(fd, head, sizeof(head), 0);
+    close(fd);
+
+    if (n < 0)
+        return MFX_ERR_ABORTED;
+
+    mfxU64 id[5] = { (mfxU64)st.st_dev, (mfxU64)st.st_ino, (mfxU64)st.st_size,
+                     (mfxU64)st.st_mtim.tv_sec, (mfxU64)st.st_mtim.tv_nsec };
+    *pHash = Fnv1a(Fnv1a(0xcbf29ce484222325ULL, id, sizeof(id)), head, n);
+    return MFX_ERR_NONE;
+}
+
+static inline mfxU8 Clip(int v)
+{
+    return (mfxU8)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// BT.601 limited range NV12 row pair to XRGB8888
+static void ConvertNV12Row(const mfxU8* pY, const mfxU8* pUV, mfxU32* pOut, mfxU32 width)
+{
+    for (mfxU32 x = 0; x < width; x++)
+    {
+        int c = 298 * (pY[x] - 16);
+        int d = pUV[x & ~1] - 128;
+        int e = pUV[x | 1] - 128;
+
+        pOut[x] = 0xff000000
+            | (Clip((c + 409 * e + 128) >> 8) << 16)
+            | (Clip((c - 100 * d - 208 * e + 128) >> 8) << 8)
+            | Clip((c + 516 * d + 128) >> 8);
+    }
+}
+
+CFrameCache::CFrameCache()
+    : m_fd(-1)
+    , m_bNeedsUpdate(false)
+    , m_hash(0)
+    , m_pWriter(NULL)
+    , m_FourCC(0)
+{
+    MSDK_ZERO_MEMORY(m_trailer);
+    MSDK_ZERO_MEMORY(m_strCacheFile);
+}
+
+CFrameCache::~CFrameCache()
+{
+    Close();
+}
+
+mfxStatus CFrameCache::Open(const msdk_char* strSrcFile)
+{
+    MSDK_CHECK_POINTER(strSrcFile, MFX_ERR_NULL_PTR);
+
+    Close();
+
+    // the stream may sit on a read-only share, so the file goes to the cache
+    // directory, named after the stream and told apart by its path
+    const msdk_char* strName = strrchr(strSrcFile, '/');
+    strName = strName ? strName + 1 : strSrcFile;
+    int len = snprintf(m_strCacheFile, MSDK_MAX_FILENAME_LEN, "%s/%s-%016llx%s", EARLYAPP_CACHE_DIR,
+        strName, (unsigned long long)Fnv1a(0xcbf29ce484222325ULL, strSrcFile, strlen(strSrcFile)),
+        FRAME_CACHE_SUFFIX);
+    if (len < 0 || len >= MSDK_MAX_FILENAME_LEN)
+        return MFX_ERR_UNSUPPORTED;
+
+    mfxStatus sts = HashFile(strSrcFile, &m_hash);
+    MSDK_CHECK_STATUS(sts, "HashFile failed");
+
+    // from here on a missing or stale file is replaced by the next decoded frame
+    m_bNeedsUpdate = true;
+
+    int fd = open(m_strCacheFile, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return MFX_ERR_NOT_FOUND;
+
+    struct stat st;
+    FrameCacheTrailer trailer;
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(trailer)) ||
+        (pread(fd, &trailer, sizeof(trailer), st.st_size - sizeof(trailer)) != (ssize_t)sizeof(trailer)))
+    {
+        close(fd);
+        return MFX_ERR_NOT_FOUND;
+    }
+
+    if ((trailer.magic != FRAME_CACHE_MAGIC) || (trailer.version != FRAME_CACHE_VERSION) ||
+        (trailer.hash != m_hash) || !trailer.width || !trailer.height ||
+        (trailer.pitch < trailer.width * 4) ||
+        ((off_t)trailer.pitch * trailer.height + (off_t)sizeof(trailer) != st.st_size))
+    {
+        close(fd);
+        return MFX_ERR_NOT_FOUND;
+    }
+
+    m_trailer = trailer;
+    m_fd = fd;
+    m_bNeedsUpdate = false;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CFrameCache::Store(mfxFrameSurface1* pSurface)
+{
+    MSDK_CHECK_POINTER(pSurface, MFX_ERR_NULL_PTR);
+
+    // one attempt per run, a read-only file system must not cost every frame
+    m_bNeedsUpdate = false;
+
+    mfxFrameInfo& info = pSurface->Info;
+    mfxFrameData& data = pSurface->Data;
+    mfxU32 width = info.CropW ? info.CropW : info.Width;
+    mfxU32 height = info.CropH ? info.CropH : info.Height;
+
+    if ((info.FourCC == MFX_FOURCC_NV12) && (!data.Y || !data.UV))
+        return MFX_ERR_NULL_PTR;
+    if ((info.FourCC == MFX_FOURCC_RGB4) && !data.B)
+        return MFX_ERR_NULL_PTR;
+    if ((info.FourCC != MFX_FOURCC_NV12) && (info.FourCC != MFX_FOURCC_RGB4))
+        return MFX_ERR_UNSUPPORTED;
+
+    MSDK_ZERO_MEMORY(m_trailer);
+    m_trailer.magic = FRAME_CACHE_MAGIC;
+    m_trailer.version = FRAME_CACHE_VERSION;
+    m_trailer.hash = m_hash;
+    m_trailer.width = width;
+    m_trailer.height = height;
+    m_trailer.pitch = width * 4;
+    m_FourCC = info.FourCC;
+
+    // only copy here, the surface goes back to the decoder once this returns
+    if (info.FourCC == MFX_FOURCC_NV12)
+    {
+        mfxU32 uvHeight = (height + 1) / 2;
+        m_frame.resize(width * (height + uvHeight));
+        for (mfxU32 y = 0; y < height; y++)
+            MSDK_MEMCPY(&m_frame[y * width], data.Y + (info.CropY + y) * data.Pitch + info.CropX, width);
+        for (mfxU32 y = 0; y < uvHeight; y++)
+            MSDK_MEMCPY(&m_frame[(height + y) * width],
+                data.UV + (info.CropY / 2 + y) * data.Pitch + (info.CropX & ~1), width);
+    }
+    else
+    {
+        // RGB4 is B,G,R,A in memory, the same layout as XRGB8888
+        m_frame.resize(m_trailer.pitch * height);
+        for (mfxU32 y = 0; y < height; y++)
+            MSDK_MEMCPY(&m_frame[y * m_trailer.pitch],
+                data.B + (info.CropY + y) * data.Pitch + info.CropX * 4, m_trailer.pitch);
+    }
+
+    mfxStatus sts = MFX_ERR_NONE;
+    try
+    {
+        m_pWriter = new MSDKThread(sts, WriteThreadFunc, this);
+    }
+    catch (...)
+    {
+        m_pWriter = NULL;
+        return MFX_ERR_MEMORY_ALLOC;
+    }
+    return sts;
+}
+
+unsigned int MFX_STDCALL CFrameCache::WriteThreadFunc(void* ctx)
+{
+    CFrameCache* pCache = (CFrameCache*)ctx;
+
+    mfxStatus sts = pCache->Write();
+    if (MFX_ERR_NONE != sts)
+        msdk_printf(MSDK_STRING("WARNING: first frame was not cached (%d)\n"), sts);
+    return 0;
+}
+
+// Converts the copied frame and replaces the cache file, off the deliver thread
+mfxStatus CFrameCache::Write()
+{
+    mfxU32 width = m_trailer.width;
+    mfxU32 height = m_trailer.height;
+
+    msdk_char strTmpFile[MSDK_MAX_FILENAME_LEN];
+    int len = snprintf(strTmpFile, MSDK_MAX_FILENAME_LEN, "%s.tmp", m_strCacheFile);
+    if (len < 0 || len >= MSDK_MAX_FILENAME_LEN)
+        return MFX_ERR_UNSUPPORTED;
+
+    mkdir(EARLYAPP_CACHE_DIR, 0755);
+    int fd = open(strTmpFile, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return MFX_ERR_NOT_FOUND;
+
+    std::vector<mfxU32> row(width);
+    bool bOk = true;
+    for (mfxU32 y = 0; bOk && (y < height); y++)
+    {
+        const mfxU8* pRow;
+        if (m_FourCC == MFX_FOURCC_NV12)
+        {
+            ConvertNV12Row(&m_frame[y * width], &m_frame[(height + y / 2) * width], &row[0], width);
+            pRow = (const mfxU8*)&row[0];
+        }
+        else
+        {
+            pRow = &m_frame[y * m_trailer.pitch];
+        }
+        bOk = write(fd, pRow, m_trailer.pitch) == (ssize_t)m_trailer.pitch;
+    }
+    bOk = bOk && (write(fd, &m_trailer, sizeof(m_trailer)) == (ssize_t)sizeof(m_trailer));
+    bOk = bOk && (fsync(fd) == 0);
+    close(fd);
+
+    if (!bOk || (rename(strTmpFile, m_strCacheFile) < 0))
+    {
+        unlink(strTmpFile);
+        return MFX_ERR_ABORTED;
+    }
+    return MFX_ERR_NONE;
+}
+
+void CFrameCache::Close()
+{
+    if (m_pWriter)
+    {
+        m_pWriter->Wait();
+        MSDK_SAFE_DELETE(m_pWriter);
+    }
+    m_frame.clear();
+
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+    MSDK_ZERO_MEMORY(m_trailer);
+}
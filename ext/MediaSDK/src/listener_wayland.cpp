@@ -20,6 +20,7 @@ or https://software.intel.com/en-us/media-client-solutions-support.
 #include <iostream>
 #include "listener_wayland.h"
 #include "class_wayland.h"
+#include "mfx_buffering.h"
 
 /* drm listener */
 void drm_handle_device(void *data
@@ -98,6 +99,16 @@ void handle_done(void *data, struct wl_callback *callback, uint32_t time)
 
 void buffer_release(void *data, struct wl_buffer *buffer)
 {
-    wl_buffer_destroy(buffer);
-    buffer = NULL;
+    /* Cached per-surface buffers are kept, only the surface is
+       handed back to the decoder. One-shot buffers are destroyed. */
+    wld_buffer *m_buffer = static_cast<wld_buffer*>(data);
+    if (NULL == m_buffer)
+    {
+        wl_buffer_destroy(buffer);
+        return;
+    }
+
+    msdkFrameSurface *surface = (msdkFrameSurface*)(m_buffer->pInSurface);
+    if (NULL != surface)
+        msdk_atomic_dec16(&(surface->render_lock));
 }
@@ -122,6 +122,15 @@ const mfxPluginUID & msdkGetPluginUID(mfxIMPL impl, msdkComponentType type, mfxU
     return MSDK_PLUGINGUID_NULL;
 }
 
+// returns the ticks spent in the current init stage and starts the next one
+static msdk_tick NextInitStage(msdk_tick& stageStart)
+{
+    msdk_tick now = msdk_time_get_tick();
+    msdk_tick elapsed = now - stageStart;
+    stageStart = now;
+    return elapsed;
+}
+
 
 CDecodingPipeline::CDecodingPipeline(earlyapp::GPIOControl* pGPIOCtrl)
 {
@@ -129,9 +138,11 @@ CDecodingPipeline::CDecodingPipeline(earlyapp::GPIOControl* pGPIOCtrl)
     m_pGPIOCtrl = pGPIOCtrl;
 
     m_nFrames=0;
+    m_nPresentQueueDepth = MSDK_PRESENT_QUEUE_DEPTH;
     m_export_mode=0;
     m_bVppFullColorRange=false;
     m_bVppIsUsed = false;
+    m_bVppDeferred = false;
     MSDK_ZERO_MEMORY(m_mfxBS);
 
     m_pmfxDEC = NULL;
@@ -156,6 +167,7 @@ CDecodingPipeline::CDecodingPipeline(earlyapp::GPIOControl* pGPIOCtrl)
 
     m_pDeliverOutputSemaphore = NULL;
     m_pDeliveredEvent = NULL;
+    m_pRendererAttached = NULL;
     m_error = MFX_ERR_NONE;
     m_bStopDeliverLoop = false;
 
@@ -184,6 +196,7 @@ CDecodingPipeline::CDecodingPipeline(earlyapp::GPIOControl* pGPIOCtrl)
     m_bResetFileReader = false;
 
     m_startTick = 0;
+    m_initTick = 0;
     m_delayTicks = 0;
 
     MSDK_ZERO_MEMORY(m_VppDoNotUse);
@@ -215,6 +228,8 @@ CDecodingPipeline::CDecodingPipeline(earlyapp::GPIOControl* pGPIOCtrl)
     m_bPerfMode = false;
 
     m_monitorType = 0;
+    m_hwdev = NULL;
+    m_pFrameCache = NULL;
     totalBytesProcessed = 0;
     m_vLatency.reserve(1000); // reserve some space to reduce dynamic reallocation impact on pipeline execution
 }
@@ -230,6 +245,9 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
 
     mfxStatus sts = MFX_ERR_NONE;
 
+    m_initTick = msdk_time_get_tick();
+    msdk_tick stageTick = m_initTick;
+
     // prepare input stream file reader
     // for VP8 complete and single frame reader is a requirement
     // create reader that supports completeframe mode for latency oriented scenarios
@@ -287,6 +305,7 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
 
     m_nMaxFps = pParams->nMaxFPS;
     m_nFrames = pParams->nFrames ? pParams->nFrames : MFX_INFINITE;
+    m_nPresentQueueDepth = pParams->nPresentQueueDepth ? pParams->nPresentQueueDepth : MSDK_PRESENT_QUEUE_DEPTH;
 
     m_hwdev = NULL;
 
@@ -299,6 +318,14 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
     sts = m_FileReader->Init(pParams->strSrcFile);
     MSDK_CHECK_STATUS(sts, "m_FileReader->Init failed");
 
+    if (pParams->bFrameCache && (pParams->mode == MODE_RENDERING))
+    {
+        m_pFrameCache = new CFrameCache();
+        // a missing or stale cache is rewritten from the first decoded frame
+        if (MFX_ERR_NONE != m_pFrameCache->Open(pParams->strSrcFile))
+            msdk_printf(MSDK_STRING("No valid frame cache for %s\n"), pParams->strSrcFile);
+    }
+
     mfxInitParam initPar;
     mfxExtThreadsParam threadsPar;
     mfxExtBuffer* extBufs[1];
@@ -403,8 +430,15 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
         m_bRenderWin = pParams->bRenderWin;
     }
 
+    if (pParams->bDeferRender && (pParams->mode == MODE_RENDERING)) {
+        m_pRendererAttached = new MSDKEvent(sts, true, false);
+        MSDK_CHECK_STATUS(sts, "MSDKEvent failed");
+    }
+
     m_delayTicks = pParams->nMaxFPS ? msdk_time_get_frequency() / pParams->nMaxFPS : 0;
 
+    m_tick_init_session = NextInitStage(stageTick);
+
     // create decoder
     m_pmfxDEC = new MFXVideoDECODE(m_mfxSession);
     MSDK_CHECK_POINTER(m_pmfxDEC, MFX_ERR_MEMORY_ALLOC);
@@ -420,6 +454,8 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
     sts = InitMfxParams(pParams);
     MSDK_CHECK_STATUS(sts, "InitMfxParams failed");
 
+    m_tick_init_header = NextInitStage(stageTick);
+
     if (m_bVppIsUsed)
         m_bDecOutSysmem = pParams->bUseHWLib ? false : true;
     else
@@ -429,6 +465,14 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
     {
         m_pmfxVPP = new MFXVideoVPP(m_mfxSession);
         if (!m_pmfxVPP) return MFX_ERR_MEMORY_ALLOC;
+
+        // staged init: the first frame is presented as decoded, VPP filters
+        // and output surfaces are set up by RunDecoding() right after it
+        if (pParams->bStagedInit && (pParams->mode == MODE_RENDERING) && !m_bDecOutSysmem)
+        {
+            m_bVppIsUsed = false;
+            m_bVppDeferred = true;
+        }
     }
 
     m_eWorkMode = pParams->mode;
@@ -450,6 +494,8 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
     sts = AllocFrames();
     MSDK_CHECK_STATUS(sts, "AllocFrames failed");
 
+    m_tick_init_frames = NextInitStage(stageTick);
+
     sts = m_pmfxDEC->Init(&m_mfxVideoParams);
     if (MFX_WRN_PARTIAL_ACCELERATION == sts)
     {
@@ -458,18 +504,13 @@ mfxStatus CDecodingPipeline::Init(sInputParams *pParams)
     }
     MSDK_CHECK_STATUS(sts, "m_pmfxDEC->Init failed");
 
+    m_tick_init_decoder = NextInitStage(stageTick);
+
     if (m_bVppIsUsed)
     {
-        if (m_diMode)
-            m_mfxVppVideoParams.vpp.Out.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
-
-        sts = m_pmfxVPP->Init(&m_mfxVppVideoParams);
-        if (MFX_WRN_PARTIAL_ACCELERATION == sts)
-        {
-            msdk_printf(MSDK_STRING("WARNING: partial acceleration\n"));
-            MSDK_IGNORE_MFX_STS(sts, MFX_WRN_PARTIAL_ACCELERATION);
-        }
-        MSDK_CHECK_STATUS(sts, "m_pmfxVPP->Init failed");
+        sts = InitVpp();
+        MSDK_CHECK_STATUS(sts, "InitVpp failed");
+        m_tick_init_vpp = NextInitStage(stageTick);
     }
 
     sts = m_pmfxDEC->GetVideoParam(&m_mfxVideoParams);
@@ -530,6 +571,7 @@ void CDecodingPipeline::Close()
     MSDK_SAFE_DELETE(m_pmfxVPP);
 
     DeleteFrames();
+    MSDK_SAFE_DELETE(m_pFrameCache);
 
     if (m_bIsExtBuffers)
     {
@@ -551,6 +593,8 @@ void CDecodingPipeline::Close()
     // allocator if used as external for MediaSDK must be deleted after decoder
     DeleteAllocator();
 
+    MSDK_SAFE_DELETE(m_pRendererAttached);
+
     return;
 }
 
@@ -913,6 +957,50 @@ mfxStatus CDecodingPipeline::InitVppParams()
     return MFX_ERR_NONE;
 }
 
+mfxStatus CDecodingPipeline::InitVpp()
+{
+    mfxStatus sts = MFX_ERR_NONE;
+
+    if (m_diMode)
+        m_mfxVppVideoParams.vpp.Out.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+
+    sts = m_pmfxVPP->Init(&m_mfxVppVideoParams);
+    if (MFX_WRN_PARTIAL_ACCELERATION == sts)
+    {
+        msdk_printf(MSDK_STRING("WARNING: partial acceleration\n"));
+        MSDK_IGNORE_MFX_STS(sts, MFX_WRN_PARTIAL_ACCELERATION);
+    }
+    MSDK_CHECK_STATUS(sts, "m_pmfxVPP->Init failed");
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CDecodingPipeline::InitDeferredVpp()
+{
+    CAutoTimer timer_vpp(m_tick_init_vpp);
+
+    mfxStatus sts = MFX_ERR_NONE;
+    mfxFrameAllocRequest VppRequest[2];
+
+    MSDK_ZERO_MEMORY(VppRequest[0]);
+    MSDK_ZERO_MEMORY(VppRequest[1]);
+
+    m_bVppDeferred = false;
+
+    // decoder surfaces were sized without VPP, only its output pool is added
+    sts = QueryVppFrames(VppRequest);
+    MSDK_CHECK_STATUS(sts, "QueryVppFrames failed");
+
+    sts = AllocVppFrames(VppRequest[1]);
+    MSDK_CHECK_STATUS(sts, "AllocVppFrames failed");
+
+    sts = InitVpp();
+    MSDK_CHECK_STATUS(sts, "InitVpp failed");
+
+    m_bVppIsUsed = true;
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CDecodingPipeline::CreateHWDevice(earlyapp::GPIOControl* pGPIOCtrl)
 {
     mfxStatus sts = MFX_ERR_NONE;
@@ -922,22 +1010,83 @@ mfxStatus CDecodingPipeline::CreateHWDevice(earlyapp::GPIOControl* pGPIOCtrl)
         return MFX_ERR_MEMORY_ALLOC;
     }
 
-    sts = m_hwdev->Init(&m_monitorType, (m_eWorkMode == MODE_RENDERING) ? 1 : 0, MSDKAdapter::GetNumber(m_mfxSession));
+    // with deferred rendering only the VA display is opened here
+    bool bWindow = (m_eWorkMode == MODE_RENDERING) && !m_pRendererAttached;
+    sts = m_hwdev->Init(&m_monitorType, bWindow ? 1 : 0, MSDKAdapter::GetNumber(m_mfxSession));
     MSDK_CHECK_STATUS(sts, "m_hwdev->Init failed");
 
-    if (m_eWorkMode == MODE_RENDERING) {
-        mfxHDL hdl = NULL;
-        mfxHandleType hdlw_t = (mfxHandleType)HANDLE_WAYLAND_DRIVER;
-        Wayland *wld;
-        sts = m_hwdev->GetHandle(hdlw_t, &hdl);
-        MSDK_CHECK_STATUS(sts, "m_hwdev->GetHandle failed");
-        wld = (Wayland*)hdl;
-        wld->SetRenderWinPos(m_nRenderWinX, m_nRenderWinY);
-        wld->SetPerfMode(m_bPerfMode);
+    if (bWindow) {
+        sts = InitRenderer();
+        MSDK_CHECK_STATUS(sts, "InitRenderer failed");
+    }
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CDecodingPipeline::InitRenderer()
+{
+    mfxStatus sts = MFX_ERR_NONE;
+    mfxHDL hdl = NULL;
+    mfxHandleType hdlw_t = (mfxHandleType)HANDLE_WAYLAND_DRIVER;
+    Wayland *wld;
+
+    sts = m_hwdev->GetHandle(hdlw_t, &hdl);
+    MSDK_CHECK_STATUS(sts, "m_hwdev->GetHandle failed");
+    wld = (Wayland*)hdl;
+    wld->SetRenderWinPos(m_nRenderWinX, m_nRenderWinY);
+    wld->SetPerfMode(m_bPerfMode);
+
+    // nothing decoded for the display yet, put the cached first frame up
+    if (m_pFrameCache && m_pFrameCache->IsValid() &&
+        !m_output_count && !m_DeliveredSurfacesPool.GetSurfaceCount())
+    {
+        sts = m_hwdev->RenderStillFrame(m_pFrameCache->GetFd(),
+            m_pFrameCache->GetWidth(), m_pFrameCache->GetHeight(), m_pFrameCache->GetPitch());
+        if (MFX_ERR_NONE != sts) MSDK_PRINT_WRN_MSG(sts, "RenderStillFrame failed");
+    }
+    return MFX_ERR_NONE;
+}
+
+void CDecodingPipeline::StoreCachedFrame(mfxFrameSurface1* frame)
+{
+    mfxStatus sts = m_pGeneralAllocator->Lock(m_pGeneralAllocator->pthis, frame->Data.MemId, &(frame->Data));
+    if (MFX_ERR_NONE == sts)
+    {
+        sts = m_pFrameCache->Store(frame);
+        m_pGeneralAllocator->Unlock(m_pGeneralAllocator->pthis, frame->Data.MemId, &(frame->Data));
     }
+    if (MFX_ERR_NONE != sts)
+        msdk_printf(MSDK_STRING("WARNING: first frame was not cached (%d)\n"), sts);
+}
+
+mfxStatus CDecodingPipeline::AttachRenderer()
+{
+    mfxStatus sts = MFX_ERR_NONE;
+
+    MSDK_CHECK_POINTER(m_hwdev, MFX_ERR_NOT_INITIALIZED);
+    if (!m_pRendererAttached)
+        return MFX_ERR_NONE; // window was created in Init
+
+    sts = m_hwdev->InitWindow();
+    MSDK_CHECK_STATUS(sts, "m_hwdev->InitWindow failed");
+
+    sts = InitRenderer();
+    MSDK_CHECK_STATUS(sts, "InitRenderer failed");
+
+    m_pRendererAttached->Signal();
     return MFX_ERR_NONE;
 }
 
+void CDecodingPipeline::Abort()
+{
+    m_error = MFX_ERR_ABORTED;
+
+    // wake up the decode and deliver threads wherever they wait
+    if (m_pRendererAttached)
+        m_pRendererAttached->Signal();
+    if (m_pDeliveredEvent)
+        m_pDeliveredEvent->Signal();
+}
+
 mfxStatus CDecodingPipeline::ResetDevice()
 {
     return m_hwdev->Reset();
@@ -953,7 +1102,6 @@ mfxStatus CDecodingPipeline::AllocFrames()
     mfxFrameAllocRequest VppRequest[2];
 
     mfxU16 nSurfNum = 0; // number of surfaces for decoder
-    mfxU16 nVppSurfNum = 0; // number of surfaces for vpp
 
     MSDK_ZERO_MEMORY(Request);
 
@@ -1003,33 +1151,13 @@ mfxStatus CDecodingPipeline::AllocFrames()
         MSDK_CHECK_STATUS(sts, "m_pmfxDEC->QueryIOSurf failed");
 
 
-        sts = InitVppParams();
-        MSDK_CHECK_STATUS(sts, "InitVppParams failed");
-
-        sts = m_pmfxVPP->Query(&m_mfxVppVideoParams, &m_mfxVppVideoParams);
-        MSDK_IGNORE_MFX_STS(sts, MFX_WRN_INCOMPATIBLE_VIDEO_PARAM);
-        MSDK_CHECK_STATUS(sts, "m_pmfxVPP->Query failed");
-
-        // VppRequest[0] for input frames request, VppRequest[1] for output frames request
-        sts = m_pmfxVPP->QueryIOSurf(&m_mfxVppVideoParams, VppRequest);
-        if (MFX_WRN_PARTIAL_ACCELERATION == sts) {
-            msdk_printf(MSDK_STRING("WARNING: partial acceleration\n"));
-            MSDK_IGNORE_MFX_STS(sts, MFX_WRN_PARTIAL_ACCELERATION);
-        }
-        MSDK_CHECK_STATUS(sts, "m_pmfxVPP->QueryIOSurf failed");
-
-        if ((VppRequest[0].NumFrameSuggested < m_mfxVppVideoParams.AsyncDepth) ||
-            (VppRequest[1].NumFrameSuggested < m_mfxVppVideoParams.AsyncDepth))
-            return MFX_ERR_MEMORY_ALLOC;
-
+        sts = QueryVppFrames(VppRequest);
+        MSDK_CHECK_STATUS(sts, "QueryVppFrames failed");
 
         // If surfaces are shared by 2 components, c1 and c2. NumSurf = c1_out + c2_in - AsyncDepth + 1
         // The number of surfaces shared by vpp input and decode output
         nSurfNum = Request.NumFrameSuggested + VppRequest[0].NumFrameSuggested - m_mfxVideoParams.AsyncDepth + 1;
 
-        // The number of surfaces for vpp output
-        nVppSurfNum = VppRequest[1].NumFrameSuggested;
-
         // prepare allocation request
         Request.NumFrameSuggested = Request.NumFrameMin = nSurfNum;
 
@@ -1037,6 +1165,13 @@ mfxStatus CDecodingPipeline::AllocFrames()
         Request.Type = MFX_MEMTYPE_EXTERNAL_FRAME | MFX_MEMTYPE_FROM_DECODE | MFX_MEMTYPE_FROM_VPPIN;
     }
 
+    if (!m_bVppIsUsed && (m_eWorkMode == MODE_RENDERING))
+    {
+        // Decoder surfaces stay locked while they are queued for
+        // presentation and while the compositor holds their buffers
+        Request.NumFrameSuggested += m_nPresentQueueDepth + MSDK_RENDER_HELD_SURFACES;
+    }
+
     if ((Request.NumFrameSuggested < m_mfxVideoParams.AsyncDepth) &&
         (m_impl & MFX_IMPL_HARDWARE_ANY))
         return MFX_ERR_MEMORY_ALLOC;
@@ -1057,24 +1192,9 @@ mfxStatus CDecodingPipeline::AllocFrames()
 
     if (m_bVppIsUsed)
     {
-        // alloc frames for VPP
-        if (m_export_mode != vaapiAllocatorParams::DONOT_EXPORT)
-        {
-            VppRequest[1].Type |= MFX_MEMTYPE_EXPORT_FRAME;
-        }
-
-        VppRequest[1].NumFrameSuggested = VppRequest[1].NumFrameMin = nVppSurfNum;
-        MSDK_MEMCPY_VAR(VppRequest[1].Info, &(m_mfxVppVideoParams.vpp.Out), sizeof(mfxFrameInfo));
-
-        sts = m_pGeneralAllocator->Alloc(m_pGeneralAllocator->pthis, &VppRequest[1], &m_mfxVppResponse);
-        MSDK_CHECK_STATUS(sts, "m_pGeneralAllocator->Alloc failed");
-
-        // prepare mfxFrameSurface1 array for decoder
-        nVppSurfNum = m_mfxVppResponse.NumFrameActual;
-
         // AllocVppBuffers should call before AllocBuffers to set the value of m_OutputSurfacesNumber
-        sts = AllocVppBuffers(nVppSurfNum);
-        MSDK_CHECK_STATUS(sts, "AllocVppBuffers failed");
+        sts = AllocVppFrames(VppRequest[1]);
+        MSDK_CHECK_STATUS(sts, "AllocVppFrames failed");
     }
 
     // prepare mfxFrameSurface1 array for decoder
@@ -1101,9 +1221,70 @@ mfxStatus CDecodingPipeline::AllocFrames()
         }
     }
 
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CDecodingPipeline::QueryVppFrames(mfxFrameAllocRequest VppRequest[2])
+{
+    MSDK_CHECK_POINTER(m_pmfxVPP, MFX_ERR_NULL_PTR);
+
+    mfxStatus sts = MFX_ERR_NONE;
+
+    sts = InitVppParams();
+    MSDK_CHECK_STATUS(sts, "InitVppParams failed");
+
+    sts = m_pmfxVPP->Query(&m_mfxVppVideoParams, &m_mfxVppVideoParams);
+    MSDK_IGNORE_MFX_STS(sts, MFX_WRN_INCOMPATIBLE_VIDEO_PARAM);
+    MSDK_CHECK_STATUS(sts, "m_pmfxVPP->Query failed");
+
+    // VppRequest[0] for input frames request, VppRequest[1] for output frames request
+    sts = m_pmfxVPP->QueryIOSurf(&m_mfxVppVideoParams, VppRequest);
+    if (MFX_WRN_PARTIAL_ACCELERATION == sts) {
+        msdk_printf(MSDK_STRING("WARNING: partial acceleration\n"));
+        MSDK_IGNORE_MFX_STS(sts, MFX_WRN_PARTIAL_ACCELERATION);
+    }
+    MSDK_CHECK_STATUS(sts, "m_pmfxVPP->QueryIOSurf failed");
+
+    if ((VppRequest[0].NumFrameSuggested < m_mfxVppVideoParams.AsyncDepth) ||
+        (VppRequest[1].NumFrameSuggested < m_mfxVppVideoParams.AsyncDepth))
+        return MFX_ERR_MEMORY_ALLOC;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CDecodingPipeline::AllocVppFrames(mfxFrameAllocRequest& VppOutRequest)
+{
+    mfxStatus sts = MFX_ERR_NONE;
+
+    // The number of surfaces for vpp output
+    mfxU16 nVppSurfNum = VppOutRequest.NumFrameSuggested;
+    if (m_eWorkMode == MODE_RENDERING)
+    {
+        // VPP output surfaces stay locked while they are queued for
+        // presentation and while the compositor holds their buffers
+        nVppSurfNum += m_nPresentQueueDepth + MSDK_RENDER_HELD_SURFACES;
+    }
+
+    // alloc frames for VPP
+    if (m_export_mode != vaapiAllocatorParams::DONOT_EXPORT)
+    {
+        VppOutRequest.Type |= MFX_MEMTYPE_EXPORT_FRAME;
+    }
+
+    VppOutRequest.NumFrameSuggested = VppOutRequest.NumFrameMin = nVppSurfNum;
+    MSDK_MEMCPY_VAR(VppOutRequest.Info, &(m_mfxVppVideoParams.vpp.Out), sizeof(mfxFrameInfo));
+
+    sts = m_pGeneralAllocator->Alloc(m_pGeneralAllocator->pthis, &VppOutRequest, &m_mfxVppResponse);
+    MSDK_CHECK_STATUS(sts, "m_pGeneralAllocator->Alloc failed");
+
     // prepare mfxFrameSurface1 array for VPP
+    nVppSurfNum = m_mfxVppResponse.NumFrameActual;
+
+    sts = AllocVppBuffers(nVppSurfNum);
+    MSDK_CHECK_STATUS(sts, "AllocVppBuffers failed");
+
     for (int i = 0; i < nVppSurfNum; i++) {
-        MSDK_MEMCPY_VAR(m_pVppSurfaces[i].frame.Info, &(VppRequest[1].Info), sizeof(mfxFrameInfo));
+        MSDK_MEMCPY_VAR(m_pVppSurfaces[i].frame.Info, &(VppOutRequest.Info), sizeof(mfxFrameInfo));
         if (m_bExternalAlloc) {
             m_pVppSurfaces[i].frame.Data.MemId = m_mfxVppResponse.mids[i];
             if (m_bVppFullColorRange)
@@ -1201,6 +1382,12 @@ void CDecodingPipeline::DeleteFrames()
 
     m_pCurrentFreeVppSurface = NULL;
 
+    // drop device resources bound to the surfaces (cached wl_buffers)
+    if (m_hwdev)
+    {
+        m_hwdev->Reset();
+    }
+
     // delete frames
     if (m_pGeneralAllocator)
     {
@@ -1324,6 +1511,7 @@ mfxStatus CDecodingPipeline::ResetDecoder(sInputParams *pParams)
     // initialize parameters with values from parsed header
     sts = InitMfxParams(pParams);
     MSDK_CHECK_STATUS(sts, "InitMfxParams failed");
+    m_bVppDeferred = false;
 
     // in case of HW accelerated decode frames must be allocated prior to decoder initialization
     sts = AllocFrames();
@@ -1383,6 +1571,11 @@ mfxStatus CDecodingPipeline::DeliverOutput(mfxFrameSurface1* frame)
             }
         } else if (m_eWorkMode == MODE_RENDERING) {
             res = m_hwdev->RenderFrame(frame, m_pGeneralAllocator);
+            // after the frame is queued; only the copy runs here, the
+            // conversion and the file write run on the cache's writer thread
+            if ((MFX_ERR_NONE == res) && m_pFrameCache && m_pFrameCache->NeedsUpdate()) {
+                StoreCachedFrame(frame);
+            }
 
             while( m_delayTicks && (m_startTick + m_delayTicks > msdk_time_get_tick()) )
             {
@@ -1411,6 +1604,13 @@ mfxStatus CDecodingPipeline::DeliverLoop(void)
         if (MFX_ERR_NONE != m_error) {
             continue;
         }
+        if (m_pRendererAttached) {
+            // frames decoded before the compositor came up wait here
+            m_pRendererAttached->Wait();
+            if (MFX_ERR_NONE != m_error) {
+                continue;
+            }
+        }
         msdkOutputSurface* pCurrentDeliveredSurface = m_DeliveredSurfacesPool.GetSurface();
         if (!pCurrentDeliveredSurface) {
             m_error = MFX_ERR_NULL_PTR;
@@ -1420,6 +1620,9 @@ mfxStatus CDecodingPipeline::DeliverLoop(void)
 
         m_error = DeliverOutput(frame);
         ReturnSurfaceToBuffers(pCurrentDeliveredSurface);
+        if (!m_output_count) {
+            m_tick_first_frame = msdk_time_get_tick() - m_initTick;
+        }
 
         pCurrentDeliveredSurface = NULL;
         msdk_atomic_inc32(&m_output_count);
@@ -1504,6 +1707,12 @@ mfxStatus CDecodingPipeline::SyncOutputSurface(mfxU32 wait)
             }
             ReturnSurfaceToBuffers(m_pCurrentOutputSurface);
         } else if (m_eWorkMode == MODE_RENDERING) {
+            // presentation queue is full, let the display catch up. Decoding
+            // continues into the free surfaces meanwhile.
+            while ((m_DeliveredSurfacesPool.GetSurfaceCount() >= m_nPresentQueueDepth) &&
+                   (MFX_ERR_NONE == m_error) && !m_bStopDeliverLoop) {
+                m_pDeliveredEvent->TimedWait(MSDK_DEC_WAIT_INTERVAL);
+            }
             m_DeliveredSurfacesPool.AddSurface(m_pCurrentOutputSurface);
             m_pDeliveredEvent->Reset();
             m_pDeliverOutputSemaphore->Post();
@@ -1541,6 +1750,9 @@ mfxStatus CDecodingPipeline::RunDecoding()
 
     while (((sts == MFX_ERR_NONE) || (MFX_ERR_MORE_DATA == sts) || (MFX_ERR_MORE_SURFACE == sts)) && (m_nFrames > m_output_count))
     {
+        if (MFX_ERR_ABORTED == m_error) {
+            break;
+        }
         if (MFX_ERR_NONE != m_error) {
             msdk_printf(MSDK_STRING("DeliverOutput return error = %d\n"),m_error);
             break;
@@ -1584,6 +1796,11 @@ mfxStatus CDecodingPipeline::RunDecoding()
         }
 
         if ((MFX_ERR_NONE == sts) || (MFX_ERR_MORE_DATA == sts) || (MFX_ERR_MORE_SURFACE == sts)) {
+            // wl_buffer.release drops render_lock, also after the last frame shown
+            if ((m_eWorkMode == MODE_RENDERING) && m_hwdev &&
+                (!m_pRendererAttached || (MFX_ERR_NONE == m_pRendererAttached->TimedWait(0)))) {
+                m_hwdev->ReleaseSurfaces();
+            }
             SyncFrameSurfaces();
             SyncVppFrameSurfaces();
             if (!m_pCurrentFreeSurface) {
@@ -1795,6 +2012,25 @@ mfxStatus CDecodingPipeline::RunDecoding()
                 m_pCurrentFreeOutputSurface->surface = surface;
                 m_OutputSurfacesPool.AddSurface(m_pCurrentFreeOutputSurface);
                 m_pCurrentFreeOutputSurface = NULL;
+
+                if (m_bVppDeferred)
+                {
+                    // staged init: hand the first frame to the display now and
+                    // bring VPP up while it is being presented
+                    do {
+                        sts = SyncOutputSurface(MSDK_DEC_WAIT_INTERVAL);
+                    } while (MFX_WRN_IN_EXECUTION == sts);
+
+                    if (MFX_ERR_NONE == sts)
+                    {
+                        sts = InitDeferredVpp();
+                    }
+                    if (MFX_ERR_NONE != sts)
+                    {
+                        MSDK_PRINT_RET_MSG(sts, "Staged VPP initialization failed");
+                        break;
+                    }
+                }
             }
         }
     } //while processing
@@ -1809,6 +2045,7 @@ mfxStatus CDecodingPipeline::RunDecoding()
     }
 
     PrintPerFrameStat(true);
+    PrintInitStat();
 
     if (m_bPrintLatency && m_vLatency.size() > 0) {
         unsigned int frame_idx = 0;
@@ -1847,6 +2084,18 @@ mfxStatus CDecodingPipeline::RunDecoding()
     return sts; // ERR_NONE or ERR_INCOMPATIBLE_VIDEO_PARAM
 }
 
+void CDecodingPipeline::PrintInitStat()
+{
+    msdk_printf(MSDK_STRING("\nInit stages, ms: session %.2f, header %.2f, frames %.2f, decoder %.2f, vpp %.2f\n"),
+        CTimer::ConvertToSeconds(m_tick_init_session)*1000,
+        CTimer::ConvertToSeconds(m_tick_init_header)*1000,
+        CTimer::ConvertToSeconds(m_tick_init_frames)*1000,
+        CTimer::ConvertToSeconds(m_tick_init_decoder)*1000,
+        CTimer::ConvertToSeconds(m_tick_init_vpp)*1000);
+    msdk_printf(MSDK_STRING("First frame delivered %.2f ms after Init\n"),
+        CTimer::ConvertToSeconds(m_tick_first_frame)*1000);
+}
+
 void CDecodingPipeline::PrintInfo()
 {
     msdk_printf(MSDK_STRING("Decoding Sample Version %s\n\n"), GetMSDKSampleVersion().c_str());
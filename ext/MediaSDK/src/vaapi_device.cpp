@@ -20,6 +20,8 @@ or https://software.intel.com/en-us/media-client-solutions-support.
 #include "vaapi_device.h"
 #include "class_wayland.h"
 #include "wayland-drm-client-protocol.h"
+#include "mfx_buffering.h"
+#include <sys/mman.h>
 
 CVAAPIDeviceWayland::~CVAAPIDeviceWayland(void)
 {
@@ -30,45 +32,62 @@ mfxStatus CVAAPIDeviceWayland::Init(mfxHDL hWindow, mfxU16 nViews, mfxU32 nAdapt
 {
     mfxStatus mfx_res = MFX_ERR_NONE;
 
+    // VA display comes from the DRM render node, only the window needs the compositor.
     if(nViews)
     {
-        m_Wayland = (Wayland*)WaylandCreate();
-        if(!m_Wayland->InitDisplay()) {
-            return MFX_ERR_DEVICE_FAILED;
-        }
-
-        if(NULL == m_Wayland->GetDisplay())
-        {
-            mfx_res = MFX_ERR_UNKNOWN;
-            return mfx_res;
-        }
-       if(-1 == m_Wayland->DisplayRoundtrip())
-        {
-            mfx_res = MFX_ERR_UNKNOWN;
-            return mfx_res;
-        }
-        if(!m_Wayland->CreateSurface())
-        {
-            mfx_res = MFX_ERR_UNKNOWN;
-            return mfx_res;
-        }
+        mfx_res = InitWindow();
     }
     return mfx_res;
 }
 
-mfxStatus CVAAPIDeviceWayland::RenderFrame(mfxFrameSurface1 * pSurface, mfxFrameAllocator * /*pmfxAlloc*/)
+mfxStatus CVAAPIDeviceWayland::InitWindow(void)
 {
-    uint32_t drm_format = 0;
-    int offsets[3], pitches[3];
     mfxStatus mfx_res = MFX_ERR_NONE;
-    vaapiMemId * memId = NULL;
-    struct wl_buffer *m_wl_buffer = NULL;
-    if(NULL==pSurface) {
+
+    m_Wayland = (Wayland*)WaylandCreate();
+    if(!m_Wayland->InitDisplay()) {
+        return MFX_ERR_DEVICE_FAILED;
+    }
+
+    if(NULL == m_Wayland->GetDisplay())
+    {
         mfx_res = MFX_ERR_UNKNOWN;
         return mfx_res;
     }
-    m_Wayland->Sync();
-    memId = (vaapiMemId*)(pSurface->Data.MemId);
+    if(-1 == m_Wayland->DisplayRoundtrip())
+    {
+        mfx_res = MFX_ERR_UNKNOWN;
+        return mfx_res;
+    }
+    if(!m_Wayland->CreateSurface())
+    {
+        mfx_res = MFX_ERR_UNKNOWN;
+        return mfx_res;
+    }
+    return mfx_res;
+}
+
+wld_buffer* CVAAPIDeviceWayland::GetCachedBuffer(mfxFrameSurface1 * pSurface)
+{
+    uint32_t drm_format = 0;
+    int offsets[3], pitches[3];
+    vaapiMemId * memId = (vaapiMemId*)(pSurface->Data.MemId);
+    wld_buffer * buffer = NULL;
+
+    std::map<vaapiMemId*, wld_buffer*>::iterator it = m_BufferCache.find(memId);
+    if (it != m_BufferCache.end())
+    {
+        buffer = it->second;
+        // Same surface, still exported through the same prime fd.
+        if (buffer->handle == (int)memId->m_buffer_info.handle)
+        {
+            buffer->pInSurface = pSurface;
+            return buffer;
+        }
+        wl_buffer_destroy(buffer->buffer);
+        delete buffer;
+        m_BufferCache.erase(it);
+    }
 
     if (pSurface->Info.FourCC == MFX_FOURCC_NV12)
     {
@@ -89,20 +108,71 @@ mfxStatus CVAAPIDeviceWayland::RenderFrame(mfxFrameSurface1 * pSurface, mfxFrame
     pitches[0] = memId->m_image.pitches[0];
     pitches[1] = memId->m_image.pitches[1];
     pitches[2] = memId->m_image.pitches[2];
-    m_wl_buffer = m_Wayland->CreatePrimeBuffer(memId->m_buffer_info.handle
+
+    buffer = new wld_buffer;
+    buffer->pInSurface = pSurface;
+    buffer->handle = (int)memId->m_buffer_info.handle;
+    buffer->buffer = m_Wayland->CreatePrimeBuffer(memId->m_buffer_info.handle
       , pSurface->Info.CropW
       , pSurface->Info.CropH
       , drm_format
       , offsets
       , pitches);
-    if(NULL == m_wl_buffer)
+    if(NULL == buffer->buffer)
+    {
+        delete buffer;
+        return NULL;
+    }
+    m_Wayland->AddBufferListener(buffer);
+    m_BufferCache[memId] = buffer;
+
+    return buffer;
+}
+
+void CVAAPIDeviceWayland::FreeCachedBuffers(void)
+{
+    std::map<vaapiMemId*, wld_buffer*>::iterator it;
+    for (it = m_BufferCache.begin(); it != m_BufferCache.end(); ++it)
+    {
+        wl_buffer_destroy(it->second->buffer);
+        delete it->second;
+    }
+    m_BufferCache.clear();
+}
+
+mfxStatus CVAAPIDeviceWayland::Reset(void)
+{
+    // Surface pool is going away, cached buffers would point at stale memory.
+    FreeCachedBuffers();
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CVAAPIDeviceWayland::RenderFrame(mfxFrameSurface1 * pSurface, mfxFrameAllocator * /*pmfxAlloc*/)
+{
+    mfxStatus mfx_res = MFX_ERR_NONE;
+    wld_buffer *m_wld_buffer = NULL;
+    if(NULL==pSurface) {
+        mfx_res = MFX_ERR_UNKNOWN;
+        return mfx_res;
+    }
+
+    m_wld_buffer = GetCachedBuffer(pSurface);
+    if(NULL == m_wld_buffer)
     {
             msdk_printf("\nCan't wrap flink to wl_buffer\n");
             mfx_res = MFX_ERR_UNKNOWN;
             return mfx_res;
     }
 
-    m_Wayland->RenderBuffer(m_wl_buffer, pSurface->Info.CropW, pSurface->Info.CropH);
+    // Wait for the previous frame to be shown before queueing this one.
+    m_Wayland->Sync();
+
+    // The surface stays locked until the compositor releases its buffer.
+    msdk_atomic_inc16(&(((msdkFrameSurface*)pSurface)->render_lock));
+    m_Wayland->RenderBuffer(m_wld_buffer, pSurface->Info.CropW, pSurface->Info.CropH);
+
+    // The decoded frame replaced the still one on the surface.
+    FreeStillBuffer();
 
     // GPIO output.
     if(!m_bGotFirstFrame && m_pGPIOCtrl != nullptr)
@@ -114,8 +184,64 @@ mfxStatus CVAAPIDeviceWayland::RenderFrame(mfxFrameSurface1 * pSurface, mfxFrame
     return mfx_res;
 }
 
+void CVAAPIDeviceWayland::ReleaseSurfaces(void)
+{
+    // nothing was attached before the window exists
+    if(NULL != m_Wayland)
+        m_Wayland->DispatchReleases();
+}
+
+mfxStatus CVAAPIDeviceWayland::RenderStillFrame(int fd, mfxU32 width, mfxU32 height, mfxU32 pitch)
+{
+    if((NULL == m_Wayland) || (NULL == m_Wayland->GetShm()))
+        return MFX_ERR_NOT_INITIALIZED;
+    if(NULL != m_StillBuffer)
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+
+    if(!m_Wayland->CreateShmPool(fd, pitch * height, PROT_READ))
+        return MFX_ERR_MEMORY_ALLOC;
+
+    m_StillBuffer = new wld_buffer;
+    m_StillBuffer->pInSurface = NULL;
+    m_StillBuffer->handle = fd;
+    m_StillBuffer->buffer = m_Wayland->CreateShmBuffer(width, height, pitch, WL_SHM_FORMAT_XRGB8888);
+    if(NULL == m_StillBuffer->buffer)
+    {
+        delete m_StillBuffer;
+        m_StillBuffer = NULL;
+        m_Wayland->FreeShmPool();
+        return MFX_ERR_MEMORY_ALLOC;
+    }
+
+    m_Wayland->RenderBuffer(m_StillBuffer, width, height);
+
+    // Counts as the first frame on screen.
+    if(!m_bGotFirstFrame && m_pGPIOCtrl != nullptr)
+    {
+        m_pGPIOCtrl->outputPattern();
+        m_bGotFirstFrame = true;
+    }
+    return MFX_ERR_NONE;
+}
+
+void CVAAPIDeviceWayland::FreeStillBuffer(void)
+{
+    if(NULL == m_StillBuffer)
+        return;
+
+    wl_buffer_destroy(m_StillBuffer->buffer);
+    delete m_StillBuffer;
+    m_StillBuffer = NULL;
+    m_Wayland->FreeShmPool();
+}
+
 void CVAAPIDeviceWayland::Close(void)
 {
+    if(NULL == m_Wayland)
+        return;
+
+    FreeStillBuffer();
+    FreeCachedBuffers();
     m_Wayland->FreeSurface();
 }
 
@@ -11,6 +11,8 @@ done
 while true; do
 	found_new=n
 	for _f in `cat $PRELOAD_LIST_FILE`; do
+		# critical files carry a leading '@'
+		_f=${_f#@}
 		if [ ! -e $_f ]; then
 			f=$DESTDIR/$_f
 		else
@@ -20,7 +22,7 @@ while true; do
 			continue
 		fi
 		for f_lib in `/usr/lib64/ld-linux-x86-64.so.2 --list $f | grep '=>' | grep -o '/usr/lib[^ ]*'`; do
-			if ! grep -q "^$f_lib$" $PRELOAD_LIST_FILE; then
+			if ! grep -qx -e "$f_lib" -e "@$f_lib" $PRELOAD_LIST_FILE; then
 				found_new=y
 				echo $f_lib >> $PRELOAD_LIST_FILE
 			fi
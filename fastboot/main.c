@@ -37,7 +37,13 @@
 #include <sys/stat.h>
 #include <sys/mount.h>
 #include <sys/sysmacros.h>
+#include <sys/wait.h>
 #include <pthread.h>
+#include <spawn.h>
+
+#include "modload.h"
+#include "preload.h"
+#include "record.h"
 
 #define DEFAULT_INIT "/sbin/init"
 
@@ -52,22 +58,19 @@ static pthread_t cbc_attach_tid;
 void *cbc_attach_init(void *arg)
 {
 	int ret;
-	ret = system("/usr/bin/cbc_attach");
-	if (ret < 0)
+	pid_t pid;
+	char *const argv[] = { "/usr/bin/cbc_attach", NULL };
+
+	/* straight exec, no shell in between */
+	ret = posix_spawn(&pid, argv[0], NULL, NULL, argv, environ);
+	if (ret != 0 || waitpid(pid, NULL, 0) < 0)
 		fprintf(stderr, "failed to cbc attach\n");
 	return NULL;
 }
 #endif
 
 #define ARRAY_SIZE(array)       (sizeof(array) / sizeof((array)[0]))
-static pthread_t load_ipu4_modules_tid;
-static pthread_t load_ipu4_crlmodule_lite_tid;
-static pthread_t load_ipu4_isys_csslib_tid;
-static pthread_t load_ipu4_psys_csslib_tid;
-static pthread_t load_ipu4_mmu_tid;
-static pthread_t load_ipu4_psys_tid;
-static pthread_t load_ipu4_isys_tid;
-char *ipu4_modulesp[]  = { 
+static const char *const ipu4_modulesp[]  = {
 	"crlmodule-lite",
 	"intel-ipu4",
 	"intel-ipu4-mmu",
@@ -77,87 +80,6 @@ char *ipu4_modulesp[]  = {
 	"intel-ipu4-isys-csslib",
 };
 
-void *load_ipu4_mmu(void *arg)
-{
-	int ret;
-	char mprobe[64];
-	sprintf(mprobe, "modprobe %s", ipu4_modulesp[2]);
-	ret = system(mprobe);
-	if (ret < 0)
-		fprintf(stderr, "faile to modprobe %s", ipu4_modulesp[2]);
-	return NULL;
-}
-
-void *load_ipu4_psys(void *arg)
-{
-	int ret;
-	char mprobe[64];
-	sprintf(mprobe, "modprobe %s", ipu4_modulesp[3]);
-	ret = system(mprobe);
-	if (ret < 0)
-		fprintf(stderr, "faile to modprobe %s", ipu4_modulesp[3]);
-	return NULL;
-}
-
-
-void *load_ipu4_isys(void *arg)
-{
-	int ret;
-	char mprobe[64];
-	sprintf(mprobe, "modprobe %s", ipu4_modulesp[4]);
-	ret = system(mprobe);
-	if (ret < 0)
-		fprintf(stderr, "faile to modprobe %s", ipu4_modulesp[4]);
-	return NULL;
-}
-
-
-void *load_ipu4_crlmodule_lite(void *arg)
-{
-	int ret;
-	char mprobe[64];
-	sprintf(mprobe, "modprobe %s", ipu4_modulesp[0]);
-	ret = system(mprobe);
-	if (ret < 0)
-		fprintf(stderr, "faile to modprobe %s", ipu4_modulesp[0]);
-	return NULL;
-}
-
-void *load_ipu4_isys_csslib(void *arg)
-{
-	int ret;
-	char mprobe[64];
-	sprintf(mprobe, "modprobe %s", ipu4_modulesp[6]);
-	ret = system(mprobe);
-	if (ret < 0)
-		fprintf(stderr, "faile to modprobe %s", ipu4_modulesp[6]);
-	return NULL;
-}
-
-void *load_ipu4_psys_csslib(void *arg)
-{
-	int ret;
-	char mprobe[64];
-	sprintf(mprobe, "modprobe %s", ipu4_modulesp[5]);
-	ret = system(mprobe);
-	if (ret < 0)
-		fprintf(stderr, "faile to modprobe %s", ipu4_modulesp[5]);
-	return NULL;
-}
-
-void *load_ipu4_modules(void *arg)
-{
-	char mprobe[64];
-	int ret;
-
-	sprintf(mprobe, "modprobe %s", ipu4_modulesp[1]);
-	ret = system(mprobe);
-	if (ret < 0) 
-		fprintf(stderr, "faile to modprobe %s", ipu4_modulesp[1]);
-
-	return NULL;
-}
-
 #ifdef EARLY_AUDIO_CMD
 static pthread_t early_audio_tid;
 void *setup_early_audio(void *arg)
@@ -174,47 +96,14 @@ void *setup_early_audio(void *arg)
 
 #ifdef PRELOAD_LIST_FILE
 static pthread_t preload_tid;
+static int record_handle = -1;
 static void *preload_thread(void *arg)
 {
-	int fd;
-	struct stat sb;
-	int ret;
-	FILE *fp;
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t nread;
-
-	fp = fopen(PRELOAD_LIST_FILE, "r");
-	if (!fp) {
-//		fprintf(stderr, "open preload list error (%d): %m\n", errno);
-		goto exit;
-	}
-
-	while ((nread = getline(&line, &len, fp)) != -1) {
-		if (nread < 2) {
-			continue;
-		}
-		if (line[nread - 1] == '\n' || line[nread - 1] == '\r')
-			line[nread - 1] = 0;
-		fd = open(line, O_RDONLY);
-		if (fd > 0) {
-			fstat(fd, &sb);
-			ret = readahead(fd, 0, sb.st_size);
-			if (ret == 0) {
-				//fprintf(stdout, "preload %s success\n", line);
-			}else {
-				fprintf(stdout, "preload %s error (%d): %m\n", line, errno);
-			}
-			close(fd);
-		} else {
-			//fprintf(stdout, "preload open %s error (%d): %m\n", line, errno);
-		}
-	}
-
-exit:
-	free(line);
-	if (fp)
-		fclose(fp);
+	/* a recording boot starts cold and writes the next list instead */
+	if (record_handle >= 0)
+		record_run(record_handle, PRELOAD_LIST_FILE, RECORD_TIMEOUT_MS);
+	else
+		preload(PRELOAD_LIST_FILE, PRELOAD_LOCK_MS);
 	return NULL;
 }
 #endif
@@ -241,6 +130,12 @@ int main(int argc, char *argv[])
 	int ret;
 	char buf[8];
 
+#ifdef PRELOAD_LIST_FILE
+	/* init=earlyapp-fastboot -- --record on the kernel command line */
+	if (argc > 1 && !strcmp(argv[1], "--record"))
+		record_handle = record_start();
+#endif
+
 	if (getpid() == 1) {
 		fd = open(SPLASH_SCREEN_TRIGGER_FILE, O_RDONLY);
 		if (fd > 0) {
@@ -264,28 +159,14 @@ int main(int argc, char *argv[])
 	if (pid < 0)
 		fprintf(stderr, "fork ipu4 pid error\n");
         else if (pid == 0) {
-		pthread_create(&load_ipu4_modules_tid, NULL, load_ipu4_modules, NULL);
-		pthread_create(&load_ipu4_crlmodule_lite_tid, NULL, load_ipu4_crlmodule_lite, NULL);
-		pthread_create(&load_ipu4_isys_csslib_tid, NULL, load_ipu4_isys_csslib, NULL);
-		pthread_create(&load_ipu4_psys_csslib_tid, NULL, load_ipu4_psys_csslib, NULL);
-		pthread_create(&load_ipu4_mmu_tid,  NULL, load_ipu4_mmu, NULL);
-		pthread_create(&load_ipu4_psys_tid,  NULL, load_ipu4_psys, NULL);
-		pthread_create(&load_ipu4_isys_tid,  NULL, load_ipu4_isys, NULL);
 #ifdef CBC_ATTACH
 		pthread_create(&cbc_attach_tid, NULL, cbc_attach_init, NULL);
 #endif
+		modload(ipu4_modulesp, ARRAY_SIZE(ipu4_modulesp));
 
 #ifdef CBC_ATTACH
 		pthread_join(cbc_attach_tid, NULL);
 #endif
-
-		pthread_join(load_ipu4_modules_tid, NULL);
-		pthread_join(load_ipu4_crlmodule_lite_tid, NULL);
-		pthread_join(load_ipu4_isys_csslib_tid, NULL);
-		pthread_join(load_ipu4_psys_csslib_tid, NULL);
-		pthread_join(load_ipu4_mmu_tid, NULL);
-		pthread_join(load_ipu4_psys_tid,  NULL);
-		pthread_join(load_ipu4_isys_tid,  NULL);
 		return 0;
 	}
 
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Authors: Bin Yang <bin.yang@intel.com>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+#include "modload.h"
+
+#ifndef MODULE_INIT_COMPRESSED_FILE
+#define MODULE_INIT_COMPRESSED_FILE 4
+#endif
+
+#define MODLOAD_MAX 64
+
+enum mod_state {
+	MOD_PENDING,
+	MOD_LOADED,
+	MOD_FAILED,
+};
+
+struct module {
+	char name[64];		/* '-' folded to '_' like the kernel does */
+	char path[PATH_MAX];	/* empty when modules.dep has no entry */
+	int deps[MODLOAD_MAX];
+	int dep_count;
+	enum mod_state state;
+	double wait_ms, load_ms;
+	pthread_t tid;
+};
+
+static struct {
+	struct module mod[MODLOAD_MAX];
+	int count;
+	char dir[128];
+	char *dep;		/* modules.dep, NUL terminated */
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+} ml = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+static double ms_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 +
+		(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* "kernel/drivers/foo/intel-ipu4.ko.xz" -> "intel_ipu4" */
+static void module_name(const char *path, size_t len, char *name, size_t size)
+{
+	const char *base = path, *p;
+	size_t n = 0;
+
+	for (p = path; p < path + len; p++)
+		if (*p == '/')
+			base = p + 1;
+	for (p = base; p < path + len && *p != '.' && n + 1 < size; p++)
+		name[n++] = *p == '-' ? '_' : *p;
+	name[n] = '\0';
+}
+
+static char *read_file(const char *path)
+{
+	struct stat sb;
+	char *buf;
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &sb) < 0 || !(buf = malloc(sb.st_size + 1))) {
+		close(fd);
+		return NULL;
+	}
+	n = read(fd, buf, sb.st_size);
+	close(fd);
+	if (n != sb.st_size) {
+		free(buf);
+		return NULL;
+	}
+	buf[n] = '\0';
+	return buf;
+}
+
+/* The modules.dep line of a module, NULL if it has none */
+static const char *dep_line(const char *name)
+{
+	const char *line = ml.dep, *colon;
+	char found[64];
+
+	while (line && *line) {
+		colon = strchr(line, ':');
+		if (!colon)
+			break;
+		module_name(line, colon - line, found, sizeof(found));
+		if (!strcmp(found, name))
+			return line;
+		line = strchr(colon, '\n');
+		if (line)
+			line++;
+	}
+	return NULL;
+}
+
+/* Adds a module and its dependencies, returns its index or -1 */
+static int add_module(const char *name)
+{
+	struct module *m;
+	const char *line, *p, *end;
+	char dep[64];
+	int i, idx, d;
+
+	for (i = 0; i < ml.count; i++)
+		if (!strcmp(ml.mod[i].name, name))
+			return i;
+	if (ml.count == MODLOAD_MAX)
+		return -1;
+
+	idx = ml.count++;
+	m = &ml.mod[idx];
+	memset(m, 0, sizeof(*m));
+	snprintf(m->name, sizeof(m->name), "%s", name);
+
+	line = dep_line(name);
+	if (!line)
+		return idx;
+	p = strchr(line, ':');
+	snprintf(m->path, sizeof(m->path), "%s/%.*s", ml.dir, (int) (p - line), line);
+
+	/* modules.dep already lists the whole closure, no recursion needed */
+	for (p++; *p && *p != '\n'; p = end) {
+		while (*p == ' ')
+			p++;
+		for (end = p; *end && *end != ' ' && *end != '\n'; end++)
+			;
+		if (end == p)
+			break;
+		module_name(p, end - p, dep, sizeof(dep));
+		d = add_module(dep);
+		if (d >= 0 && m->dep_count < MODLOAD_MAX)
+			m->deps[m->dep_count++] = d;
+	}
+	return idx;
+}
+
+/* Returns 0 or a negative errno */
+static int load_module(const struct module *m)
+{
+	const char *ext = strrchr(m->path, '.');
+	int flags = 0, ret, fd;
+	char cmd[96];
+
+	if (!m->path[0]) {
+		/* an alias or built-in module, leave it to modprobe */
+		snprintf(cmd, sizeof(cmd), "modprobe %s", m->name);
+		return system(cmd) == 0 ? 0 : -ENOENT;
+	}
+
+	if (ext && strcmp(ext, ".ko"))
+		flags |= MODULE_INIT_COMPRESSED_FILE;
+	fd = open(m->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	ret = syscall(SYS_finit_module, fd, "", flags);
+	if (ret < 0)
+		ret = errno == EEXIST ? 0 : -errno;
+	close(fd);
+	return ret;
+}
+
+static void *module_thread(void *arg)
+{
+	struct module *m = arg;
+	struct timespec start;
+	enum mod_state state = MOD_LOADED;
+	int i, ready, ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_mutex_lock(&ml.lock);
+	do {
+		ready = 1;
+		for (i = 0; i < m->dep_count; i++) {
+			if (ml.mod[m->deps[i]].state == MOD_PENDING)
+				ready = 0;
+			else if (ml.mod[m->deps[i]].state == MOD_FAILED)
+				state = MOD_FAILED;
+		}
+		if (!ready)
+			pthread_cond_wait(&ml.done, &ml.lock);
+	} while (!ready);
+	pthread_mutex_unlock(&ml.lock);
+	m->wait_ms = ms_since(&start);
+
+	if (state == MOD_FAILED)
+		fprintf(stderr, "modload: %s skipped, a dependency failed\n", m->name);
+	else if ((ret = load_module(m)) < 0) {
+		fprintf(stderr, "modload: %s failed: %s\n", m->name, strerror(-ret));
+		state = MOD_FAILED;
+	}
+	m->load_ms = ms_since(&start) - m->wait_ms;
+
+	pthread_mutex_lock(&ml.lock);
+	m->state = state;
+	pthread_cond_broadcast(&ml.done);
+	pthread_mutex_unlock(&ml.lock);
+	return NULL;
+}
+
+int modload(const char *const *names, unsigned int count)
+{
+	struct timespec start;
+	struct utsname uts;
+	char path[PATH_MAX];
+	char name[64];
+	unsigned int i;
+	int failed = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (uname(&uts) == 0) {
+		snprintf(ml.dir, sizeof(ml.dir), "/lib/modules/%s", uts.release);
+		snprintf(path, sizeof(path), "%s/modules.dep", ml.dir);
+		ml.dep = read_file(path);
+	}
+	if (!ml.dep)
+		fprintf(stderr, "modload: no modules.dep, using modprobe\n");
+
+	for (i = 0; i < count; i++) {
+		module_name(names[i], strlen(names[i]), name, sizeof(name));
+		if (add_module(name) < 0)
+			fprintf(stderr, "modload: too many modules, %s dropped\n", names[i]);
+	}
+	free(ml.dep);
+	ml.dep = NULL;
+
+	for (i = 0; i < (unsigned int) ml.count; i++) {
+		if (pthread_create(&ml.mod[i].tid, NULL, module_thread, &ml.mod[i])) {
+			fprintf(stderr, "modload: no thread for %s\n", ml.mod[i].name);
+			ml.mod[i].tid = 0;
+			/* lets its dependents give up instead of waiting forever */
+			pthread_mutex_lock(&ml.lock);
+			ml.mod[i].state = MOD_FAILED;
+			pthread_cond_broadcast(&ml.done);
+			pthread_mutex_unlock(&ml.lock);
+		}
+	}
+	for (i = 0; i < (unsigned int) ml.count; i++) {
+		if (ml.mod[i].tid)
+			pthread_join(ml.mod[i].tid, NULL);
+		if (ml.mod[i].state == MOD_FAILED)
+			failed++;
+		fprintf(stdout, "modload: %-24s waited %7.3f ms, loaded in %7.3f ms%s\n",
+				ml.mod[i].name, ml.mod[i].wait_ms, ml.mod[i].load_ms,
+				ml.mod[i].state == MOD_FAILED ? " (failed)" : "");
+	}
+	fprintf(stdout, "modload: %d modules in %.3f ms\n", ml.count, ms_since(&start));
+	return failed;
+}
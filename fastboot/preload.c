@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Authors: Bin Yang <bin.yang@intel.com>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+
+#include "preload.h"
+
+#define PRELOAD_WORKERS 4
+/* read size for pages readahead has not brought in */
+#define PRELOAD_CHUNK (128 * 1024)
+/* a file another worker is still submitting */
+#define PRELOAD_POLL_US 1000
+
+struct preload_file {
+	char *path;
+	int critical;
+	int fd;
+	dev_t dev;
+	uint64_t physical;	/* first extent on disk, inode number without FIEMAP */
+	off_t size;
+	char *ranges;		/* "offset:length ..." from a recorded list, or NULL */
+	void *map;		/* locked mapping of a critical file */
+	int err;
+	int submitted;		/* set last by the submitting worker */
+	int cached;		/* every preloaded page is in the page cache */
+	double submit_ms;	/* readahead queued (locked files: read) */
+	double done_ms;		/* last page resident */
+};
+
+static struct {
+	struct preload_file *files;
+	unsigned int count;
+	unsigned int next;	/* next file for a worker to submit */
+	unsigned int next_wait;	/* next file for a worker to wait on */
+	struct timespec start;
+} pl;
+
+static double ms_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 +
+		(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Physical offset of the first extent, 0 if the file system can't tell */
+static uint64_t first_extent(int fd)
+{
+	struct {
+		struct fiemap map;
+		struct fiemap_extent extent;
+	} fm;
+
+	memset(&fm, 0, sizeof(fm));
+	fm.map.fm_length = FIEMAP_MAX_OFFSET;
+	fm.map.fm_extent_count = 1;
+	if (ioctl(fd, FS_IOC_FIEMAP, &fm.map) < 0 || !fm.map.fm_mapped_extents)
+		return 0;
+	return fm.extent.fe_physical;
+}
+
+static int file_order(const void *a, const void *b)
+{
+	const struct preload_file *fa = a, *fb = b;
+
+	/* what earlyapp needs first comes first, then disk order */
+	if (fa->critical != fb->critical)
+		return fb->critical - fa->critical;
+	if (fa->dev != fb->dev)
+		return fa->dev < fb->dev ? -1 : 1;
+	if (fa->physical != fb->physical)
+		return fa->physical < fb->physical ? -1 : 1;
+	return 0;
+}
+
+static int read_list(const char *list_file)
+{
+	struct preload_file *f;
+	unsigned int size = 0;
+	struct stat sb;
+	char *line = NULL, *path, *ranges;
+	size_t len = 0;
+	ssize_t nread;
+	FILE *fp;
+
+	fp = fopen(list_file, "r");
+	if (!fp)
+		return -1;
+
+	while ((nread = getline(&line, &len, fp)) != -1) {
+		while (nread && (line[nread - 1] == '\n' || line[nread - 1] == '\r'))
+			line[--nread] = 0;
+		path = line[0] == '@' ? line + 1 : line;
+		ranges = strchr(path, ' ');
+		if (ranges)
+			*ranges++ = '\0';
+		if (!*path)
+			continue;
+
+		if (pl.count == size) {
+			size = size ? size * 2 : 64;
+			f = realloc(pl.files, size * sizeof(*f));
+			if (!f)
+				break;
+			pl.files = f;
+		}
+		f = &pl.files[pl.count];
+		memset(f, 0, sizeof(*f));
+		f->fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (f->fd < 0 || fstat(f->fd, &sb) < 0) {
+			if (f->fd >= 0)
+				close(f->fd);
+			continue;
+		}
+		f->path = strdup(path);
+		f->ranges = ranges && *ranges ? strdup(ranges) : NULL;
+		f->critical = line[0] == '@';
+		f->dev = sb.st_dev;
+		f->size = sb.st_size;
+		f->physical = first_extent(f->fd);
+		if (!f->physical)
+			f->physical = sb.st_ino;
+		pl.count++;
+	}
+
+	free(line);
+	fclose(fp);
+	return 0;
+}
+
+/* Calls fn on each recorded range, or on the whole file without ranges */
+static int for_each_range(struct preload_file *f,
+		int (*fn)(struct preload_file *, off_t, off_t))
+{
+	char *p = f->ranges, *end;
+	unsigned long long off, len;
+	int ret;
+
+	if (!p)
+		return fn(f, 0, f->size);
+	while (sscanf(p, "%llu:%llu", &off, &len) == 2) {
+		ret = fn(f, off, len);
+		if (ret)
+			return ret;
+		end = strchr(p, ' ');
+		if (!end)
+			break;
+		p = end + 1;
+	}
+	return 0;
+}
+
+static int submit_range(struct preload_file *f, off_t off, off_t len)
+{
+	return posix_fadvise(f->fd, off, len, POSIX_FADV_WILLNEED);
+}
+
+/*
+ * Reads whatever part of the range is still not in the page cache. Pages
+ * under readahead make pread wait for their I/O, and pages WILLNEED left
+ * out (it caps how much it queues) are read here, so on return the whole
+ * range is cached.
+ */
+static int range_complete(struct preload_file *f, off_t off, off_t len)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	off_t start = off & ~(off_t)(page - 1);
+	size_t map_len, pages, i, run;
+	unsigned char *vec = NULL;
+	char buf[PRELOAD_CHUNK];
+	void *map;
+	ssize_t n;
+	int ret = 0;
+
+	if (off >= f->size)
+		return 0;
+	if (len > f->size - off)
+		len = f->size - off;
+	map_len = off + len - start;
+	pages = (map_len + page - 1) / page;
+
+	map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, f->fd, start);
+	if (map == MAP_FAILED)
+		return errno;
+	vec = malloc(pages);
+	if (!vec || mincore(map, map_len, vec) < 0) {
+		ret = vec ? errno : ENOMEM;
+		pages = 0;
+	}
+	munmap(map, map_len);
+
+	for (i = 0; i < pages && !ret; i += run) {
+		for (run = 0; i + run < pages && !(vec[i + run] & 1) &&
+				(run + 1) * page <= sizeof(buf); run++)
+			;
+		if (!run) {
+			run = 1;
+			continue;
+		}
+		n = pread(f->fd, buf, run * page, start + i * page);
+		if (n < 0)
+			ret = errno;
+	}
+	free(vec);
+	return ret;
+}
+
+static void preload_file(struct preload_file *f)
+{
+	if (f->critical && f->size) {
+		/* faulted in by MAP_POPULATE, kept there by mlock */
+		f->map = mmap(NULL, f->size, PROT_READ, MAP_SHARED | MAP_POPULATE, f->fd, 0);
+		if (f->map != MAP_FAILED && mlock(f->map, f->size) == 0) {
+			f->submit_ms = f->done_ms = ms_since(&pl.start);
+			f->cached = 1;
+			__atomic_store_n(&f->submitted, 1, __ATOMIC_RELEASE);
+			return;
+		}
+		if (f->map != MAP_FAILED)
+			munmap(f->map, f->size);
+		f->map = NULL;
+	}
+	/* only what the recorded boot actually read, if it was recorded */
+	f->err = for_each_range(f, submit_range);
+	f->submit_ms = ms_since(&pl.start);
+	__atomic_store_n(&f->submitted, 1, __ATOMIC_RELEASE);
+}
+
+/* Returns once the readahead of f has landed, which is its done time */
+static void preload_wait(struct preload_file *f)
+{
+	if (!f->err && !f->cached) {
+		f->err = for_each_range(f, range_complete);
+		f->done_ms = ms_since(&pl.start);
+		f->cached = !f->err;
+	}
+	close(f->fd);
+	f->fd = -1;
+}
+
+static void *preload_worker(void *arg)
+{
+	unsigned int i;
+
+	while ((i = __atomic_fetch_add(&pl.next, 1, __ATOMIC_RELAXED)) < pl.count)
+		preload_file(&pl.files[i]);
+	/* submitted in order, so they mostly complete in order too */
+	while ((i = __atomic_fetch_add(&pl.next_wait, 1, __ATOMIC_RELAXED)) < pl.count) {
+		/* another worker may still be submitting it */
+		while (!__atomic_load_n(&pl.files[i].submitted, __ATOMIC_ACQUIRE))
+			usleep(PRELOAD_POLL_US);
+		preload_wait(&pl.files[i]);
+	}
+	return NULL;
+}
+
+int preload(const char *list_file, unsigned int lock_ms)
+{
+	pthread_t workers[PRELOAD_WORKERS];
+	unsigned int i, started = 0, locked = 0;
+	int failed = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &pl.start);
+	if (read_list(list_file) < 0)
+		return -1;
+	qsort(pl.files, pl.count, sizeof(*pl.files), file_order);
+
+	for (i = 0; i < PRELOAD_WORKERS && i < pl.count; i++) {
+		if (pthread_create(&workers[started], NULL, preload_worker, NULL) == 0)
+			started++;
+	}
+	/* no worker at all, do it here */
+	if (!started)
+		preload_worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+
+	for (i = 0; i < pl.count; i++) {
+		struct preload_file *f = &pl.files[i];
+
+		if (f->err) {
+			fprintf(stdout, "preload %s error (%d): %s\n", f->path, f->err,
+					strerror(f->err));
+			failed++;
+		} else {
+			fprintf(stdout, "preload: submitted %8.3f ms, cached %8.3f ms %s%s\n",
+					f->submit_ms, f->done_ms, f->path,
+					f->map ? " (locked)" : "");
+		}
+		if (f->map)
+			locked++;
+	}
+	fprintf(stdout, "preload: %u files cached in %.3f ms, %u locked\n",
+			pl.count, ms_since(&pl.start), locked);
+
+	/* until earlyapp had the time to map them itself */
+	if (locked)
+		usleep(lock_ms * 1000);
+
+	for (i = 0; i < pl.count; i++) {
+		if (pl.files[i].map)
+			munmap(pl.files[i].map, pl.files[i].size);
+		free(pl.files[i].path);
+		free(pl.files[i].ranges);
+	}
+	free(pl.files);
+	pl.files = NULL;
+	pl.count = 0;
+	return failed;
+}
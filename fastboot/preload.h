@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Authors: Bin Yang <bin.yang@intel.com>
+ */
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+/*
+ * Pulls the files named in list_file (one path per line, optionally
+ * followed by " offset:length" ranges to read instead of the whole file)
+ * into the page cache. A few workers issue the I/O together, in on-disk order. Lines
+ * starting with '@' name critical files: they are read first, mapped and
+ * locked in memory for lock_ms before preload() returns. Per file it
+ * prints when the readahead was submitted and when the whole file (or
+ * its ranges) was in the page cache.
+ *
+ * Returns the number of files that could not be preloaded.
+ */
+int preload(const char *list_file, unsigned int lock_ms);
+
+#endif
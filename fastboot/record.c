@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Authors: Bin Yang <bin.yang@intel.com>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/fanotify.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "cam_telemetry.h"
+#include "kpi_marker.h"
+#include "record.h"
+
+#ifndef FAN_OPEN_EXEC
+#define FAN_OPEN_EXEC 0
+#endif
+
+/* Gaps up to this size between cached ranges are read anyway */
+#define RECORD_RANGE_GAP (64 * 1024)
+
+struct recorded_file {
+	char *path;
+	int critical;
+	/* list line of a critical file that was not opened this time */
+	char *line;
+};
+
+static struct {
+	struct recorded_file *files;
+	unsigned int count, size;
+} rec;
+
+static int recorded(const char *path)
+{
+	unsigned int i;
+
+	for (i = 0; i < rec.count; i++)
+		if (!strcmp(rec.files[i].path, path))
+			return 1;
+	return 0;
+}
+
+static void add_file(const char *path, int critical)
+{
+	struct recorded_file *f;
+
+	if (recorded(path))
+		return;
+	if (rec.count == rec.size) {
+		rec.size = rec.size ? rec.size * 2 : 256;
+		f = realloc(rec.files, rec.size * sizeof(*f));
+		if (!f)
+			return;
+		rec.files = f;
+	}
+	rec.files[rec.count].path = strdup(path);
+	rec.files[rec.count].critical = critical;
+	rec.files[rec.count].line = NULL;
+	rec.count++;
+}
+
+/*
+ * KPI markers earlyapp emits when an output shows its first frame. The
+ * GStreamer devices mark play() before their pipeline runs, so a Gst
+ * boot is recorded until the timeout instead.
+ */
+static const char *const frame_markers[] = {
+	"MSDK Video", "gles", "csi-camera", "ici-camera",
+};
+
+/* True once a camera ring holds a rendered frame */
+static int camera_frame_shown(void)
+{
+	static const char *const sources[] = { "csi", "ici" };
+	const struct cam_telemetry *t;
+	struct cam_frame_record r;
+	uint64_t n, head;
+	unsigned int i;
+	int shown = 0;
+
+	for (i = 0; i < 2 && !shown; i++) {
+		t = cam_telemetry_attach(sources[i]);
+		if (!t)
+			continue;
+		head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+		/* only the newest slots still hold their records */
+		n = head > CAM_TELEMETRY_SLOTS ? head - CAM_TELEMETRY_SLOTS : 0;
+		for (; n < head && !shown; n++)
+			shown = cam_telemetry_read(t, n, &r) == 0 && r.render_ns;
+		cam_telemetry_detach(t);
+	}
+	return shown;
+}
+
+/* True once the shm KPI ring (--kpi-marker shm) has a first frame marker */
+static int marker_frame_shown(void)
+{
+	const struct kpi_marker_ring *ring = kpi_marker_ring_attach();
+	struct kpi_marker_record r;
+	uint64_t n, head;
+	unsigned int i;
+	int shown = 0;
+
+	if (!ring)
+		return 0;
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	n = head > KPI_MARKER_SLOTS ? head - KPI_MARKER_SLOTS : 0;
+	for (; n < head && !shown; n++) {
+		if (kpi_marker_read(ring, n, &r) < 0)
+			continue;
+		for (i = 0; i < sizeof(frame_markers) / sizeof(frame_markers[0]); i++)
+			shown |= !strcmp(r.name, frame_markers[i]);
+	}
+	munmap((void *) ring, sizeof(*ring));
+	return shown;
+}
+
+/* True once earlyapp has shown a camera, video or GLES frame */
+static int first_frame_shown(void)
+{
+	return camera_frame_shown() || marker_frame_shown();
+}
+
+static void read_events(int fan)
+{
+	char buf[8192] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+	const struct fanotify_event_metadata *ev;
+	char link[32], path[PATH_MAX];
+	struct stat sb;
+	ssize_t len, n;
+
+	len = read(fan, buf, sizeof(buf));
+	for (ev = (void *) buf; len > 0 && FAN_EVENT_OK(ev, len); ev = FAN_EVENT_NEXT(ev, len)) {
+		if (ev->fd < 0)
+			continue;
+		snprintf(link, sizeof(link), "/proc/self/fd/%d", ev->fd);
+		n = readlink(link, path, sizeof(path) - 1);
+		if (n > 0 && ev->pid != getpid() && fstat(ev->fd, &sb) == 0 &&
+				S_ISREG(sb.st_mode)) {
+			path[n] = '\0';
+			add_file(path, 0);
+		}
+		close(ev->fd);
+	}
+}
+
+int record_start(void)
+{
+	int fan;
+
+	/* opened files are named through /proc/self/fd */
+	if (access("/proc/self/fd", R_OK) != 0)
+		mount("proc", "/proc", "proc", 0, NULL);
+
+	fan = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK,
+			O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+	if (fan < 0) {
+		fprintf(stderr, "record: fanotify_init error (%d): %m\n", errno);
+		return -1;
+	}
+	if (fanotify_mark(fan, FAN_MARK_ADD | FAN_MARK_MOUNT,
+				FAN_OPEN | FAN_OPEN_EXEC, AT_FDCWD, "/") < 0) {
+		fprintf(stderr, "record: fanotify_mark error (%d): %m\n", errno);
+		close(fan);
+		return -1;
+	}
+	return fan;
+}
+
+/*
+ * Writes a list line for a file with data in the page cache: the path,
+ * then the cached parts as " offset:length" unless that is all of it.
+ */
+static int write_file(FILE *out, const struct recorded_file *f)
+{
+	const char *path = f->path;
+	unsigned char *vec = NULL;
+	size_t pages, i, start = 0, end = 0;
+	long page = sysconf(_SC_PAGESIZE);
+	int fd, cached = 0, whole;
+	struct stat sb;
+	void *map;
+
+	if (f->line) {
+		fputs(f->line, out);
+		if (f->line[strlen(f->line) - 1] != '\n')
+			fputc('\n', out);
+		return 1;
+	}
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &sb) < 0 || !sb.st_size) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+	pages = (sb.st_size + page - 1) / page;
+	vec = malloc(pages);
+	if (!vec || mincore(map, sb.st_size, vec) < 0) {
+		free(vec);
+		munmap(map, sb.st_size);
+		return 0;
+	}
+
+	for (i = 0; i < pages; i++)
+		cached += vec[i] & 1;
+	whole = (size_t) cached == pages;
+	if (cached)
+		fprintf(out, "%s%s", f->critical ? "@" : "", path);
+	if (cached && !whole) {
+		for (i = 0; i < pages; i++) {
+			if (!(vec[i] & 1))
+				continue;
+			if (end == start || (i - end) * page > RECORD_RANGE_GAP) {
+				if (end > start)
+					fprintf(out, " %zu:%zu", start * page, (end - start) * page);
+				start = i;
+			}
+			end = i + 1;
+		}
+		if (end > start)
+			fprintf(out, " %zu:%zu", start * page, (end - start) * page);
+	}
+	if (cached)
+		fputc('\n', out);
+
+	free(vec);
+	munmap(map, sb.st_size);
+	return cached;
+}
+
+int record_run(int fan, const char *list_file, unsigned int timeout_ms)
+{
+	struct pollfd pfd = { .fd = fan, .events = POLLIN };
+	struct timespec start, now;
+	char tmp[PATH_MAX], *line = NULL, *copy, *path;
+	unsigned int i, opened, written = 0;
+	size_t len = 0;
+	ssize_t nread;
+	FILE *fp;
+
+	if (fan < 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		if (poll(&pfd, 1, 100) > 0)
+			read_events(fan);
+		if (first_frame_shown())
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec - start.tv_sec) * 1000 +
+				(now.tv_nsec - start.tv_nsec) / 1000000 >= timeout_ms) {
+			fprintf(stderr, "record: no first frame within %u ms\n", timeout_ms);
+			break;
+		}
+	}
+	/* what was opened right before the frame */
+	read_events(fan);
+	close(fan);
+
+	/*
+	 * Keep the critical entries of the current list. Ones not opened
+	 * this time are carried over as they were.
+	 */
+	opened = rec.count;
+	fp = fopen(list_file, "r");
+	while (fp && (nread = getline(&line, &len, fp)) != -1) {
+		if (line[0] != '@')
+			continue;
+		copy = strdup(line);
+		path = strtok(line + 1, " \r\n");
+		for (i = 0; path && i < rec.count; i++)
+			if (!strcmp(rec.files[i].path, path))
+				break;
+		if (path && i == rec.count) {
+			add_file(path, 1);
+			if (i < rec.count) {
+				rec.files[i].line = copy;
+				copy = NULL;
+			}
+		} else if (path) {
+			rec.files[i].critical = 1;
+		}
+		free(copy);
+	}
+	free(line);
+	if (fp)
+		fclose(fp);
+
+	snprintf(tmp, sizeof(tmp), "%s.new", list_file);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		fprintf(stderr, "record: create %s error (%d): %m\n", tmp, errno);
+		return -1;
+	}
+	for (i = 0; i < rec.count; i++) {
+		/* files opened but never read are left out */
+		if (write_file(fp, &rec.files[i]))
+			written++;
+		free(rec.files[i].path);
+		free(rec.files[i].line);
+	}
+	free(rec.files);
+	fclose(fp);
+	if (rename(tmp, list_file) < 0) {
+		fprintf(stderr, "record: rename to %s error (%d): %m\n", list_file, errno);
+		return -1;
+	}
+	fprintf(stdout, "record: %u files opened, %u listed in %s\n",
+			opened, written, list_file);
+	return 0;
+}
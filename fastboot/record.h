@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Authors: Bin Yang <bin.yang@intel.com>
+ */
+#ifndef RECORD_H
+#define RECORD_H
+
+/*
+ * Boot I/O recorder behind earlyapp-fastboot --record.
+ *
+ * record_start() begins watching file opens on the root file system and
+ * returns a handle, or -1. record_run() collects the opens in order until
+ * a camera frame has been rendered (see cam_telemetry.h), a first frame
+ * KPI marker of the video, GLES or camera output is in the shm marker
+ * ring (see kpi_marker.h), or timeout_ms passed, then writes list_file
+ * for preload(): every file touched, in
+ * first-open order, with the byte ranges that made it into the page
+ * cache. '@' marks of an existing list are kept.
+ */
+int record_start(void);
+int record_run(int handle, const char *list_file, unsigned int timeout_ms);
+
+#endif
@@ -34,8 +34,18 @@
 #include <sys/mount.h>
 #include <sys/sysmacros.h>
 
+#ifdef SPLASH_SCREEN_KPI_MARKER
+#include "kpi_marker.h"
+
+#define SPLASH_MARKER_START	1
+#define SPLASH_MARKER_END	2
+#endif
+
 void *splash_screen_init(void *arg)
 {
+#ifdef SPLASH_SCREEN_KPI_MARKER
+	struct kpi_marker marker;
+#endif
 	int fd = -1;
 	int fd_fb0 = -1;
 	struct stat sb;
@@ -46,6 +56,10 @@ void *splash_screen_init(void *arg)
 	dev = makedev(29, 0);
 	mknod(WORKDIR"/fb0_dev", 0600 | S_IFCHR, dev);
 
+#ifdef SPLASH_SCREEN_KPI_MARKER
+	kpi_marker_open(&marker, kpi_marker_sink_from_name(SPLASH_SCREEN_KPI_MARKER));
+	kpi_marker_emit(&marker, SPLASH_MARKER_START, "splash-start");
+#endif
 #ifdef SPLASH_SCREEN_START_CMD
 	if (system(SPLASH_SCREEN_START_CMD " > /dev/null"))
 		fprintf(stderr, "\"%s\" return error\n", SPLASH_SCREEN_START_CMD);
@@ -76,6 +90,10 @@ void *splash_screen_init(void *arg)
 	}
 
 exit:
+#ifdef SPLASH_SCREEN_KPI_MARKER
+	kpi_marker_emit(&marker, SPLASH_MARKER_END, "splash-end");
+	kpi_marker_close(&marker);
+#endif
 #ifdef SPLASH_SCREEN_END_CMD
 	if (system(SPLASH_SCREEN_END_CMD " > /dev/null"))
 		fprintf(stderr, "\"%s\" return error\n", SPLASH_SCREEN_END_CMD);
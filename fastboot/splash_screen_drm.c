@@ -36,162 +36,51 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
-#define FB_DEPTH 24
-#define FB_BPP 32
+#include "kms_presenter.h"
+#include "splash_image.h"
 
-struct  drm_fb_t {
-	int drm_fd;
-	drmModeModeInfo mode;
-	uint32_t conn_id;
-	uint32_t crtc_id;
-	uint32_t fb_id;
-	uint32_t handle;
-	uint32_t width;
-	uint32_t height;
-	uint32_t stride;
-	uint32_t size;
-	uint8_t *map;
-};
+#ifdef SPLASH_SCREEN_KPI_MARKER
+#include "kpi_marker.h"
 
-static struct drm_fb_t drm_fb0;
+#define SPLASH_MARKER_START	1
+#define SPLASH_MARKER_END	2
+#endif
 
-static void drm_destroy_fb(struct drm_fb_t *fb)
-{
-	struct drm_mode_destroy_dumb dreq;
+static struct kms_presenter splash_kms;
 
-	if (fb->map && fb->map != MAP_FAILED)
-		munmap(fb->map, fb->size);
-	drmModeRmFB(fb->drm_fd, fb->fb_id);
-	memset(&dreq, 0, sizeof(dreq));
-	dreq.handle = fb->handle;
-	drmIoctl(fb->drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
-}
-
-static int drm_get_fb0(int fd, struct drm_fb_t *fb)
+/* Compressed images are decoded into fb, anything else is a raw dump of it */
+static int splash_load(int img_fd, struct kms_presenter *k, struct kms_buffer *fb)
 {
-	drmModeRes *res = NULL;
-	drmModeConnector *conn = NULL;
-	drmModeEncoder *enc = NULL;
-	struct drm_mode_create_dumb creq;
-	struct drm_mode_map_dumb mreq;
-	uint64_t has_dumb;
-	int i, j;
-	int ret = 0;
+	struct splash_image_header h;
+	struct stat sb;
+	void *data;
+	int ret;
 
-	if (drmGetCap(fd, DRM_CAP_DUMB_BUFFER, &has_dumb) < 0 || has_dumb == 0) {
-		fprintf(stderr, "DRM_CAP_DUMB_BUFFER not support\n");
-		return -1;
+	fstat(img_fd, &sb);
+	if (pread(img_fd, &h, sizeof(h), 0) != sizeof(h) || !splash_image_check(&h, sb.st_size)) {
+		if (fb->size != sb.st_size)
+			fprintf(stderr, "fb size and splash img size mismatch, fb size: %llu, img size: %lu\n",
+				(unsigned long long)fb->size, sb.st_size);
+		return read(img_fd, fb->map, fb->size) <= 0 ? -1 : 0;
 	}
 
-	res = drmModeGetResources(fd);
-	if (!res) {
-		fprintf(stderr, "Cannot get DRM resources\n");
+	data = malloc(h.data_size);
+	if (!data || pread(img_fd, data, h.data_size, sizeof(h)) != h.data_size) {
+		free(data);
 		return -1;
 	}
-
-	for (i = 0; i < res->count_connectors; ++i) {
-		conn = drmModeGetConnector(fd, res->connectors[i]);
-		if (conn && conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0)
-			break;
-		if (conn)
-			drmModeFreeConnector(conn);
-	}
-	if (!res) {
-		fprintf(stderr, "Cannot get valid connector\n");
-		ret = -1;
-		goto exit;
-	}
-
-	fb->drm_fd = fd;
-	fb->conn_id = conn->connector_id;
-	fb->width = conn->modes[0].hdisplay;
-	fb->height = conn->modes[0].vdisplay;
-	//fprintf(stdout, "Get connector %d, %ux%u\n", conn->connector_id, fb->width, fb->height);
-
-	enc = drmModeGetEncoder(fd, conn->encoder_id);
-	if (!enc) {
-		for (i = 0; i < conn->count_encoders; ++i) {
-			enc = drmModeGetEncoder(fd, conn->encoders[i]);
-			if (!enc)
-				continue;
-			for (j = 0; j < res->count_crtcs; ++j) {
-				if (enc->possible_crtcs & (1 << j))
-					break;
-			}
-			if (j >= res->count_crtcs) {
-				drmModeFreeEncoder(enc);
-				continue;
-			}
-			fb->crtc_id = res->crtcs[j];
-			break;
-		}
-	} else {
-		fb->crtc_id = enc->crtc_id;
-	}
-
-	if (!enc) {
-		fprintf(stderr, "Cannot get valid encoder\n");
-		ret = -1;
-		goto exit;
-	}
-
-	memset(&creq, 0, sizeof(creq));
-	creq.width = fb->width;
-	creq.height = fb->height;
-	creq.bpp = FB_BPP;
-	ret = drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq);
-	if (ret < 0) {
-		fprintf(stderr, "Cannot create dumb\n");
-		goto exit;
-	}
-	fb->stride = creq.pitch;
-	fb->size = creq.size;
-	fb->handle = creq.handle;
-
-	ret = drmModeAddFB(fd, fb->width, fb->height, 24, 32, fb->stride,
-			   fb->handle, &fb->fb_id);
-	if (ret) {
-		fprintf(stderr, "Cannot create framebuf\n");
-		goto err_destroy;
-	}
-
-	memset(&mreq, 0, sizeof(mreq));
-	mreq.handle = fb->handle;
-	ret = drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq);
-	if (ret) {
-		fprintf(stderr, "Cannot map dump\n");
-		goto err_destroy;
-	}
-
-	fb->map = mmap(0, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mreq.offset);
-	if (fb->map == MAP_FAILED) {
-		fprintf(stderr, "framebuf mmap error\n");
-		goto err_destroy;
-	}
-
-	ret = drmModeSetCrtc(fd, fb->crtc_id, fb->fb_id, 0, 0, &fb->conn_id, 1, &conn->modes[0]);
-	if (ret) {
-		fprintf(stderr, "set crtc error (%d): %m\n", errno);
-		goto err_destroy;
-	}
-
-	goto exit;
-
-err_destroy:
-	drm_destroy_fb(fb);
-exit:
-	if (enc)
-		drmModeFreeEncoder(enc);
-	if (conn)
-		drmModeFreeConnector(conn);
-	if (res)
-		drmModeFreeResources(res);
+	ret = splash_image_decode(&h, data, fb->map, k->width, k->height, fb->pitch);
+	if (ret < 0)
+		fprintf(stderr, "%s is corrupt\n", SPLASH_SCREEN_FB_FILE);
+	free(data);
 	return ret;
 }
 
-
 void *splash_screen_init(void *arg)
 {
+#ifdef SPLASH_SCREEN_KPI_MARKER
+	struct kpi_marker marker;
+#endif
 	dev_t dev;
 	int drm_fd = -1;
 	int img_fd = -1;
@@ -199,8 +88,12 @@ void *splash_screen_init(void *arg)
 	char str[6];
 	int msec;
 	useconds_t usec;
-	struct stat sb;
+	struct kms_buffer *fb;
 
+#ifdef SPLASH_SCREEN_KPI_MARKER
+	kpi_marker_open(&marker, kpi_marker_sink_from_name(SPLASH_SCREEN_KPI_MARKER));
+	kpi_marker_emit(&marker, SPLASH_MARKER_START, "splash-start");
+#endif
 #ifdef SPLASH_SCREEN_START_CMD
 	if (system(SPLASH_SCREEN_START_CMD " > /dev/null"))
 		fprintf(stderr, "\"%s\" return error\n", SPLASH_SCREEN_START_CMD);
@@ -219,20 +112,29 @@ void *splash_screen_init(void *arg)
 		goto exit;
 	}
 
-	if (drm_get_fb0(drm_fd, &drm_fb0) != 0) {
-		fprintf(stderr, "get fb0 error\n");
+	if (kms_presenter_open(&splash_kms, drm_fd) != 0) {
+		fprintf(stderr, "kms presenter open error\n");
+		close(drm_fd);
+		drm_fd = -1;
 		goto exit;
 	}
 
-	fstat(img_fd, &sb);
-	if (drm_fb0.size != sb.st_size)
-		fprintf(stderr, "fb0 size and splash img size mismatch, fb0 size: %u, img size: %lu\n", drm_fb0.size, sb.st_size);
-	if (read(img_fd, drm_fb0.map, drm_fb0.size) <= 0) {
+	fb = kms_presenter_back(&splash_kms);
+	if (splash_load(img_fd, &splash_kms, fb) != 0) {
 		fprintf(stderr, "read %s error, errno = %d\n", SPLASH_SCREEN_FB_FILE, errno);
 		goto exit;
 	}
+	/* master is dropped right away, the compositor may start under the splash */
+	if (kms_presenter_acquire(&splash_kms) != 0 ||
+	    kms_presenter_present(&splash_kms) != 0)
+		fprintf(stderr, "splash scanout error\n");
+	kms_presenter_release(&splash_kms);
 
 exit:
+#ifdef SPLASH_SCREEN_KPI_MARKER
+	kpi_marker_emit(&marker, SPLASH_MARKER_END, "splash-end");
+	kpi_marker_close(&marker);
+#endif
 #ifdef SPLASH_SCREEN_END_CMD
 	if (system(SPLASH_SCREEN_END_CMD " > /dev/null"))
 		fprintf(stderr, "\"%s\" return error\n", SPLASH_SCREEN_END_CMD);
@@ -252,7 +154,7 @@ exit:
 	if (img_fd > 0)
 		close(img_fd);
 	if (drm_fd > 0) {
-		drm_destroy_fb(&drm_fb0);
+		kms_presenter_close(&splash_kms);
 		close(drm_fd);
 	}
 	return NULL;
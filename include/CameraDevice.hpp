@@ -36,6 +36,7 @@ extern "C" {
 
 #include "pipeline-cfg.h"
 #include "icitest.h"
+#include "icitest_deinterlace.h"
 
 #ifdef __cplusplus
 }
@@ -59,9 +59,16 @@ namespace earlyapp
         static const unsigned int DEFAULT_DISPLAY_HEIGHT;
         static const int DEFAULT_GPIONUMBER;
         static const useconds_t DEFAULT_GPIOSUSTAIN;
+        static const char* DEFAULT_KPIMARKER;
         static const bool DEFAULT_USE_GSTREAMER;
 	static const bool DEFAULT_USE_CSICAM;
         static const char* DEFAULT_GSTCAMCMD;
+        static const unsigned int DEFAULT_CSI_BUFFERS;
+        static const bool DEFAULT_CSI_CPU_CONVERT;
+        static const bool DEFAULT_CSI_KMS_PREVIEW;
+        static const char* DEFAULT_DEINTERLACE;
+        static const bool DEFAULT_ICI_CPU_CONVERT;
+        static const unsigned int DEFAULT_EGL_SWAP_INTERVAL;
 
 
         /*
@@ -78,9 +85,16 @@ namespace earlyapp
         static const char* KEY_DISPLAYHEIGHT;
         static const char* KEY_GPIONUMBER;
         static const char* KEY_GPIOSUSTAIN;
+        static const char* KEY_KPIMARKER;
         static const char* KEY_USEGSTREAMER;
 	static const char* KEY_USECSICAM;
         static const char* KEY_GSTCAMCMD;
+        static const char* KEY_CSIBUFFERS;
+        static const char* KEY_CSICPUCONVERT;
+        static const char* KEY_CSIKMSPREVIEW;
+        static const char* KEY_DEINTERLACE;
+        static const char* KEY_ICICPUCONVERT;
+        static const char* KEY_EGLSWAPINTERVAL;
 
 
         /**
@@ -169,6 +183,16 @@ namespace earlyapp
          */
         unsigned int gpioSustain(void) const;
 
+        /**
+          @brief Returns where KPI markers go: gpio, kmsg, trace or shm.
+         */
+        const std::string& kpiMarker(void);
+
+        /**
+          @brief Returns true if KPI markers are emitted at all.
+         */
+        bool kpiMarkers(void);
+
         /**
            @brief Returns whether user asked to use GStreamer.
         */
@@ -185,6 +209,36 @@ namespace earlyapp
          */
         const std::string& gstCamCmd(void);
 
+        /**
+           @brief Returns number of capture buffers kept for the CSI camera.
+         */
+        unsigned int csiBufferCount(void) const;
+
+        /**
+           @brief Returns true if CSI frames are converted to RGB on the CPU.
+         */
+        bool csiCpuConvert(void) const;
+
+        /**
+           @brief Returns true if CSI frames are scanned out through KMS until the compositor is up.
+         */
+        bool csiKmsPreview(void) const;
+
+        /**
+           @brief Returns the deinterlacing mode for the CVBS camera fields.
+         */
+        const std::string& deinterlace(void);
+
+        /**
+           @brief Returns true if ICI frames are converted to RGB on the CPU.
+         */
+        bool iciCpuConvert(void) const;
+
+        /**
+           @brief Returns the EGL swap interval of the GLES test path, 0 to free-run.
+         */
+        unsigned int eglSwapInterval(void) const;
+
         /**
            @brief Disable copy assigned operators.
         */
@@ -97,6 +97,11 @@ namespace earlyapp
 
         set_up m_csiParam;
 
+        /**
+           @brief Capture buffers reused on every engagement.
+        */
+        struct csi_buffer_pool* m_pBufferPool = nullptr;
+
 	/*
           Boost thread.
          */
@@ -149,24 +149,14 @@ namespace earlyapp
         void waitForWayland(void);
 
         /**
-           @brief Maximum length of the Wayland socket path.
+          @brief Wait for the video init thread, joins it only once.
          */
-        const int WAYLAND_SOCKET_PATH_LENGTH = 255;
+        static void joinVideoInit(void);
 
         /**
-           @brief Environment variable XDG_RUNTIME_DIR.
-        */
-        const char* XDG_RUNTIME_DIR = "XDG_RUNTIME_DIR";
-
-        /**
-           @brief Environment variable WAYLAND_DISPLAY.
-        */
-        const char* WAYLAND_DISPLAY = "WAYLAND_DISPLAY";
-
-        /**
-           @brief Default wayland socket name.
-        */
-        const char* DEFAULT_WAYLAND_SOCKET = "wayland-0";
+          @brief The splash video will not be played, stop its warm decoding.
+         */
+        void cancelVideo(void);
 
 	/**
 		@brief Audio play thread
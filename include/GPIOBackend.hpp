@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <time.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "kpi_marker.h"
+
+namespace earlyapp
+{
+    /**
+       @brief Where GPIOControl drives its KPI marker line.
+     */
+    class GPIOBackend
+    {
+    public:
+        virtual ~GPIOBackend(void) { };
+
+        /**
+           @brief Drive the line.
+           @param high true for HIGH, false for LOW.
+           @return true for success, false otherwise.
+         */
+        virtual bool set(bool high) = 0;
+
+        /**
+           @brief Does a marker need a timed HIGH / LOW pulse?
+           @return false for event backends, marked by set(true) alone.
+         */
+        virtual bool pulses(void) const { return true; }
+    };
+
+    /**
+       @brief sysfs GPIO, exported once and kept open.
+     */
+    class SysfsGPIOBackend : public GPIOBackend
+    {
+    public:
+        /**
+           @brief Constructor, exports the GPIO and opens its value file.
+           @param gpioNumber GPIO number to control.
+         */
+        SysfsGPIOBackend(int gpioNumber);
+
+        /**
+           @brief Destructor.
+         */
+        virtual ~SysfsGPIOBackend(void);
+
+        /**
+           @brief Is the value file open?
+         */
+        bool isOpen(void) const { return m_ValueFd >= 0; }
+
+        virtual bool set(bool high);
+
+    private:
+        /**
+          @brief Value file, open for the lifetime of the backend.
+         */
+        int m_ValueFd = -1;
+    };
+
+    /**
+       @brief Software KPI markers instead of a GPIO line.
+     */
+    class SoftwareMarkerBackend : public GPIOBackend
+    {
+    public:
+        /**
+           @brief Constructor.
+           @param sink Where the markers go.
+           @param name Marker name, e.g. the device emitting it.
+         */
+        SoftwareMarkerBackend(enum kpi_marker_sink sink, const char* name);
+
+        /**
+           @brief Destructor.
+         */
+        virtual ~SoftwareMarkerBackend(void);
+
+        /**
+           @brief Is the sink open?
+         */
+        bool isOpen(void) const { return m_Marker.sink != KPI_MARKER_NONE; }
+
+        /**
+           @brief Emits a marker on HIGH, LOW is ignored.
+         */
+        virtual bool set(bool high);
+
+        virtual bool pulses(void) const { return false; }
+
+    private:
+        struct kpi_marker m_Marker;
+
+        /**
+          @brief Marker id, not handed out by any other process.
+         */
+        uint32_t m_Id = 0;
+
+        std::string m_Name;
+    };
+
+    /**
+       @brief Records line changes instead of driving hardware, for tests.
+     */
+    class MockGPIOBackend : public GPIOBackend
+    {
+    public:
+        /**
+           @brief One recorded line change.
+         */
+        struct Transition
+        {
+            bool high;
+            struct timespec time;
+        };
+
+        virtual bool set(bool high);
+
+        /**
+           @brief Recorded line changes so far.
+         */
+        std::vector<Transition> transitions(void);
+
+    private:
+        std::mutex m_Lock;
+        std::vector<Transition> m_Transitions;
+    };
+
+} // namespace
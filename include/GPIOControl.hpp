@@ -27,14 +27,23 @@
 #pragma once
 
 #include <unistd.h>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <boost/thread.hpp>
 
 #include "Configuration.hpp"
+#include "GPIOBackend.hpp"
 
 namespace earlyapp
 {
     /**
        @brief Controls given GPIO number with user set values.
+
+       A pulse raises the line on the calling thread and returns; a timer
+       thread lowers it once the sustain time is over, so render loops
+       never sleep on a KPI marker. With a software marker sink set, each
+       pulse becomes one timestamped marker event instead.
      */
     class GPIOControl
     {
@@ -50,13 +59,29 @@ namespace earlyapp
 
         /**
           @brief Constructor.
-          @param gpioNumber GPIO number to control.
+          @param gpioNumber GPIO number to control, unused with a marker sink.
           @param sustainTime GPIO peak sustaining time in ms.
+          @param marker Name of the software markers.
         */
         GPIOControl(
             int gpioNumber = Configuration::NOT_SET,
+            unsigned int peakSustainTime = Configuration::DEFAULT_GPIOSUSTAIN,
+            const char* marker = nullptr);
+
+        /**
+          @brief Constructor with a given backend, e.g. MockGPIOBackend.
+          @param backend Line to drive.
+          @param sustainTime GPIO peak sustaining time in ms.
+        */
+        GPIOControl(
+            std::unique_ptr<GPIOBackend> backend,
             unsigned int peakSustainTime = Configuration::DEFAULT_GPIOSUSTAIN);
 
+        /**
+          @brief Destructor, leaves the line LOW.
+        */
+        ~GPIOControl(void);
+
         /**
            @brief Ouput GPIO with given value.
            @param hightLow Set the GPIO with HIGH or LOW.
@@ -64,33 +89,25 @@ namespace earlyapp
          */
         bool output(eGPIOValue highLow);
 
-        /**
-           @brief Sustain current GPIO output for given time.
-         */
-        void sustain(void);
-
         /**
            @brief Output GPIO patther - One pulse for user set time.
+
+           Requests arriving while a pulse or the LOW gap after it is
+           still running are dropped, so every edge stays visible.
          */
         void outputPattern(void);
 
         /**
-          @brief GPIO export path.
-          @return Corresponding GPIO export path.
+           @brief Number of pulses dropped so far.
          */
-        std::shared_ptr<std::string> exportPath(void) const;
-
-        /*
-          @brief GPIO direction path.
-          @return Corresponding GPIO direction path.
-        */
-        std::shared_ptr<std::string> directionPath(void) const;
+        unsigned int droppedPulses(void) const { return m_DroppedPulses; }
 
         /**
-          @brief GPIO value path.
-          @return Corresponding PIO value path.
+           @brief Select software KPI markers for the controls created later.
+           @param sink "gpio" for the GPIO line, "kmsg", "trace" or "shm".
+           @return false for an unknown sink.
          */
-        std::shared_ptr<std::string> valuePath(void) const;
+        static bool setMarkerSink(const std::string& sink);
 
     private:
         /**
@@ -99,14 +116,52 @@ namespace earlyapp
         bool m_Valid = false;
 
         /**
-           @brief GPIO number to control.
+          @brief GPIO sustaining time in us.
          */
-        int m_GPIONumber = -1;
+        unsigned int m_SustainTime = 0;
 
         /**
-          @brief GPIO sustaining time in ms.
+          @brief Line being driven.
          */
-        unsigned int m_SustainTime = 0;
+        std::unique_ptr<GPIOBackend> m_pBackend;
+
+        /**
+          @brief Fires at the end of a pulse.
+         */
+        int m_TimerFd = -1;
+
+        /**
+          @brief Wakes the pulse thread up for shutdown.
+         */
+        int m_StopFd = -1;
+
+        /**
+          @brief Lowers the line when m_TimerFd fires.
+         */
+        boost::thread* m_pPulseThread = nullptr;
+
+        /**
+          @brief Guards the pulse state below.
+         */
+        std::mutex m_PulseLock;
+        bool m_High = false;
+        struct timespec m_NextPulse = { 0, 0 };
+        unsigned int m_DroppedPulses = 0;
+
+        /**
+          @brief Software marker sink, KPI_MARKER_NONE for GPIO.
+         */
+        static enum kpi_marker_sink s_MarkerSink;
+
+        /**
+          @brief Start the pulse thread.
+         */
+        void startPulseThread(void);
+
+        /**
+          @brief Pulse thread function.
+         */
+        void pulseThread(void);
 
         /**
           @brief Hidden default constructor.
@@ -118,10 +173,12 @@ namespace earlyapp
        @brief GPIOControl C interfaces - Create.
        @param gpioNumber GPIO number to be controlled.
        @param peakSustainTime Time in ms GPIO staying at HIGH status.
+       @param marker Name of the software markers.
      */
     extern "C" void* GPIOControl_create(
         int gpioNumber,
-        unsigned int peakSustainTime = Configuration::DEFAULT_GPIOSUSTAIN);
+        unsigned int peakSustainTime = Configuration::DEFAULT_GPIOSUSTAIN,
+        const char* marker = nullptr);
 
     /**
        @brief GPIOControl C interfaces - Release resource.
@@ -76,6 +76,12 @@ namespace earlyapp
          */
         virtual void preparePlay(std::shared_ptr<DeviceParameter> playParam=nullptr);
 
+        /**
+          @brief Called instead of play() when the device will not be played,
+          e.g. reverse gear at boot. Drops work started ahead of play().
+         */
+        virtual void cancelPlay(void);
+
         /**
           @brief Play the device.
          */
@@ -29,6 +29,7 @@
 #include "OutputDevice.hpp"
 #include "Configuration.hpp"
 #include "pipeline_decode.h"
+#include <boost/thread.hpp>
 
 namespace earlyapp
 {
@@ -54,6 +55,11 @@ namespace earlyapp
         */
         void play(void);
 
+        /**
+           @brief Aborts the decoder started in init() without showing anything.
+        */
+        void cancelPlay(void);
+
         /**
            @brief Stop playback.
         */
@@ -85,6 +91,21 @@ namespace earlyapp
            Decoding input parameters.
          */
         sInputParams m_Params;
+
+        /**
+           Decoding thread started in init() so frames are ready before the compositor.
+         */
+        boost::thread* m_pDecodeThread = nullptr;
+
+        /**
+           Binds the Wayland window to the already running decoder.
+         */
+        void attachDisplay(void);
+
+        /**
+           Joins the decoding thread, aborting it first if requested.
+         */
+        void joinDecoding(bool bAbort);
     };
 } // namespace
 
@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+namespace earlyapp
+{
+    /**
+       @brief Tells every component when the Wayland compositor accepts clients.
+
+       The first waiter watches $XDG_RUNTIME_DIR with inotify, or its
+       nearest existing ancestor until it is created, and probes the
+       socket with a connect() on each change; the others sleep on a
+       condition variable and are all released when the probe succeeds.
+       Nothing spins while the compositor starts up.
+
+       Loops that cannot block in wait() add pollFd() to their poll set
+       and call isReady() when it fires; isReady() only probes after a
+       change was seen.
+     */
+    class WaylandReady
+    {
+    public:
+        /**
+           @brief Returns the process wide instance.
+         */
+        static WaylandReady& getInstance(void);
+
+        /**
+           @brief Block until a client can connect to the compositor.
+           Returns at once if XDG_RUNTIME_DIR is not set.
+         */
+        void wait(void);
+
+        /**
+           @brief Non-blocking check, probes the socket if nobody saw it yet.
+           With pollFd() set up, only after its inotify watch fired, or
+           again while the socket exists but does not accept yet.
+           @return true once the compositor accepts clients.
+         */
+        bool isReady(void);
+
+        /**
+           @brief Inotify descriptor that turns readable on changes to the
+           socket directory, set up on the first call.
+           @return Descriptor, negative without inotify or XDG_RUNTIME_DIR.
+         */
+        int pollFd(void);
+
+        /**
+           @brief Compositor socket path, empty without XDG_RUNTIME_DIR.
+         */
+        const std::string& socketPath(void) const { return m_SocketPath; }
+
+    private:
+        WaylandReady(void);
+
+        /**
+           @brief Connect to the socket and hang up.
+           @return true if the compositor is listening.
+         */
+        bool probe(void) const;
+
+        /**
+           @brief Watch the socket directory, or its nearest existing
+           ancestor until the directory is created.
+           @param watched Set to the directory actually watched.
+           @return Watch descriptor, negative on error.
+         */
+        int addWatch(int fd, std::string& watched) const;
+
+        /**
+           @brief Move the watch a level down while the socket directory
+           does not exist yet.
+         */
+        void followWatch(int fd, int& wd, std::string& watched) const;
+
+        /**
+           @brief Block on inotify until probe() succeeds, then setReady().
+         */
+        void watch(void);
+
+        /**
+           @brief Mark ready and release the waiters.
+         */
+        void setReady(void);
+
+        std::string m_SocketPath;
+        std::mutex m_Lock;
+        std::condition_variable m_Cond;
+        bool m_Ready = false;
+        bool m_Watching = false;
+
+        /**
+           @brief pollFd() watch and whether isReady() has to probe.
+         */
+        int m_PollFd = -1;
+        int m_PollWd = -1;
+        std::string m_PollWatched;
+        bool m_PollProbe = true;
+    };
+
+    /**
+       @brief WaylandReady C interfaces - Block until the compositor is up.
+     */
+    extern "C" void WaylandReady_wait(void);
+
+    /**
+       @brief WaylandReady C interfaces - Non-blocking check.
+       @return 1 once the compositor accepts clients, 0 otherwise.
+     */
+    extern "C" int WaylandReady_isReady(void);
+
+    /**
+       @brief WaylandReady C interfaces - Descriptor for poll loops.
+       @return Readable when WaylandReady_isReady() is worth calling,
+       negative if it has to be called on every iteration.
+     */
+    extern "C" int WaylandReady_pollFd(void);
+
+} // namespace
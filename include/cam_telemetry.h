@@ -0,0 +1,233 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/*
+ * Per-frame camera telemetry kept in a shared memory ring.
+ *
+ * The capture thread is the only writer of a ring. It fills one record
+ * per dequeued buffer with no locks and no stdio. The render thread only
+ * stamps render_ns of the frame it drew. earlyapp-camstat or any other
+ * process maps the file read-only and checks each record's seq before
+ * and after copying it, so a record overwritten mid-read is skipped.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define CAM_TELEMETRY_PATH_FMT	"/dev/shm/earlyapp-camera-%s"
+#define CAM_TELEMETRY_MAGIC	0x4d544345u	/* "ECTM" */
+#define CAM_TELEMETRY_VERSION	1
+#define CAM_TELEMETRY_SLOTS	512		/* power of two */
+
+/* cam_frame_record.flags */
+#define CAM_FRAME_BOTTOM	(1u << 0)	/* bottom field */
+#define CAM_FRAME_LONE_FIELD	(1u << 1)	/* field shown without its partner */
+#define CAM_FRAME_NO_TIMESTAMP	(1u << 2)	/* driver gave none, dequeue time used */
+#define CAM_FRAME_RECOVERED	(1u << 3)	/* first frame after a stream restart */
+
+struct cam_frame_record {
+	uint64_t seq;		/* 2n+1 while frame n is written, 2n+2 once done */
+	uint32_t flags;
+	uint32_t buffer;	/* driver buffer index */
+	uint64_t capture_ns;	/* driver timestamp, CLOCK_MONOTONIC */
+	uint64_t dequeue_ns;	/* when the capture thread got the buffer */
+	uint64_t render_ns;	/* when it was first drawn, 0 until then */
+};
+
+struct cam_telemetry {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	int32_t pid;		/* writer */
+	char source[16];
+	uint64_t head;		/* frames recorded so far */
+	struct cam_frame_record rec[CAM_TELEMETRY_SLOTS];
+};
+
+static inline uint64_t cam_telemetry_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t cam_telemetry_tv_ns(const struct timeval *tv)
+{
+	return (uint64_t) tv->tv_sec * 1000000000ull + (uint64_t) tv->tv_usec * 1000ull;
+}
+
+/* Creates (or takes over) the ring of a source, NULL if shm is unusable */
+static inline struct cam_telemetry *cam_telemetry_create(const char *source)
+{
+	struct cam_telemetry *t;
+	char path[64];
+	int fd;
+
+	snprintf(path, sizeof(path), CAM_TELEMETRY_PATH_FMT, source);
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, sizeof(*t)) < 0) {
+		close(fd);
+		return NULL;
+	}
+	t = mmap(NULL, sizeof(*t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (t == MAP_FAILED)
+		return NULL;
+
+	/* readers ignore the ring until the magic is back */
+	__atomic_store_n(&t->magic, 0, __ATOMIC_RELEASE);
+	memset(t->rec, 0, sizeof(t->rec));
+	t->version = CAM_TELEMETRY_VERSION;
+	t->slots = CAM_TELEMETRY_SLOTS;
+	t->pid = getpid();
+	strncpy(t->source, source, sizeof(t->source) - 1);
+	__atomic_store_n(&t->head, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&t->magic, CAM_TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+	return t;
+}
+
+/* Read-only mapping for readers, NULL if missing or not a ring */
+static inline const struct cam_telemetry *cam_telemetry_attach(const char *source)
+{
+	const struct cam_telemetry *t;
+	char path[64];
+	struct stat st;
+	int fd;
+
+	snprintf(path, sizeof(path), CAM_TELEMETRY_PATH_FMT, source);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*t)) {
+		close(fd);
+		return NULL;
+	}
+	t = mmap(NULL, sizeof(*t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (t == MAP_FAILED)
+		return NULL;
+	if (t->version != CAM_TELEMETRY_VERSION || t->slots != CAM_TELEMETRY_SLOTS) {
+		munmap((void *) t, sizeof(*t));
+		return NULL;
+	}
+	return t;
+}
+
+static inline void cam_telemetry_detach(const struct cam_telemetry *t)
+{
+	if (t)
+		munmap((void *) t, sizeof(*t));
+}
+
+/* Capture thread only. Returns the frame number for cam_telemetry_render. */
+static inline uint64_t cam_telemetry_capture(struct cam_telemetry *t,
+		uint64_t capture_ns, uint32_t buffer, uint32_t flags)
+{
+	uint64_t n, now = cam_telemetry_now();
+	struct cam_frame_record *rec;
+
+	if (!t)
+		return 0;
+
+	n = __atomic_load_n(&t->head, __ATOMIC_RELAXED);
+	rec = &t->rec[n & (CAM_TELEMETRY_SLOTS - 1)];
+	if (!capture_ns) {
+		capture_ns = now;
+		flags |= CAM_FRAME_NO_TIMESTAMP;
+	}
+
+	__atomic_store_n(&rec->seq, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&rec->flags, flags, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->buffer, buffer, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->capture_ns, capture_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->dequeue_ns, now, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->render_ns, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->seq, 2 * n + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&t->head, n + 1, __ATOMIC_RELEASE);
+	return n;
+}
+
+/* Capture thread only, for flags known after the record was written */
+static inline void cam_telemetry_flag(struct cam_telemetry *t, uint64_t frame,
+		uint32_t flags)
+{
+	struct cam_frame_record *rec;
+
+	if (!t)
+		return;
+	rec = &t->rec[frame & (CAM_TELEMETRY_SLOTS - 1)];
+	if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == 2 * frame + 2)
+		__atomic_fetch_or(&rec->flags, flags, __ATOMIC_RELAXED);
+}
+
+/* Render thread, stamps the first time frame reached the screen */
+static inline void cam_telemetry_render(struct cam_telemetry *t, uint64_t frame)
+{
+	struct cam_frame_record *rec;
+	uint64_t unset = 0;
+
+	if (!t)
+		return;
+	rec = &t->rec[frame & (CAM_TELEMETRY_SLOTS - 1)];
+	if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == 2 * frame + 2)
+		__atomic_compare_exchange_n(&rec->render_ns, &unset,
+				cam_telemetry_now(), 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/* Copies record n, 0 on success, -1 if it was overwritten or unfinished */
+static inline int cam_telemetry_read(const struct cam_telemetry *t, uint64_t n,
+		struct cam_frame_record *out)
+{
+	const struct cam_frame_record *rec = &t->rec[n & (CAM_TELEMETRY_SLOTS - 1)];
+	uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+
+	if (seq != 2 * n + 2)
+		return -1;
+	out->flags = __atomic_load_n(&rec->flags, __ATOMIC_RELAXED);
+	out->buffer = __atomic_load_n(&rec->buffer, __ATOMIC_RELAXED);
+	out->capture_ns = __atomic_load_n(&rec->capture_ns, __ATOMIC_RELAXED);
+	out->dequeue_ns = __atomic_load_n(&rec->dequeue_ns, __ATOMIC_RELAXED);
+	out->render_ns = __atomic_load_n(&rec->render_ns, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq)
+		return -1;
+	out->seq = seq;
+	return 0;
+}
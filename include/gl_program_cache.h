@@ -0,0 +1,242 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/*
+ * Linked GLES programs kept on disk through GL_OES_get_program_binary,
+ * shared by the CSI, ICI and EGL test renderers.
+ *
+ * Each program has one file under GL_PROGRAM_CACHE_DIR named after it,
+ * keyed by a hash of its shader sources, attribute bindings and the GL
+ * vendor, renderer and version strings. An edited shader or a driver
+ * update misses the cache instead of feeding the driver a stale binary,
+ * and a binary the driver still rejects falls back to compiling. Files
+ * are written under a temporary name and renamed into place.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#ifndef GL_PROGRAM_CACHE_DIR
+#define GL_PROGRAM_CACHE_DIR "/var/cache/earlyapp"
+#endif
+
+#define GL_PROGRAM_CACHE_MAGIC	0x50434c47u	/* "GLCP" */
+#define GL_PROGRAM_CACHE_MAX	(4u << 20)
+
+struct gl_program_cache_header {
+	uint32_t magic;
+	uint32_t format;	/* binary format reported by the driver */
+	uint64_t key;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+/* FNV-1a, the terminator is hashed too to keep the strings apart */
+static inline uint64_t gl_program_cache_hash(uint64_t h, const char *s)
+{
+	if (!s)
+		s = "";
+	do {
+		h ^= (unsigned char) *s;
+		h *= 0x100000001b3ull;
+	} while (*s++);
+	return h;
+}
+
+static inline uint64_t gl_program_cache_key(const char *vert, const char *frag,
+		const char *const *attribs)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+
+	h = gl_program_cache_hash(h, (const char *) glGetString(GL_VENDOR));
+	h = gl_program_cache_hash(h, (const char *) glGetString(GL_RENDERER));
+	h = gl_program_cache_hash(h, (const char *) glGetString(GL_VERSION));
+	h = gl_program_cache_hash(h, vert);
+	h = gl_program_cache_hash(h, frag);
+	while (attribs && *attribs)
+		h = gl_program_cache_hash(h, *attribs++);
+	return h;
+}
+
+static inline GLuint gl_program_compile(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	GLint status;
+
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		char log[1000];
+		GLsizei len;
+
+		glGetShaderInfoLog(shader, sizeof(log), &len, log);
+		fprintf(stderr, "Error: compiling %s: %.*s\n",
+				type == GL_VERTEX_SHADER ? "vertex" : "fragment", len, log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+static inline int gl_program_linked(GLuint program)
+{
+	GLint status = 0;
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status;
+}
+
+static inline int gl_program_cache_load(GLuint program, const char *path, uint64_t key,
+		PFNGLPROGRAMBINARYOESPROC load)
+{
+	struct gl_program_cache_header h;
+	void *binary = NULL;
+	FILE *f = fopen(path, "rb");
+	int ok = 0;
+
+	if (!f)
+		return 0;
+	if (fread(&h, sizeof(h), 1, f) == 1 && h.magic == GL_PROGRAM_CACHE_MAGIC &&
+			h.key == key && h.size && h.size <= GL_PROGRAM_CACHE_MAX &&
+			(binary = malloc(h.size)) && fread(binary, h.size, 1, f) == 1) {
+		glGetError();
+		load(program, h.format, binary, h.size);
+		ok = glGetError() == GL_NO_ERROR && gl_program_linked(program);
+	}
+	free(binary);
+	fclose(f);
+	return ok;
+}
+
+static inline void gl_program_cache_store(GLuint program, const char *path, uint64_t key,
+		PFNGLGETPROGRAMBINARYOESPROC get)
+{
+	struct gl_program_cache_header h = { GL_PROGRAM_CACHE_MAGIC, 0, key, 0, 0 };
+	char tmp[256];
+	GLint size = 0;
+	void *binary;
+	FILE *f;
+	int ok;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &size);
+	if (size <= 0 || (unsigned) size > GL_PROGRAM_CACHE_MAX || !(binary = malloc(size)))
+		return;
+	get(program, size, NULL, &h.format, binary);
+	h.size = size;
+
+	mkdir(GL_PROGRAM_CACHE_DIR, 0755);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+	f = fopen(tmp, "wb");
+	if (!f) {
+		free(binary);
+		return;
+	}
+	ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(binary, size, 1, f) == 1;
+	ok = !fclose(f) && ok;
+	if (!ok || rename(tmp, path))
+		unlink(tmp);
+	free(binary);
+}
+
+/*
+ * Returns a linked program made of the two shaders, 0 if they fail to
+ * compile or link. attribs, NULL terminated or NULL, are bound to
+ * locations 0, 1, ... before linking.
+ */
+static inline GLuint gl_program_cached(const char *name, const char *vert, const char *frag,
+		const char *const *attribs)
+{
+	PFNGLPROGRAMBINARYOESPROC load = NULL;
+	PFNGLGETPROGRAMBINARYOESPROC get = NULL;
+	const char *ext = (const char *) glGetString(GL_EXTENSIONS);
+	GLint formats = 0;
+	GLuint program, vs, fs;
+	uint64_t key = 0;
+	char path[224];
+	GLuint i;
+
+	if (ext && strstr(ext, "GL_OES_get_program_binary")) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+		if (formats > 0) {
+			load = (PFNGLPROGRAMBINARYOESPROC) eglGetProcAddress("glProgramBinaryOES");
+			get = (PFNGLGETPROGRAMBINARYOESPROC) eglGetProcAddress("glGetProgramBinaryOES");
+		}
+	}
+
+	program = glCreateProgram();
+	if (load && get) {
+		key = gl_program_cache_key(vert, frag, attribs);
+		snprintf(path, sizeof(path), GL_PROGRAM_CACHE_DIR "/%s.bin", name);
+		if (gl_program_cache_load(program, path, key, load))
+			return program;
+		/* a rejected binary may leave the program unusable */
+		glDeleteProgram(program);
+		program = glCreateProgram();
+	}
+
+	vs = gl_program_compile(GL_VERTEX_SHADER, vert);
+	fs = gl_program_compile(GL_FRAGMENT_SHADER, frag);
+	if (!vs || !fs)
+		goto err;
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	for (i = 0; attribs && attribs[i]; i++)
+		glBindAttribLocation(program, i, attribs[i]);
+	glLinkProgram(program);
+	if (!gl_program_linked(program)) {
+		char log[1000];
+		GLsizei len;
+
+		glGetProgramInfoLog(program, sizeof(log), &len, log);
+		fprintf(stderr, "Error: linking:\n%.*s\n", len, log);
+		goto err;
+	}
+	/* flagged for deletion, they go with the program */
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	if (load && get)
+		gl_program_cache_store(program, path, key, get);
+	return program;
+
+err:
+	if (vs)
+		glDeleteShader(vs);
+	if (fs)
+		glDeleteShader(fs);
+	glDeleteProgram(program);
+	return 0;
+}
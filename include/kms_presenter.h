@@ -0,0 +1,477 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/*
+ * Minimal KMS presenter for the time before the compositor runs.
+ *
+ * Two dumb buffers are scanned out from the primary plane of the first
+ * connected output, with atomic commits when the driver has them and
+ * SetCrtc/PageFlip otherwise. DRM master is taken once by
+ * kms_presenter_acquire() and held until kms_presenter_release(), so no
+ * compositor can start in the middle of a commit and fail to become
+ * master; the caller releases it when the compositor asks for the device.
+ * The last frame stays on screen after the release until
+ * kms_presenter_close(), which should wait for kms_presenter_replaced()
+ * so the handover has no black gap. The caller owns the fd and writes
+ * XRGB8888 pixels into kms_presenter_back() before each present.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define KMS_HANDED_OVER		1
+#define KMS_FLIP_TIMEOUT_MS	100
+#define KMS_REPLACED_POLL_US	1000
+
+struct kms_buffer {
+	uint32_t handle;
+	uint32_t fb_id;
+	uint32_t pitch;
+	uint64_t size;
+	uint8_t *map;
+};
+
+struct kms_presenter {
+	int fd;
+	uint32_t conn_id;
+	uint32_t crtc_id;
+	uint32_t plane_id;	/* 0 without atomic */
+	uint32_t mode_blob;
+	drmModeModeInfo mode;
+	uint32_t width, height;
+	struct {
+		uint32_t conn_crtc_id;
+		uint32_t crtc_active, crtc_mode_id;
+		uint32_t fb_id, crtc_id;
+		uint32_t src_x, src_y, src_w, src_h;
+		uint32_t crtc_x, crtc_y, crtc_w, crtc_h;
+	} prop;
+	struct kms_buffer buf[2];
+	unsigned int front;
+	int modeset_done;
+	int flip_pending;
+	int master;
+};
+
+static inline uint32_t kms_prop_id(int fd, uint32_t obj, uint32_t type, const char *name)
+{
+	drmModeObjectProperties *props = drmModeObjectGetProperties(fd, obj, type);
+	uint32_t id = 0;
+	uint32_t i;
+
+	for (i = 0; props && i < props->count_props && !id; i++) {
+		drmModePropertyRes *p = drmModeGetProperty(fd, props->props[i]);
+
+		if (p && !strcmp(p->name, name))
+			id = p->prop_id;
+		drmModeFreeProperty(p);
+	}
+	drmModeFreeObjectProperties(props);
+	return id;
+}
+
+static inline uint64_t kms_prop_value(int fd, uint32_t obj, uint32_t type, const char *name)
+{
+	drmModeObjectProperties *props = drmModeObjectGetProperties(fd, obj, type);
+	uint64_t value = 0;
+	uint32_t i;
+
+	for (i = 0; props && i < props->count_props; i++) {
+		drmModePropertyRes *p = drmModeGetProperty(fd, props->props[i]);
+		int match = p && !strcmp(p->name, name);
+
+		drmModeFreeProperty(p);
+		if (match) {
+			value = props->prop_values[i];
+			break;
+		}
+	}
+	drmModeFreeObjectProperties(props);
+	return value;
+}
+
+/* Connected output, its current (or first usable) CRTC and preferred mode */
+static inline int kms_pick_output(struct kms_presenter *k, drmModeRes *res, int *crtc_index)
+{
+	drmModeConnector *conn = NULL;
+	drmModeEncoder *enc;
+	int i, j, m;
+
+	for (i = 0; i < res->count_connectors; i++) {
+		conn = drmModeGetConnector(k->fd, res->connectors[i]);
+		if (conn && conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0)
+			break;
+		drmModeFreeConnector(conn);
+		conn = NULL;
+	}
+	if (!conn) {
+		fprintf(stderr, "kms: no connected output\n");
+		return -1;
+	}
+
+	k->conn_id = conn->connector_id;
+	k->mode = conn->modes[0];
+	for (m = 0; m < conn->count_modes; m++) {
+		if (conn->modes[m].type & DRM_MODE_TYPE_PREFERRED) {
+			k->mode = conn->modes[m];
+			break;
+		}
+	}
+	k->width = k->mode.hdisplay;
+	k->height = k->mode.vdisplay;
+
+	/* keep what firmware or an earlier splash already lit up */
+	enc = conn->encoder_id ? drmModeGetEncoder(k->fd, conn->encoder_id) : NULL;
+	if (enc && enc->crtc_id)
+		k->crtc_id = enc->crtc_id;
+	drmModeFreeEncoder(enc);
+
+	for (i = 0; i < conn->count_encoders && !k->crtc_id; i++) {
+		enc = drmModeGetEncoder(k->fd, conn->encoders[i]);
+		if (!enc)
+			continue;
+		for (j = 0; j < res->count_crtcs; j++) {
+			if (enc->possible_crtcs & (1u << j)) {
+				k->crtc_id = res->crtcs[j];
+				break;
+			}
+		}
+		drmModeFreeEncoder(enc);
+	}
+	drmModeFreeConnector(conn);
+
+	for (j = 0; j < res->count_crtcs; j++) {
+		if (res->crtcs[j] == k->crtc_id)
+			*crtc_index = j;
+	}
+	if (!k->crtc_id) {
+		fprintf(stderr, "kms: no CRTC for connector %u\n", k->conn_id);
+		return -1;
+	}
+	return 0;
+}
+
+static inline uint32_t kms_pick_primary_plane(struct kms_presenter *k, int crtc_index)
+{
+	drmModePlaneRes *planes = drmModeGetPlaneResources(k->fd);
+	uint32_t id = 0;
+	uint32_t i;
+
+	for (i = 0; planes && i < planes->count_planes && !id; i++) {
+		drmModePlane *p = drmModeGetPlane(k->fd, planes->planes[i]);
+
+		if (p && (p->possible_crtcs & (1u << crtc_index)) &&
+		    kms_prop_value(k->fd, p->plane_id, DRM_MODE_OBJECT_PLANE, "type") ==
+				DRM_PLANE_TYPE_PRIMARY)
+			id = p->plane_id;
+		drmModeFreePlane(p);
+	}
+	drmModeFreePlaneResources(planes);
+	return id;
+}
+
+static inline void kms_buffer_destroy(int fd, struct kms_buffer *b)
+{
+	struct drm_mode_destroy_dumb dreq;
+
+	if (b->map && b->map != MAP_FAILED)
+		munmap(b->map, b->size);
+	if (b->fb_id)
+		drmModeRmFB(fd, b->fb_id);
+	if (b->handle) {
+		memset(&dreq, 0, sizeof(dreq));
+		dreq.handle = b->handle;
+		drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	}
+	memset(b, 0, sizeof(*b));
+}
+
+static inline int kms_buffer_create(int fd, uint32_t width, uint32_t height, struct kms_buffer *b)
+{
+	struct drm_mode_create_dumb creq;
+	struct drm_mode_map_dumb mreq;
+
+	memset(&creq, 0, sizeof(creq));
+	creq.width = width;
+	creq.height = height;
+	creq.bpp = 32;
+	if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+		fprintf(stderr, "kms: cannot create dumb buffer: %m\n");
+		return -1;
+	}
+	b->handle = creq.handle;
+	b->pitch = creq.pitch;
+	b->size = creq.size;
+
+	if (drmModeAddFB(fd, width, height, 24, 32, b->pitch, b->handle, &b->fb_id)) {
+		fprintf(stderr, "kms: cannot create framebuffer: %m\n");
+		goto err;
+	}
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.handle = b->handle;
+	if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
+		fprintf(stderr, "kms: cannot map dumb buffer: %m\n");
+		goto err;
+	}
+	b->map = mmap(0, b->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mreq.offset);
+	if (b->map == MAP_FAILED) {
+		fprintf(stderr, "kms: framebuffer mmap error: %m\n");
+		goto err;
+	}
+	return 0;
+
+err:
+	kms_buffer_destroy(fd, b);
+	return -1;
+}
+
+static inline void kms_presenter_close(struct kms_presenter *k);
+
+static inline int kms_presenter_open(struct kms_presenter *k, int fd)
+{
+	drmModeRes *res;
+	uint64_t has_dumb;
+	int crtc_index = -1;
+	int ret;
+
+	memset(k, 0, sizeof(*k));
+	k->fd = fd;
+
+	if (drmGetCap(fd, DRM_CAP_DUMB_BUFFER, &has_dumb) < 0 || has_dumb == 0) {
+		fprintf(stderr, "kms: DRM_CAP_DUMB_BUFFER not supported\n");
+		return -1;
+	}
+
+	res = drmModeGetResources(fd);
+	if (!res) {
+		fprintf(stderr, "kms: cannot get DRM resources\n");
+		return -1;
+	}
+	ret = kms_pick_output(k, res, &crtc_index);
+	drmModeFreeResources(res);
+	if (ret < 0)
+		return -1;
+
+	if (!drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) &&
+	    !drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1))
+		k->plane_id = kms_pick_primary_plane(k, crtc_index);
+
+	if (k->plane_id) {
+		k->prop.conn_crtc_id = kms_prop_id(fd, k->conn_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+		k->prop.crtc_active = kms_prop_id(fd, k->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+		k->prop.crtc_mode_id = kms_prop_id(fd, k->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+		k->prop.fb_id = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+		k->prop.crtc_id = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+		k->prop.src_x = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X");
+		k->prop.src_y = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+		k->prop.src_w = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W");
+		k->prop.src_h = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H");
+		k->prop.crtc_x = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+		k->prop.crtc_y = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+		k->prop.crtc_w = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+		k->prop.crtc_h = kms_prop_id(fd, k->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+		if (drmModeCreatePropertyBlob(fd, &k->mode, sizeof(k->mode), &k->mode_blob)) {
+			fprintf(stderr, "kms: cannot create mode blob, using legacy modeset\n");
+			k->plane_id = 0;
+		}
+	}
+
+	if (kms_buffer_create(fd, k->width, k->height, &k->buf[0]) < 0 ||
+	    kms_buffer_create(fd, k->width, k->height, &k->buf[1]) < 0) {
+		kms_presenter_close(k);
+		return -1;
+	}
+	return 0;
+}
+
+static inline struct kms_buffer *kms_presenter_back(struct kms_presenter *k)
+{
+	return &k->buf[k->front ^ 1];
+}
+
+static inline void kms_page_flip_handler(int fd, unsigned int seq, unsigned int sec,
+		unsigned int usec, void *data)
+{
+	((struct kms_presenter *) data)->flip_pending = 0;
+}
+
+/* Waits for the last flip so its old front buffer can be drawn into again */
+static inline int kms_presenter_wait(struct kms_presenter *k, int timeout_ms)
+{
+	drmEventContext ev = {
+		.version = 2,
+		.page_flip_handler = kms_page_flip_handler,
+	};
+	struct pollfd pfd = { .fd = k->fd, .events = POLLIN };
+
+	while (k->flip_pending) {
+		int ret = poll(&pfd, 1, timeout_ms);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			/* lost to a compositor modeset, the buffer is ours again */
+			k->flip_pending = 0;
+			return -1;
+		}
+		drmHandleEvent(k->fd, &ev);
+	}
+	return 0;
+}
+
+static inline int kms_presenter_commit(struct kms_presenter *k, struct kms_buffer *b)
+{
+	drmModeAtomicReq *req;
+	uint32_t flags;
+	int ret;
+
+	if (!k->plane_id) {
+		if (!k->modeset_done)
+			return drmModeSetCrtc(k->fd, k->crtc_id, b->fb_id, 0, 0,
+					&k->conn_id, 1, &k->mode);
+		return drmModePageFlip(k->fd, k->crtc_id, b->fb_id,
+				DRM_MODE_PAGE_FLIP_EVENT, k);
+	}
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -1;
+	if (!k->modeset_done) {
+		drmModeAtomicAddProperty(req, k->conn_id, k->prop.conn_crtc_id, k->crtc_id);
+		drmModeAtomicAddProperty(req, k->crtc_id, k->prop.crtc_mode_id, k->mode_blob);
+		drmModeAtomicAddProperty(req, k->crtc_id, k->prop.crtc_active, 1);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.crtc_id, k->crtc_id);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.src_x, 0);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.src_y, 0);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.src_w, (uint64_t)k->width << 16);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.src_h, (uint64_t)k->height << 16);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.crtc_x, 0);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.crtc_y, 0);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.crtc_w, k->width);
+		drmModeAtomicAddProperty(req, k->plane_id, k->prop.crtc_h, k->height);
+		flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
+	} else {
+		flags = DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
+	}
+	drmModeAtomicAddProperty(req, k->plane_id, k->prop.fb_id, b->fb_id);
+	ret = drmModeAtomicCommit(k->fd, req, flags, k);
+	drmModeAtomicFree(req);
+	return ret;
+}
+
+/*
+ * Takes DRM master for as long as frames are presented. Returns
+ * KMS_HANDED_OVER when someone else, normally the compositor, holds it.
+ */
+static inline int kms_presenter_acquire(struct kms_presenter *k)
+{
+	if (drmSetMaster(k->fd))
+		return KMS_HANDED_OVER;
+	k->master = 1;
+	return 0;
+}
+
+/* Drops master once the last flip has landed, the frame stays on screen */
+static inline void kms_presenter_release(struct kms_presenter *k)
+{
+	kms_presenter_wait(k, KMS_FLIP_TIMEOUT_MS);
+	if (k->master)
+		drmDropMaster(k->fd);
+	k->master = 0;
+}
+
+/*
+ * Scans out the back buffer, master must be held. The first call sets
+ * the mode and blocks, later ones queue a flip for the next vblank.
+ * Returns KMS_HANDED_OVER if master was taken away.
+ */
+static inline int kms_presenter_present(struct kms_presenter *k)
+{
+	struct kms_buffer *b = kms_presenter_back(k);
+
+	kms_presenter_wait(k, KMS_FLIP_TIMEOUT_MS);
+	if (kms_presenter_commit(k, b)) {
+		if (errno == EACCES || errno == EPERM)
+			return KMS_HANDED_OVER;
+		fprintf(stderr, "kms: commit failed: %m\n");
+		return -1;
+	}
+
+	k->flip_pending = k->modeset_done;
+	k->modeset_done = 1;
+	k->front ^= 1;
+	return 0;
+}
+
+/*
+ * Waits up to timeout_ms for another master to put a framebuffer of its
+ * own on the CRTC. Returns 0 once it has, -1 on timeout.
+ */
+static inline int kms_presenter_replaced(struct kms_presenter *k, int timeout_ms)
+{
+	struct timespec start, now;
+	drmModeCrtc *crtc;
+	uint32_t fb_id;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		crtc = drmModeGetCrtc(k->fd, k->crtc_id);
+		if (!crtc)
+			return -1;
+		fb_id = crtc->buffer_id;
+		drmModeFreeCrtc(crtc);
+		if (fb_id != k->buf[0].fb_id && fb_id != k->buf[1].fb_id)
+			return 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec - start.tv_sec) * 1000 +
+				(now.tv_nsec - start.tv_nsec) / 1000000 >= timeout_ms)
+			return -1;
+		usleep(KMS_REPLACED_POLL_US);
+	}
+}
+
+/* Leaves the fd to the caller. Whatever is still on screen goes dark. */
+static inline void kms_presenter_close(struct kms_presenter *k)
+{
+	kms_presenter_release(k);
+	kms_buffer_destroy(k->fd, &k->buf[0]);
+	kms_buffer_destroy(k->fd, &k->buf[1]);
+	if (k->mode_blob)
+		drmModeDestroyPropertyBlob(k->fd, k->mode_blob);
+	k->mode_blob = 0;
+}
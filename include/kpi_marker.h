@@ -0,0 +1,291 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/*
+ * Software KPI markers, the headless counterpart of a GPIO pulse.
+ *
+ * Each marker is one event (id, name, CLOCK_MONOTONIC and CLOCK_BOOTTIME
+ * time, thread) written with a single syscall to /dev/kmsg or the ftrace
+ * trace_marker, or stored in a shared memory ring that fastboot and
+ * earlyapp append to and earlyapp-camstat -k prints. The thread id is
+ * looked up once per thread, so after a thread's first marker the ring
+ * takes no syscall at all.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define KPI_MARKER_SHM_PATH	"/dev/shm/earlyapp-kpi"
+#define KPI_MARKER_MAGIC	0x4d49504bu	/* "KPIM" */
+#define KPI_MARKER_VERSION	1
+#define KPI_MARKER_SLOTS	256		/* power of two */
+#define KPI_MARKER_FIRST_ID	256		/* ids below are fixed, e.g. the splash screen's */
+
+enum kpi_marker_sink {
+	KPI_MARKER_NONE,
+	KPI_MARKER_KMSG,
+	KPI_MARKER_TRACE,
+	KPI_MARKER_SHM,
+};
+
+struct kpi_marker_record {
+	uint64_t seq;		/* 2n+1 while marker n is written, 2n+2 once done */
+	uint32_t id;
+	int32_t tid;
+	uint64_t mono_ns;
+	uint64_t boot_ns;
+	char name[32];
+};
+
+struct kpi_marker_ring {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t next_id;	/* ids handed out by kpi_marker_new_id so far */
+	uint64_t head;		/* markers written so far, by any process */
+	struct kpi_marker_record rec[KPI_MARKER_SLOTS];
+};
+
+struct kpi_marker {
+	enum kpi_marker_sink sink;
+	int fd;
+	struct kpi_marker_ring *ring;
+};
+
+static inline uint64_t kpi_marker_clock(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static __thread int kpi_marker_tid_cache;
+
+/* A forked child starts over with its own thread id */
+static inline void kpi_marker_tid_forget(void)
+{
+	kpi_marker_tid_cache = 0;
+}
+
+static inline int kpi_marker_tid(void)
+{
+	static int atfork;
+
+	if (!kpi_marker_tid_cache) {
+		kpi_marker_tid_cache = (int) syscall(SYS_gettid);
+		if (!__atomic_exchange_n(&atfork, 1, __ATOMIC_RELAXED))
+			pthread_atfork(NULL, NULL, kpi_marker_tid_forget);
+	}
+	return kpi_marker_tid_cache;
+}
+
+/* "kmsg", "trace" or "shm", KPI_MARKER_NONE for anything else */
+static inline enum kpi_marker_sink kpi_marker_sink_from_name(const char *name)
+{
+	if (!strcmp(name, "kmsg"))
+		return KPI_MARKER_KMSG;
+	if (!strcmp(name, "trace"))
+		return KPI_MARKER_TRACE;
+	if (!strcmp(name, "shm"))
+		return KPI_MARKER_SHM;
+	return KPI_MARKER_NONE;
+}
+
+/* Joins the ring other processes may already be writing */
+static inline struct kpi_marker_ring *kpi_marker_ring_map(void)
+{
+	struct kpi_marker_ring *r;
+	uint32_t unset = 0;
+	int fd;
+
+	fd = open(KPI_MARKER_SHM_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, sizeof(*r)) < 0) {
+		close(fd);
+		return NULL;
+	}
+	r = (struct kpi_marker_ring *) mmap(NULL, sizeof(*r),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (r == MAP_FAILED)
+		return NULL;
+
+	/* a fresh file is all zero, the first process to get here stamps it */
+	if (__atomic_compare_exchange_n(&r->magic, &unset, KPI_MARKER_MAGIC, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		r->version = KPI_MARKER_VERSION;
+		__atomic_store_n(&r->slots, KPI_MARKER_SLOTS, __ATOMIC_RELEASE);
+	}
+	return r;
+}
+
+/* Returns 0, or -1 with the sink left at KPI_MARKER_NONE */
+static inline int kpi_marker_open(struct kpi_marker *m, enum kpi_marker_sink sink)
+{
+	m->sink = KPI_MARKER_NONE;
+	m->fd = -1;
+	m->ring = NULL;
+
+	switch (sink) {
+	case KPI_MARKER_KMSG:
+		m->fd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC);
+		break;
+	case KPI_MARKER_TRACE:
+		m->fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+		if (m->fd < 0)
+			m->fd = open("/sys/kernel/debug/tracing/trace_marker",
+					O_WRONLY | O_CLOEXEC);
+		break;
+	case KPI_MARKER_SHM:
+		m->ring = kpi_marker_ring_map();
+		break;
+	default:
+		break;
+	}
+	if (m->fd < 0 && !m->ring)
+		return -1;
+	m->sink = sink;
+	return 0;
+}
+
+static inline void kpi_marker_close(struct kpi_marker *m)
+{
+	if (m->fd >= 0)
+		close(m->fd);
+	if (m->ring)
+		munmap(m->ring, sizeof(*m->ring));
+	m->fd = -1;
+	m->ring = NULL;
+	m->sink = KPI_MARKER_NONE;
+}
+
+/*
+ * A marker id no other process hands out. With the shm sink it comes from
+ * the ring header; kmsg and trace lines carry the pid, so a per-process
+ * count is enough there.
+ */
+static inline uint32_t kpi_marker_new_id(struct kpi_marker *m)
+{
+	static uint32_t next_id;
+
+	if (m->ring)
+		return KPI_MARKER_FIRST_ID +
+			__atomic_fetch_add(&m->ring->next_id, 1, __ATOMIC_RELAXED);
+	return KPI_MARKER_FIRST_ID + __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+}
+
+/* Any thread; timestamps are taken before anything else */
+static inline void kpi_marker_emit(struct kpi_marker *m, uint32_t id, const char *name)
+{
+	uint64_t mono = kpi_marker_clock(CLOCK_MONOTONIC);
+	uint64_t boot = kpi_marker_clock(CLOCK_BOOTTIME);
+	int tid = kpi_marker_tid();
+	struct kpi_marker_record *rec;
+	char line[128];
+	uint64_t n;
+	int len;
+
+	if (m->ring) {
+		n = __atomic_fetch_add(&m->ring->head, 1, __ATOMIC_RELAXED);
+		rec = &m->ring->rec[n & (KPI_MARKER_SLOTS - 1)];
+		__atomic_store_n(&rec->seq, 2 * n + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		rec->id = id;
+		rec->tid = tid;
+		rec->mono_ns = mono;
+		rec->boot_ns = boot;
+		strncpy(rec->name, name, sizeof(rec->name) - 1);
+		rec->name[sizeof(rec->name) - 1] = '\0';
+		__atomic_store_n(&rec->seq, 2 * n + 2, __ATOMIC_RELEASE);
+		return;
+	}
+	if (m->fd < 0)
+		return;
+
+	/* one write, so lines from several threads never interleave */
+	len = snprintf(line, sizeof(line),
+			"%searlyapp-kpi: %s id=%u mono=%llu boot=%llu pid=%d tid=%d\n",
+			m->sink == KPI_MARKER_KMSG ? "<6>" : "", name, id,
+			(unsigned long long) mono, (unsigned long long) boot,
+			(int) getpid(), tid);
+	if (len > (int) sizeof(line) - 1)
+		len = sizeof(line) - 1;
+	if (write(m->fd, line, len) < 0)
+		return;
+}
+
+/* Read-only mapping for readers, NULL if no marker was written yet */
+static inline const struct kpi_marker_ring *kpi_marker_ring_attach(void)
+{
+	const struct kpi_marker_ring *r;
+	struct stat st;
+	int fd;
+
+	fd = open(KPI_MARKER_SHM_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*r)) {
+		close(fd);
+		return NULL;
+	}
+	r = (const struct kpi_marker_ring *) mmap(NULL, sizeof(*r), PROT_READ,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (r == MAP_FAILED)
+		return NULL;
+	if (r->magic != KPI_MARKER_MAGIC || r->version != KPI_MARKER_VERSION) {
+		munmap((void *) r, sizeof(*r));
+		return NULL;
+	}
+	return r;
+}
+
+/* Copies marker n, returns 0 or -1 if it was overwritten or not done yet */
+static inline int kpi_marker_read(const struct kpi_marker_ring *r, uint64_t n,
+		struct kpi_marker_record *out)
+{
+	const struct kpi_marker_record *rec = &r->rec[n & (KPI_MARKER_SLOTS - 1)];
+
+	if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != 2 * n + 2)
+		return -1;
+	memcpy(out, rec, sizeof(*out));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != 2 * n + 2)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/*
+ * Compressed splash image, decoded by fastboot straight into the scanout
+ * buffer and written by earlyapp-splashconv.
+ *
+ * A header is followed by the rows top to bottom. Each row is a list of
+ * 32-bit tokens covering exactly width pixels: a run token (bit 31 set)
+ * is followed by one XRGB8888 colour repeated count times, a literal
+ * token by count XRGB8888 pixels. A logo on a flat background shrinks to
+ * a few hundred KB, and decoding is a fill or a copy per span. The image
+ * is centred on the framebuffer, cropped if larger, and the border is
+ * filled with the background colour.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SPLASH_IMAGE_MAGIC	0x50534145u	/* "EASP" */
+#define SPLASH_IMAGE_VERSION	1
+
+#define SPLASH_TOKEN_RUN	(1u << 31)
+#define SPLASH_TOKEN_COUNT	0x7fffffffu
+
+struct splash_image_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t background;	/* XRGB8888 outside the image */
+	uint32_t data_size;	/* bytes of row tokens after the header */
+};
+
+/* Vectorised fill, the framebuffer mapping is write-combined */
+static inline void splash_fill(uint32_t *dst, uint32_t colour, size_t n)
+{
+#ifdef __SSE2__
+	__m128i v = _mm_set1_epi32((int) colour);
+
+	while (n && ((uintptr_t) dst & 15)) {
+		*dst++ = colour;
+		n--;
+	}
+	for (; n >= 16; n -= 16, dst += 16) {
+		_mm_store_si128((__m128i *) dst, v);
+		_mm_store_si128((__m128i *) dst + 1, v);
+		_mm_store_si128((__m128i *) dst + 2, v);
+		_mm_store_si128((__m128i *) dst + 3, v);
+	}
+	for (; n >= 4; n -= 4, dst += 4)
+		_mm_store_si128((__m128i *) dst, v);
+#endif
+	while (n--)
+		*dst++ = colour;
+}
+
+static inline int splash_image_check(const struct splash_image_header *h, size_t size)
+{
+	return size >= sizeof(*h) && h->magic == SPLASH_IMAGE_MAGIC &&
+		h->version == SPLASH_IMAGE_VERSION &&
+		h->data_size <= size - sizeof(*h) && (h->data_size & 3) == 0;
+}
+
+/*
+ * Decodes the row tokens following h into a fb_width x fb_height XRGB8888
+ * framebuffer with pitch bytes per line. Returns -1 on a corrupt image,
+ * in which case the framebuffer content is undefined.
+ */
+static inline int splash_image_decode(const struct splash_image_header *h, const void *data,
+		uint8_t *fb, unsigned int fb_width, unsigned int fb_height, unsigned int pitch)
+{
+	const uint32_t *tok = data;
+	const uint32_t *end = tok + h->data_size / 4;
+	/* image origin on the framebuffer, negative when it is cropped */
+	long ox = ((long) fb_width - (long) h->width) / 2;
+	long oy = ((long) fb_height - (long) h->height) / 2;
+	long vx0 = ox > 0 ? ox : 0;
+	long vx1 = ox + (long) h->width < (long) fb_width ? ox + (long) h->width : (long) fb_width;
+	long y;
+
+	for (y = 0; y < (long) fb_height; y++) {
+		uint32_t *line = (uint32_t *) (fb + (size_t) y * pitch);
+
+		if (y < oy || y >= oy + (long) h->height) {
+			splash_fill(line, h->background, fb_width);
+			continue;
+		}
+		if (vx0 > 0)
+			splash_fill(line, h->background, vx0);
+		if (vx1 < (long) fb_width)
+			splash_fill(line + vx1, h->background, fb_width - vx1);
+	}
+
+	for (y = 0; y < (long) h->height; y++) {
+		long fy = oy + y;
+		uint32_t *line = fy >= 0 && fy < (long) fb_height
+			? (uint32_t *) (fb + (size_t) fy * pitch) : NULL;
+		long x = 0;
+
+		while (x < (long) h->width) {
+			uint32_t t, n;
+			long a, b;
+
+			if (tok >= end)
+				return -1;
+			t = *tok++;
+			n = t & SPLASH_TOKEN_COUNT;
+			if (n == 0 || n > h->width - x)
+				return -1;
+			if (!(t & SPLASH_TOKEN_RUN) && (size_t) (end - tok) < n)
+				return -1;
+			if ((t & SPLASH_TOKEN_RUN) && tok >= end)
+				return -1;
+
+			/* visible part of [x, x + n) */
+			a = ox + x > vx0 ? ox + x : vx0;
+			b = ox + x + n < vx1 ? ox + x + n : vx1;
+			if (line && a < b) {
+				if (t & SPLASH_TOKEN_RUN)
+					splash_fill(line + a, *tok, b - a);
+				else
+					memcpy(line + a, tok + (a - ox - x), (b - a) * 4);
+			}
+			tok += (t & SPLASH_TOKEN_RUN) ? 1 : n;
+			x += n;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Converts a PNG into the compressed splash image fastboot decodes into
+ * the DRM framebuffer (see splash_image.h). Transparent pixels are
+ * blended over the background colour, which defaults to the top-left
+ * pixel of the image.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <png.h>
+
+#include "splash_image.h"
+
+/* a run token and its colour cost two literals, so runs start at three */
+#define MIN_RUN 3
+
+struct token_buf {
+	uint32_t *data;
+	size_t len, cap;
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b RRGGBB] input.png output.fb\n", name);
+}
+
+static void emit(struct token_buf *b, uint32_t v)
+{
+	if (b->len == b->cap) {
+		b->cap = b->cap ? b->cap * 2 : 4096;
+		b->data = realloc(b->data, b->cap * sizeof(*b->data));
+		if (!b->data) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	b->data[b->len++] = v;
+}
+
+static void encode_row(struct token_buf *b, const uint32_t *px, unsigned int width)
+{
+	unsigned int x = 0, lit = 0;	/* literal span [lit, x) not yet emitted */
+
+	while (x < width) {
+		unsigned int n = 1;
+
+		while (x + n < width && px[x + n] == px[x])
+			n++;
+		if (n < MIN_RUN) {
+			x += n;
+			continue;
+		}
+		if (lit < x) {
+			emit(b, x - lit);
+			for (; lit < x; lit++)
+				emit(b, px[lit]);
+		}
+		emit(b, SPLASH_TOKEN_RUN | n);
+		emit(b, px[x]);
+		x += n;
+		lit = x;
+	}
+	if (lit < x) {
+		emit(b, x - lit);
+		for (; lit < x; lit++)
+			emit(b, px[lit]);
+	}
+}
+
+static uint32_t blend(uint32_t argb, uint32_t bg)
+{
+	uint32_t a = argb >> 24, out = 0xff000000u;
+	int shift;
+
+	for (shift = 0; shift < 24; shift += 8) {
+		uint32_t f = (argb >> shift) & 0xff, k = (bg >> shift) & 0xff;
+
+		out |= ((f * a + k * (255 - a) + 127) / 255) << shift;
+	}
+	return out;
+}
+
+int main(int argc, char **argv)
+{
+	struct splash_image_header h = { 0 };
+	struct token_buf b = { 0 };
+	png_image img;
+	uint32_t *px, *check;
+	const char *bg_arg = NULL;
+	FILE *out;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			bg_arg = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	memset(&img, 0, sizeof(img));
+	img.version = PNG_IMAGE_VERSION;
+	if (!png_image_begin_read_from_file(&img, argv[optind])) {
+		fprintf(stderr, "%s: %s\n", argv[optind], img.message);
+		return 1;
+	}
+	/* BGRA in memory is ARGB8888 in a little endian word, as KMS wants it */
+	img.format = PNG_FORMAT_BGRA;
+	px = malloc(PNG_IMAGE_SIZE(img));
+	if (!px || !png_image_finish_read(&img, NULL, px, 0, NULL)) {
+		fprintf(stderr, "%s: %s\n", argv[optind], px ? img.message : strerror(errno));
+		return 1;
+	}
+
+	h.magic = SPLASH_IMAGE_MAGIC;
+	h.version = SPLASH_IMAGE_VERSION;
+	h.width = img.width;
+	h.height = img.height;
+	h.background = bg_arg ? 0xff000000u | (uint32_t) strtoul(bg_arg, NULL, 16)
+		: px[0] | 0xff000000u;
+	for (i = 0; i < (size_t) h.width * h.height; i++)
+		px[i] = blend(px[i], h.background);
+
+	for (i = 0; i < h.height; i++)
+		encode_row(&b, px + i * h.width, h.width);
+	h.data_size = b.len * sizeof(*b.data);
+
+	/* decode it back before anything reaches the boot partition */
+	check = malloc((size_t) h.width * h.height * 4);
+	if (!check || splash_image_decode(&h, b.data, (uint8_t *) check, h.width, h.height,
+				h.width * 4) < 0 ||
+			memcmp(check, px, (size_t) h.width * h.height * 4)) {
+		fprintf(stderr, "round trip check failed\n");
+		return 1;
+	}
+
+	out = fopen(argv[optind + 1], "wb");
+	if (!out || fwrite(&h, sizeof(h), 1, out) != 1 ||
+			fwrite(b.data, sizeof(*b.data), b.len, out) != b.len ||
+			fclose(out)) {
+		fprintf(stderr, "%s: %s\n", argv[optind + 1], strerror(errno));
+		return 1;
+	}
+	printf("%ux%u, %zu bytes (raw %zu)\n", h.width, h.height,
+			sizeof(h) + h.data_size, (size_t) h.width * h.height * 4);
+
+	free(check);
+	free(b.data);
+	free(px);
+	return 0;
+}
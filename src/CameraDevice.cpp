@@ -104,7 +104,24 @@ namespace earlyapp
         m_iciParam.port = 4;
         m_iciParam.fullscreen = 0;
         m_iciParam.interlaced = 0;
+        m_iciParam.deinterlace = DEINT_WEAVE;
+        const std::string& deint = m_pConf->deinterlace();
+        if(deint == "weave" || deint == "bob" || deint == "motion")
+        {
+            // CVBS delivers alternating top and bottom fields.
+            m_iciParam.interlaced = 1;
+            if(deint == "bob")
+                m_iciParam.deinterlace = DEINT_BOB;
+            else if(deint == "motion")
+                m_iciParam.deinterlace = DEINT_MOTION;
+        }
+        else if(deint != "none")
+        {
+            LWRN_(TAG, "Unknown deinterlace mode " << deint << ", capturing progressive");
+        }
         m_iciParam.frames_count = 0;
+        m_iciParam.epoll_loop = 1;
+        m_iciParam.cpu_convert = m_pConf->iciCpuConvert() ? 1 : 0;
         m_iciParam.stream_input = CVBS_INPUT;
         m_iciParam.mem_type = ICI_MEM_DMABUF;
         m_stream_id = 27;
@@ -112,9 +129,9 @@ namespace earlyapp
         initWlConnection();
 
         /* gpio creation */
-        if(m_pConf->gpioNumber() != m_pConf->NOT_SET)
+        if(m_pConf->kpiMarkers())
         {
-            m_pGPIOClass = GPIOControl_create(m_pConf->gpioNumber(), m_pConf->gpioSustain());
+            m_pGPIOClass = GPIOControl_create(m_pConf->gpioNumber(), m_pConf->gpioSustain(), "ici-camera");
         }
 
         LINF_(TAG, "Camerea intialized.");
@@ -173,6 +190,7 @@ namespace earlyapp
         {
             GPIOControl_release(m_pGPIOClass);
         }
+        iciReleaseDisplay();
         disconnectWlConnection();
     }
 
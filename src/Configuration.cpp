@@ -56,9 +56,16 @@ namespace earlyapp
     const unsigned int Configuration::DEFAULT_DISPLAY_HEIGHT = DONT_CARE;
     const int Configuration::DEFAULT_GPIONUMBER = NOT_SET;
     const unsigned int Configuration::DEFAULT_GPIOSUSTAIN = 1;
+    const char* Configuration::DEFAULT_KPIMARKER = "gpio";
     const bool Configuration::DEFAULT_USE_GSTREAMER = false;
     const bool Configuration::DEFAULT_USE_CSICAM = false;
     const char* Configuration::DEFAULT_GSTCAMCMD = "";
+    const unsigned int Configuration::DEFAULT_CSI_BUFFERS = 10;
+    const bool Configuration::DEFAULT_CSI_CPU_CONVERT = false;
+    const bool Configuration::DEFAULT_CSI_KMS_PREVIEW = false;
+    const char* Configuration::DEFAULT_DEINTERLACE = "none";
+    const bool Configuration::DEFAULT_ICI_CPU_CONVERT = false;
+    const unsigned int Configuration::DEFAULT_EGL_SWAP_INTERVAL = 1;
 
 
     // Configuration keys.
@@ -73,9 +80,16 @@ namespace earlyapp
     const char* Configuration::KEY_DISPLAYHEIGHT = "height";
     const char* Configuration::KEY_GPIONUMBER = "gpio-number";
     const char* Configuration::KEY_GPIOSUSTAIN = "gpio-sustain";
+    const char* Configuration::KEY_KPIMARKER = "kpi-marker";
     const char* Configuration::KEY_USEGSTREAMER = "use-gstreamer";
     const char* Configuration::KEY_USECSICAM = "use-csicam";
     const char* Configuration::KEY_GSTCAMCMD = "gstcamcmd";
+    const char* Configuration::KEY_CSIBUFFERS = "csi-buffers";
+    const char* Configuration::KEY_CSICPUCONVERT = "csi-cpu-convert";
+    const char* Configuration::KEY_CSIKMSPREVIEW = "csi-kms-preview";
+    const char* Configuration::KEY_DEINTERLACE = "deinterlace";
+    const char* Configuration::KEY_ICICPUCONVERT = "ici-cpu-convert";
+    const char* Configuration::KEY_EGLSWAPINTERVAL = "egl-swap-interval";
 
 
 
@@ -206,6 +220,18 @@ namespace earlyapp
         return peakSustain;
     }
 
+    // KPI marker sink.
+    const std::string& Configuration::kpiMarker(void)
+    {
+        return stringMappedValueOf(Configuration::KEY_KPIMARKER);
+    }
+
+    // GPIO or software KPI markers.
+    bool Configuration::kpiMarkers(void)
+    {
+        return gpioNumber() != NOT_SET || kpiMarker() != DEFAULT_KPIMARKER;
+    }
+
     // Use GStreamer
     bool Configuration::useGStreamer(void) const
     {
@@ -226,6 +252,47 @@ namespace earlyapp
         return stringMappedValueOf(Configuration::KEY_GSTCAMCMD);
     }
 
+    // CSI camera capture buffers.
+    unsigned int Configuration::csiBufferCount(void) const
+    {
+        unsigned int count = m_VM[Configuration::KEY_CSIBUFFERS].as<unsigned int>();
+        return count;
+    }
+
+    // CSI camera YUV to RGB conversion on the CPU.
+    bool Configuration::csiCpuConvert(void) const
+    {
+        bool cpuConvert = m_VM[Configuration::KEY_CSICPUCONVERT].as<bool>();
+        return cpuConvert;
+    }
+
+    // CSI camera scanout through KMS before the compositor.
+    bool Configuration::csiKmsPreview(void) const
+    {
+        bool kmsPreview = m_VM[Configuration::KEY_CSIKMSPREVIEW].as<bool>();
+        return kmsPreview;
+    }
+
+    // ICI camera deinterlacing mode.
+    const std::string& Configuration::deinterlace(void)
+    {
+        return stringMappedValueOf(Configuration::KEY_DEINTERLACE);
+    }
+
+    // ICI camera YUV to RGB conversion on the CPU.
+    bool Configuration::iciCpuConvert(void) const
+    {
+        bool cpuConvert = m_VM[Configuration::KEY_ICICPUCONVERT].as<bool>();
+        return cpuConvert;
+    }
+
+    // GLES test path swap interval.
+    unsigned int Configuration::eglSwapInterval(void) const
+    {
+        unsigned int interval = m_VM[Configuration::KEY_EGLSWAPINTERVAL].as<unsigned int>();
+        return interval;
+    }
+
     // Destructor.
     Configuration::~Configuration(void)
     {
@@ -305,6 +372,11 @@ namespace earlyapp
                  boost::program_options::value<unsigned int>()->default_value(Configuration::DEFAULT_GPIOSUSTAIN),
                  "GPIO sustaining time in ms for KPI measurements.")
 
+                // KPI marker sink.
+                (Configuration::KEY_KPIMARKER,
+                 boost::program_options::value<std::string>()->default_value(Configuration::DEFAULT_KPIMARKER),
+                 "Where KPI markers go: gpio, kmsg, trace or shm. The last three need no GPIO.")
+
                 // Use GStreamer
                 (Configuration::KEY_USEGSTREAMER,
                  boost::program_options::bool_switch()->default_value(Configuration::DEFAULT_USE_GSTREAMER),
@@ -318,7 +390,37 @@ namespace earlyapp
 		// Custom GStreamer camera command.
                 (Configuration::KEY_GSTCAMCMD,
                  boost::program_options::value<std::string>()->default_value(Configuration::DEFAULT_GSTCAMCMD),
-                 "Custom GStreamer camera command. Only supported with use-gstreamer option.");
+                 "Custom GStreamer camera command. Only supported with use-gstreamer option.")
+
+                // CSI camera capture buffers.
+                (Configuration::KEY_CSIBUFFERS,
+                 boost::program_options::value<unsigned int>()->default_value(Configuration::DEFAULT_CSI_BUFFERS),
+                 "Number of capture buffers kept allocated for the CSI camera.")
+
+                // CSI camera conversion on the CPU.
+                (Configuration::KEY_CSICPUCONVERT,
+                 boost::program_options::bool_switch()->default_value(Configuration::DEFAULT_CSI_CPU_CONVERT),
+                 "Convert CSI camera frames to RGB on the CPU instead of the GPU.")
+
+                // CSI camera on a KMS plane until the compositor is up.
+                (Configuration::KEY_CSIKMSPREVIEW,
+                 boost::program_options::bool_switch()->default_value(Configuration::DEFAULT_CSI_KMS_PREVIEW),
+                 "Show CSI camera frames directly through KMS until the Wayland compositor is up.")
+
+                // ICI camera deinterlacing.
+                (Configuration::KEY_DEINTERLACE,
+                 boost::program_options::value<std::string>()->default_value(Configuration::DEFAULT_DEINTERLACE),
+                 "Capture CVBS camera fields and deinterlace them: none, weave, bob or motion.")
+
+                // ICI camera conversion on the CPU.
+                (Configuration::KEY_ICICPUCONVERT,
+                 boost::program_options::bool_switch()->default_value(Configuration::DEFAULT_ICI_CPU_CONVERT),
+                 "Convert ICI camera frames to RGB on the CPU instead of the GPU.")
+
+                // GLES test path pacing.
+                (Configuration::KEY_EGLSWAPINTERVAL,
+                 boost::program_options::value<unsigned int>()->default_value(Configuration::DEFAULT_EGL_SWAP_INTERVAL),
+                 "EGL swap interval of the GLES test, 0 renders as fast as possible instead of on frame callbacks.");
 
 
             boost::program_options::store(
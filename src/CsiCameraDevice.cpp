@@ -95,10 +95,16 @@ namespace earlyapp
         if((int) m_csiParam.oh == Configuration::DONT_CARE)
             m_csiParam.oh = DEFAULT_CAMERA_HEIGHT;
 
+        // Buffers are allocated on the first engagement and kept.
+        m_pBufferPool = CsiCreateBufferPool(m_pConf->csiBufferCount());
+        m_csiParam.pool = m_pBufferPool;
+        m_csiParam.cpu_convert = m_pConf->csiCpuConvert() ? 1 : 0;
+        m_csiParam.kms_preview = m_pConf->csiKmsPreview() ? 1 : 0;
+
 	/* gpio creation */
-        if(m_pConf->gpioNumber() != m_pConf->NOT_SET)
+        if(m_pConf->kpiMarkers())
         {
-            m_pGPIOClass = GPIOControl_create(m_pConf->gpioNumber(), m_pConf->gpioSustain());
+            m_pGPIOClass = GPIOControl_create(m_pConf->gpioNumber(), m_pConf->gpioSustain(), "csi-camera");
         }
 
         LINF_(TAG, "CSI Camerea intialized.");
@@ -154,7 +160,12 @@ namespace earlyapp
         {
             GPIOControl_release(m_pGPIOClass);
         }
-
+        if(m_pBufferPool)
+        {
+            CsiDestroyBufferPool(m_pBufferPool);
+            m_pBufferPool = nullptr;
+            m_csiParam.pool = nullptr;
+        }
     }
 
     void CsiCameraDevice::displayCamera(set_up m_csiParam, void *GPIOClass)
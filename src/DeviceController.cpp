@@ -30,13 +30,13 @@
 #include <mutex>
 #include <time.h>
 #include <unistd.h>
-#include <sys/stat.h>
 #include <boost/thread.hpp>
 #include "EALog.h"
 #include "Configuration.hpp"
 #include "DeviceController.hpp"
 #include "SystemStatusTracker.hpp"
 #include "OutputDevice.hpp"
+#include "WaylandReady.hpp"
 
 #include "AudioDevice.hpp"
 #include "VideoDevice.hpp"
@@ -75,6 +75,28 @@ namespace earlyapp
         return ((void *)0);
     }
 
+    /*
+      Wait for the video init thread.
+     */
+    void DeviceController::joinVideoInit(void)
+    {
+        static std::once_flag s_Joined;
+
+        std::call_once(s_Joined, [] { pthread_join(init_vid_tid, NULL); });
+    }
+
+    /*
+      Stop the warm-started splash video.
+     */
+    void DeviceController::cancelVideo(void)
+    {
+        if(m_pVid == nullptr)
+            return;
+
+        joinVideoInit();
+        m_pVid->cancelPlay();
+    }
+
     /*
       Initialize device controller.
      */
@@ -122,6 +144,13 @@ namespace earlyapp
         addDevice(m_pVid);
         addDevice(m_pCam);
 
+        s_pConf = m_pConf;
+
+        // MSDK video decodes without a compositor, warm it up right away.
+        bool bEarlyVideo = !m_pConf->useGStreamer();
+        if(bEarlyVideo)
+            pthread_create(&init_vid_tid, NULL, init_device, (void *)m_pVid);
+
 #ifdef USE_DMESGLOG
         dmesgLogPrint("EA: Waiting for Wayland socket...");
 #endif
@@ -137,9 +166,9 @@ namespace earlyapp
 #endif
 
         // Initalize devices.
-        s_pConf = m_pConf;
         pthread_create(&init_aud_tid, NULL, init_device, (void *)m_pAud);
-        pthread_create(&init_vid_tid, NULL, init_device, (void *)m_pVid);
+        if(!bEarlyVideo)
+            pthread_create(&init_vid_tid, NULL, init_device, (void *)m_pVid);
         pthread_create(&init_cam_tid, NULL, init_device, (void *)m_pCam);
 
         // left to join video thread when really playing it
@@ -151,7 +180,8 @@ namespace earlyapp
 #endif
         m_bInit = true;
 
-	if(m_pConf->useCsicam())
+	// The camera scans out through KMS until Weston is up, don't hold it back.
+	if(m_pConf->useCsicam() && !m_pConf->csiKmsPreview())
 	    waitForWayland();
     }
 
@@ -172,7 +202,8 @@ namespace earlyapp
     /* Video Play thread */
     void DeviceController::VideoPlay_Thread(OutputDevice* m_pVid)
     {
-        pthread_join(init_vid_tid, NULL);
+        joinVideoInit();
+        WaylandReady::getInstance().wait();
         m_pVid->preparePlay(nullptr);
         m_pVid->play();
 
@@ -218,6 +249,9 @@ namespace earlyapp
                 {
                     LWRN_(TAG, "Invalid Camera device: BOOTRVC");
                 }
+
+                // No splash video on a reverse gear boot.
+                cancelVideo();
             }
             break;
 
@@ -284,6 +318,9 @@ namespace earlyapp
                 {
                     LWRN_(TAG, "Invalid Camera device: RVC");
                 }
+
+                // The splash video is over or was never shown.
+                cancelVideo();
             }
             break;
             default:
@@ -298,6 +335,8 @@ namespace earlyapp
      */
     void DeviceController::stopAllDevices(void)
     {
+        // Video init may still run when the video was never played.
+        joinVideoInit();
         for(auto& it: m_Devs)
         {
             it->prepareStop();
@@ -348,31 +387,6 @@ namespace earlyapp
      */
     void DeviceController::waitForWayland(void)
     {
-        char WLSocketPath[WAYLAND_SOCKET_PATH_LENGTH];
-        const char* pXDGEnv = getenv(XDG_RUNTIME_DIR);
-        const char* pWLDispEnv = getenv(WAYLAND_DISPLAY);
-
-        if(pXDGEnv != nullptr)
-        {
-            // Use default file name if not defined.
-            if(pWLDispEnv == nullptr)
-            {
-                LWRN_(TAG, "WAYLAND_DISPLAY has not defined");
-                pWLDispEnv = DEFAULT_WAYLAND_SOCKET;
-            }
-
-            struct stat st;
-            snprintf(WLSocketPath, WAYLAND_SOCKET_PATH_LENGTH, "%s/%s", pXDGEnv, pWLDispEnv);
-            LINF_(TAG, "Waiting for wayland socket: " <<  WLSocketPath);
-
-            while(stat(WLSocketPath, &st) != 0)
-            {
-                usleep(100);
-            }
-        }
-        else
-        {
-            LWRN_(TAG, "XDG_RUNTIM_DIR not defined. Abandoning Wayland wayting");
-        }
+        WaylandReady::getInstance().wait();
     }
 } // namespace
@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "EALog.h"
+#include "GPIOBackend.hpp"
+
+// Log tag.
+#define TAG "GPIO"
+
+// GPIO directory path.
+#define GPIO_DIRPATH "/sys/class/gpio"
+
+
+namespace earlyapp
+{
+    // Write a short string to a sysfs attribute.
+    static bool writeAttribute(const std::string& path, const char* value)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if(fd < 0)
+        {
+            return false;
+        }
+        ssize_t len = (ssize_t)strlen(value);
+        bool written = (write(fd, value, len) == len);
+        close(fd);
+        return written;
+    }
+
+    // Constructor.
+    SysfsGPIOBackend::SysfsGPIOBackend(int gpioNumber)
+    {
+        std::string gpioDir = GPIO_DIRPATH "/gpio" + std::to_string(gpioNumber);
+        std::string valuePath = gpioDir + "/value";
+
+        m_ValueFd = open(valuePath.c_str(), O_WRONLY | O_CLOEXEC);
+        if(m_ValueFd < 0)
+        {
+            // Export the GPIO and set the direction once.
+            if(! writeAttribute(GPIO_DIRPATH "/export", std::to_string(gpioNumber).c_str()))
+            {
+                LERR_(TAG, "Failed to export GPIO " << gpioNumber);
+            }
+            if(! writeAttribute(gpioDir + "/direction", "out"))
+            {
+                LERR_(TAG, "Failed to set direction of GPIO " << gpioNumber);
+                return;
+            }
+            m_ValueFd = open(valuePath.c_str(), O_WRONLY | O_CLOEXEC);
+            if(m_ValueFd < 0)
+            {
+                LERR_(TAG, "Failed to open GPIO value: " << valuePath);
+            }
+        }
+    }
+
+    // Destructor.
+    SysfsGPIOBackend::~SysfsGPIOBackend(void)
+    {
+        if(m_ValueFd >= 0)
+        {
+            close(m_ValueFd);
+        }
+    }
+
+    // Drive the line, one pwrite on the open value file.
+    bool SysfsGPIOBackend::set(bool high)
+    {
+        const char v = high ? '1' : '0';
+        return pwrite(m_ValueFd, &v, 1, 0) == 1;
+    }
+
+    // Constructor.
+    SoftwareMarkerBackend::SoftwareMarkerBackend(enum kpi_marker_sink sink, const char* name)
+        : m_Name(name)
+    {
+        if(kpi_marker_open(&m_Marker, sink) < 0)
+        {
+            LERR_(TAG, "Failed to open KPI marker sink for " << m_Name);
+            return;
+        }
+        m_Id = kpi_marker_new_id(&m_Marker);
+    }
+
+    // Destructor.
+    SoftwareMarkerBackend::~SoftwareMarkerBackend(void)
+    {
+        kpi_marker_close(&m_Marker);
+    }
+
+    // Emit a marker.
+    bool SoftwareMarkerBackend::set(bool high)
+    {
+        if(high)
+        {
+            kpi_marker_emit(&m_Marker, m_Id, m_Name.c_str());
+        }
+        return true;
+    }
+
+    // Record a line change.
+    bool MockGPIOBackend::set(bool high)
+    {
+        Transition t;
+        t.high = high;
+        clock_gettime(CLOCK_MONOTONIC, &t.time);
+
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Transitions.push_back(t);
+        return true;
+    }
+
+    // Recorded line changes.
+    std::vector<MockGPIOBackend::Transition> MockGPIOBackend::transitions(void)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        return m_Transitions;
+    }
+
+} // namespace
@@ -24,34 +24,64 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-#include <sstream>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <fcntl.h>
-#include <stdio.h>
-#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
-#include <string.h>
 #include "EALog.h"
 #include "GPIOControl.hpp"
 
 // Log tag.
 #define TAG "GPIO"
 
-// GPIO directory path.
-#define GPIO_DIRPATH "/sys/class/gpio"
-
 
 namespace earlyapp
 {
+    // GPIO unless a software sink is selected.
+    enum kpi_marker_sink GPIOControl::s_MarkerSink = KPI_MARKER_NONE;
+
+    // Select the marker sink.
+    bool GPIOControl::setMarkerSink(const std::string& sink)
+    {
+        if(sink == "gpio")
+        {
+            s_MarkerSink = KPI_MARKER_NONE;
+            return true;
+        }
+        enum kpi_marker_sink s = kpi_marker_sink_from_name(sink.c_str());
+        if(s == KPI_MARKER_NONE)
+        {
+            LERR_(TAG, "Unknown KPI marker sink: " << sink);
+            return false;
+        }
+        s_MarkerSink = s;
+        return true;
+    }
+
     // Constructor.
-    GPIOControl::GPIOControl(int gpioNumber, unsigned int peakSustainTime)
+    GPIOControl::GPIOControl(int gpioNumber, unsigned int peakSustainTime, const char* marker)
     {
+        // Peak time. x 1000 to make it ms.
+        m_SustainTime = peakSustainTime * 1000;
+
+        if(s_MarkerSink != KPI_MARKER_NONE)
+        {
+            SoftwareMarkerBackend* pMarker =
+                new SoftwareMarkerBackend(s_MarkerSink, marker ? marker : "earlyapp");
+            m_pBackend.reset(pMarker);
+            m_Valid = pMarker->isOpen();
+            LINF_(TAG, "Software KPI markers: " << (marker ? marker : "earlyapp"));
+            return;
+        }
+
         // Disregards for wrong GPIO settings.
         if(gpioNumber > 0)
         {
-            m_Valid = true;
-            m_GPIONumber = gpioNumber;
+            SysfsGPIOBackend* pSysfs = new SysfsGPIOBackend(gpioNumber);
+            m_pBackend.reset(pSysfs);
+            m_Valid = pSysfs->isOpen();
             LINF_(TAG, "GPIO output to " << gpioNumber);
         }
         else
@@ -60,102 +90,150 @@ namespace earlyapp
             LINF_(TAG, "Not controlling GPIO.");
         }
 
-        // Peak time. x 1000 to make it ms.
+        if(m_Valid)
+        {
+            LINF_(TAG, "Peak sustaining time(us): " << m_SustainTime);
+            startPulseThread();
+        }
+    }
+
+    // Constructor with a given backend.
+    GPIOControl::GPIOControl(std::unique_ptr<GPIOBackend> backend, unsigned int peakSustainTime)
+        : m_pBackend(std::move(backend))
+    {
         m_SustainTime = peakSustainTime * 1000;
-        LINF_(TAG, "Peak sustaining time(us): " << m_SustainTime);
+        m_Valid = (m_pBackend != nullptr);
+        if(m_Valid && m_pBackend->pulses())
+        {
+            startPulseThread();
+        }
     }
 
-    // Output GPIO.
-    bool GPIOControl::output(eGPIOValue highLow)
+    // Destructor.
+    GPIOControl::~GPIOControl(void)
+    {
+        if(m_pPulseThread != nullptr)
+        {
+            uint64_t one = 1;
+            write(m_StopFd, &one, sizeof(one));
+            m_pPulseThread->join();
+            delete m_pPulseThread;
+            m_pPulseThread = nullptr;
+        }
+        if(m_High)
+        {
+            output(LOW);
+        }
+        if(m_TimerFd >= 0)
+        {
+            close(m_TimerFd);
+        }
+        if(m_StopFd >= 0)
+        {
+            close(m_StopFd);
+        }
+    }
+
+    // Start the thread ending the pulses.
+    void GPIOControl::startPulseThread(void)
     {
-        std::string strGPIO = std::to_string(m_GPIONumber);
-        const char* cstrGPIO = strGPIO.c_str();
-        size_t gpioStrLen = strlen(cstrGPIO);
+        m_TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        m_StopFd = eventfd(0, EFD_CLOEXEC);
+        if(m_TimerFd < 0 || m_StopFd < 0)
+        {
+            LERR_(TAG, "Failed to create GPIO pulse timer.");
+            m_Valid = false;
+            return;
+        }
+        m_pPulseThread = new boost::thread(&GPIOControl::pulseThread, this);
+    }
 
-        // Value path.
-        int valueFd = open(valuePath()->c_str(), O_WRONLY);
-        if(valueFd < 0)
+    // Lower the line whenever the pulse timer fires.
+    void GPIOControl::pulseThread(void)
+    {
+        struct pollfd fds[2];
+        fds[0].fd = m_TimerFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = m_StopFd;
+        fds[1].events = POLLIN;
+
+        for(;;)
         {
-            // Set export / direction path when failed to open the valuePath().
-            int exportFd = open(exportPath()->c_str(), O_WRONLY);
-            if(exportFd < 0)
+            if(poll(fds, 2, -1) < 0)
             {
-                LERR_(TAG, "Failed to open export path:" << exportPath());
-                return false;
+                continue;
             }
-            write(exportFd, cstrGPIO, gpioStrLen);
-            close(exportFd);
-
-            // set the direction.
-            int dirFd = open(directionPath()->c_str(), O_WRONLY);
-            if (dirFd < 0)
+            if(fds[1].revents & POLLIN)
             {
-                LERR_(TAG, "Failed to open direction:" << directionPath());
-                return false;
+                break;
             }
-            write(dirFd, "out", (size_t)3);
-            close(dirFd);
-
-            //Retry set the high low
-            valueFd = open(valuePath()->c_str(), O_WRONLY);
-            if(valueFd < 0)
+            if(fds[0].revents & POLLIN)
             {
-                LERR_(TAG, "Failed to open GPIO value: " << valuePath());
-                return false;
+                uint64_t expirations;
+                read(m_TimerFd, &expirations, sizeof(expirations));
+
+                std::lock_guard<std::mutex> lock(m_PulseLock);
+                output(LOW);
+                m_High = false;
             }
         }
-
-        // Succeed to open the path.
-        const char v = (highLow == eGPIOValue::HIGH) ? '1' : '0';
-        write(valueFd, &v, (size_t)1);
-        close(valueFd);
-
-        return true;
     }
 
-    // Sustain current output for given time.
-    void GPIOControl::sustain(void)
+    // Output GPIO.
+    bool GPIOControl::output(eGPIOValue highLow)
     {
-        usleep(m_SustainTime);
+        if(! m_Valid)
+        {
+            return false;
+        }
+        return m_pBackend->set(highLow == eGPIOValue::HIGH);
     }
 
     // GPIO Output Pattern.
     void GPIOControl::outputPattern(void)
     {
-        output(HIGH);
-        sustain();
-        output(LOW);
-    }
+        if(! m_Valid)
+        {
+            return;
+        }
 
-    // GPIO export path.
-    std::shared_ptr<std::string> GPIOControl::exportPath(void) const
-    {
-        std::shared_ptr<std::string> r(new std::string(GPIO_DIRPATH "/export"));
-        return r;
-    }
+        // One event, nothing to time.
+        if(! m_pBackend->pulses())
+        {
+            m_pBackend->set(true);
+            return;
+        }
 
-    // GPIO direction path
-    std::shared_ptr<std::string> GPIOControl::directionPath(void) const
-    {
-        std::ostringstream ss;
-        ss << GPIO_DIRPATH;
-        ss << "/gpio";
-        ss << std::to_string(m_GPIONumber);
-        ss << "/direction";
-        std::shared_ptr<std::string> r(new std::string(ss.str()));
-        return r;
-    }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
 
-    // GPIO value path.
-    std::shared_ptr<std::string> GPIOControl::valuePath(void) const
-    {
-        std::ostringstream ss;
-        ss << GPIO_DIRPATH;
-        ss << "/gpio";
-        ss << std::to_string(m_GPIONumber);
-        ss << "/value";
-        std::shared_ptr<std::string> r(new std::string(ss.str()));
-        return r;
+        std::lock_guard<std::mutex> lock(m_PulseLock);
+        if(m_High
+           || now.tv_sec < m_NextPulse.tv_sec
+           || (now.tv_sec == m_NextPulse.tv_sec && now.tv_nsec < m_NextPulse.tv_nsec))
+        {
+            ++m_DroppedPulses;
+            return;
+        }
+
+        // The rising edge is the marker, drive it right away.
+        output(HIGH);
+        m_High = true;
+
+        struct itimerspec fall = { { 0, 0 }, { 0, 0 } };
+        fall.it_value.tv_sec = m_SustainTime / 1000000;
+        fall.it_value.tv_nsec = (m_SustainTime % 1000000) * 1000;
+        if(fall.it_value.tv_sec == 0 && fall.it_value.tv_nsec == 0)
+        {
+            // Zero disarms a timerfd.
+            fall.it_value.tv_nsec = 1;
+        }
+        timerfd_settime(m_TimerFd, 0, &fall, nullptr);
+
+        // Keep the line LOW for as long as it was HIGH.
+        uint64_t gap = 2ull * m_SustainTime * 1000 + now.tv_nsec;
+        m_NextPulse.tv_sec = now.tv_sec + gap / 1000000000;
+        m_NextPulse.tv_nsec = gap % 1000000000;
     }
 
     /**
@@ -163,9 +241,9 @@ namespace earlyapp
      */
 
     // Create GPIO control.
-    void* GPIOControl_create(int gpioNumber, unsigned int peakSustainTime)
+    void* GPIOControl_create(int gpioNumber, unsigned int peakSustainTime, const char* marker)
     {
-        return new GPIOControl(gpioNumber, peakSustainTime);
+        return new GPIOControl(gpioNumber, peakSustainTime, marker);
     }
 
     // Release GPOI control.
@@ -68,11 +68,11 @@ namespace earlyapp
     {
         int gpioNumber = pConf->gpioNumber();
         unsigned int sustainTime = pConf->gpioSustain();
-        if(gpioNumber > 0)
+        if(gpioNumber > 0 || pConf->kpiMarkers())
         {
             LINF_(TAG, boost::str(
                       boost::format("Setting GPIO %d with default sleep time") % gpioNumber));
-            m_pGPIOCtrl = new GPIOControl(gpioNumber, sustainTime);
+            m_pGPIOCtrl = new GPIOControl(gpioNumber, sustainTime, deviceName());
         }
     }
 
@@ -82,6 +82,12 @@ namespace earlyapp
         LINF_(TAG, "preparePlay()");
     }
 
+    // Not going to be played.
+    void OutputDevice::cancelPlay(void)
+    {
+        LINF_(TAG, "cancelPlay()");
+    }
+
     // Play
     void OutputDevice::play(void)
     {
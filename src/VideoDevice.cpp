@@ -101,13 +101,48 @@ namespace earlyapp
         // Default ASync depth.
         m_Params.nAsyncDepth = 4;
 
+        // Decoded frames allowed to queue up in front of the compositor.
+        m_Params.nPresentQueueDepth = 3;
+
+        // The compositor may not be up yet, play() creates the window.
+        m_Params.bDeferRender = true;
+
+        // Show the first frame before scaling is set up, VPP follows it.
+        m_Params.bStagedInit = true;
+
+        // Keep the first frame in the cache directory for the next boot.
+        m_Params.bFrameCache = true;
+
         // Initialize decoding pipeline.
-        m_pDecPipeline->Init(&m_Params);
+        if(m_pDecPipeline->Init(&m_Params) != MFX_ERR_NONE)
+        {
+            LERR_(TAG, "Failed to initialize decoding pipeline.");
+            return;
+        }
+
+        // Start decoding now, frames are queued until the display is attached.
+        m_pDecodeThread = new boost::thread(
+            boost::bind(&CDecodingPipeline::RunDecoding, m_pDecPipeline));
 
-        
         LINF_(TAG, "VideoDevice initialized.");
     }
 
+    /*
+      Display is ready.
+     */
+    void VideoDevice::attachDisplay(void)
+    {
+        LINF_(TAG, "VideoDevice attachDisplay");
+
+        if(m_pDecPipeline == nullptr)
+            return;
+
+        if(m_pDecPipeline->AttachRenderer() != MFX_ERR_NONE)
+        {
+            LERR_(TAG, "Failed to attach display.");
+        }
+    }
+
     /*
       Play the video device.
      */
@@ -115,8 +150,42 @@ namespace earlyapp
     {
         LINF_(TAG, "VideoDevice play");
 
-        // Start decoding and display.
-        m_pDecPipeline->RunDecoding();
+        // Decoding runs since init(), wait for the rest of the video.
+        if(m_pDecodeThread == nullptr)
+        {
+            LERR_(TAG, "Decoder is not running.");
+            return;
+        }
+
+        // The window only comes up when the splash video is really shown.
+        attachDisplay();
+        joinDecoding(false);
+    }
+
+    /*
+      Not going to play.
+     */
+    void VideoDevice::cancelPlay(void)
+    {
+        LINF_(TAG, "VideoDevice cancelPlay");
+
+        joinDecoding(true);
+    }
+
+    /*
+      Join decoding thread.
+     */
+    void VideoDevice::joinDecoding(bool bAbort)
+    {
+        if(m_pDecodeThread == nullptr)
+            return;
+
+        if(bAbort)
+            m_pDecPipeline->Abort();
+
+        m_pDecodeThread->join();
+        delete m_pDecodeThread;
+        m_pDecodeThread = nullptr;
     }
 
     /*
@@ -126,6 +195,9 @@ namespace earlyapp
     {
         LINF_(TAG, "VideoDevice stop");
 
+        // Not played, the warm-started decoder is still waiting for a display.
+        joinDecoding(true);
+
         // Stop play
         if(m_pDecPipeline)
         {
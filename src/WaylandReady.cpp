@@ -0,0 +1,279 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "EALog.h"
+#include "WaylandReady.hpp"
+
+// Log tag.
+#define TAG "WAYLAND"
+
+// Bound but not yet listening: retry after this long.
+#define WAYLAND_LISTEN_RETRY_MS 1
+
+// Missed events are caught by a probe this often.
+#define WAYLAND_WATCH_TIMEOUT_MS 1000
+
+// Without inotify, probe this often.
+#define WAYLAND_WATCH_RETRY_MS 50
+
+
+namespace earlyapp
+{
+    WaylandReady& WaylandReady::getInstance(void)
+    {
+        static WaylandReady s_Instance;
+        return s_Instance;
+    }
+
+    WaylandReady::WaylandReady(void)
+    {
+        const char* pXDGEnv = getenv("XDG_RUNTIME_DIR");
+        const char* pWLDispEnv = getenv("WAYLAND_DISPLAY");
+
+        if(pWLDispEnv == nullptr)
+            pWLDispEnv = "wayland-0";
+
+        // WAYLAND_DISPLAY may be an absolute path.
+        if(pWLDispEnv[0] == '/')
+            m_SocketPath = pWLDispEnv;
+        else if(pXDGEnv != nullptr)
+            m_SocketPath = std::string(pXDGEnv) + "/" + pWLDispEnv;
+        else
+            LWRN_(TAG, "XDG_RUNTIME_DIR not defined. Not waiting for Wayland");
+    }
+
+    bool WaylandReady::probe(void) const
+    {
+        struct sockaddr_un addr;
+        int fd;
+        bool ok;
+
+        if(m_SocketPath.size() >= sizeof(addr.sun_path))
+            return false;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, m_SocketPath.c_str(), m_SocketPath.size());
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0)
+            return false;
+        ok = connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0;
+        close(fd);
+        return ok;
+    }
+
+    int WaylandReady::addWatch(int fd, std::string& watched) const
+    {
+        std::string dir = m_SocketPath.substr(0, m_SocketPath.rfind('/'));
+        std::string path = dir;
+        int wd;
+
+        while(true)
+        {
+            // In an ancestor only the creation of the next level matters.
+            uint32_t mask = (path == dir)
+                ? (IN_CREATE | IN_MOVED_TO | IN_ATTRIB) : (IN_CREATE | IN_MOVED_TO);
+            wd = inotify_add_watch(fd, path.empty() ? "/" : path.c_str(), mask);
+            if(wd >= 0 || errno != ENOENT || path.empty())
+                break;
+
+            size_t slash = path.rfind('/');
+            if(slash == std::string::npos)
+                break;
+            path.resize(slash);
+        }
+
+        watched = path;
+        return wd;
+    }
+
+    void WaylandReady::followWatch(int fd, int& wd, std::string& watched) const
+    {
+        std::string dir = m_SocketPath.substr(0, m_SocketPath.rfind('/'));
+
+        if(watched != dir)
+        {
+            // The runtime directory is not there yet: follow it down
+            // as its ancestors get created.
+            std::string closer;
+            int nwd = addWatch(fd, closer);
+            if(nwd != wd)
+                inotify_rm_watch(fd, wd);
+            wd = nwd;
+            watched = closer;
+        }
+    }
+
+    void WaylandReady::watch(void)
+    {
+        std::string watched;
+        char events[sizeof(struct inotify_event) + NAME_MAX + 1];
+        int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        int wd = -1;
+
+        LINF_(TAG, "Waiting for wayland socket: " << m_SocketPath);
+
+        while(true)
+        {
+            // Watch before probing so a socket created in between is not missed.
+            if(fd >= 0 && wd < 0)
+                wd = addWatch(fd, watched);
+            if(probe())
+                break;
+
+            if(wd < 0)
+            {
+                // No inotify, or the directory cannot be watched.
+                usleep(WAYLAND_WATCH_RETRY_MS * 1000);
+                continue;
+            }
+
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int timeout = access(m_SocketPath.c_str(), F_OK) == 0
+                ? WAYLAND_LISTEN_RETRY_MS : WAYLAND_WATCH_TIMEOUT_MS;
+            if(poll(&pfd, 1, timeout) > 0)
+            {
+                while(read(fd, events, sizeof(events)) > 0)
+                    ;
+            }
+
+            followWatch(fd, wd, watched);
+        }
+
+        // Release the waiters first, closing an inotify instance can take milliseconds.
+        setReady();
+        if(fd >= 0)
+            close(fd);
+    }
+
+    void WaylandReady::setReady(void)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Ready = true;
+        m_Cond.notify_all();
+    }
+
+    void WaylandReady::wait(void)
+    {
+        std::unique_lock<std::mutex> lock(m_Lock);
+
+        if(m_SocketPath.empty())
+            return;
+        if(m_Watching)
+        {
+            m_Cond.wait(lock, [this] { return m_Ready; });
+            return;
+        }
+        if(m_Ready)
+            return;
+
+        m_Watching = true;
+        lock.unlock();
+        watch();
+    }
+
+    bool WaylandReady::isReady(void)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        char events[sizeof(struct inotify_event) + NAME_MAX + 1];
+
+        if(m_Ready || m_SocketPath.empty())
+            return true;
+
+        if(m_PollWd >= 0)
+        {
+            bool changed = false;
+            while(read(m_PollFd, events, sizeof(events)) > 0)
+                changed = true;
+            if(!changed && !m_PollProbe)
+                return false;
+            if(changed)
+                followWatch(m_PollFd, m_PollWd, m_PollWatched);
+        }
+
+        if(!probe())
+        {
+            // Bound but not listening yet, no further event will tell.
+            m_PollProbe = access(m_SocketPath.c_str(), F_OK) == 0;
+            return false;
+        }
+        m_Ready = true;
+        m_Cond.notify_all();
+        return true;
+    }
+
+    int WaylandReady::pollFd(void)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+
+        if(m_PollFd < 0 && !m_SocketPath.empty())
+        {
+            m_PollFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+            if(m_PollFd >= 0)
+                m_PollWd = addWatch(m_PollFd, m_PollWatched);
+            if(m_PollWd < 0 && m_PollFd >= 0)
+            {
+                close(m_PollFd);
+                m_PollFd = -1;
+            }
+            // The socket may have been there before the watch.
+            m_PollProbe = true;
+        }
+        return m_PollFd;
+    }
+
+    /**
+       C interfaces.
+     */
+
+    // Block until the compositor is up.
+    void WaylandReady_wait(void)
+    {
+        WaylandReady::getInstance().wait();
+    }
+
+    // Non-blocking check.
+    int WaylandReady_isReady(void)
+    {
+        return WaylandReady::getInstance().isReady() ? 1 : 0;
+    }
+
+    // Descriptor for poll loops.
+    int WaylandReady_pollFd(void)
+    {
+        return WaylandReady::getInstance().pollFd();
+    }
+} // namespace
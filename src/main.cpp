@@ -97,6 +97,10 @@ int main(int argc, char* argv[])
     {
         return -1;
     }
+    if(! earlyapp::GPIOControl::setMarkerSink(pConf->kpiMarker()))
+    {
+        return -1;
+    }
 
 
     /*
@@ -164,16 +168,16 @@ int main(int argc, char* argv[])
     }
 
     void* gp_pGPIOClass = NULL;
-    gp_pGPIOClass = earlyapp::GPIOControl_create(pConf->gpioNumber(), pConf->gpioSustain());
+    gp_pGPIOClass = earlyapp::GPIOControl_create(pConf->gpioNumber(), pConf->gpioSustain(), "main");
 
     if (( pEv != nullptr ) && (pEv->toEnum() == earlyapp::CBCEvent::eGEARSTATUS_EGL)) {
 	void* gles_pGPIOClass = NULL;
-	if(pConf->gpioNumber() != pConf->NOT_SET)
+	if(pConf->kpiMarkers())
         {
-            gles_pGPIOClass = earlyapp::GPIOControl_create(pConf->gpioNumber(), pConf->gpioSustain());
+            gles_pGPIOClass = earlyapp::GPIOControl_create(pConf->gpioNumber(), pConf->gpioSustain(), "gles");
         }
 
-        simple_egl_main(gles_pGPIOClass);
+        simple_egl_main(gles_pGPIOClass, pConf->eglSwapInterval());
     }
 
     /*
@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2018 Intel Corporation
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+// OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// SPDX-License-Identifier: MIT
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+#include "GPIOControl.hpp"
+
+using namespace earlyapp;
+
+// Sustain time of the pulses under test in ms.
+#define SUSTAIN_MS 20
+
+static int s_Failures = 0;
+
+#define EXPECT(cond) \
+    do { \
+        if(! (cond)) \
+        { \
+            fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #cond); \
+            ++s_Failures; \
+        } \
+    } while(0)
+
+// Milliseconds between two line changes.
+static long elapsedMs(const struct timespec& from, const struct timespec& to)
+{
+    return (to.tv_sec - from.tv_sec) * 1000 + (to.tv_nsec - from.tv_nsec) / 1000000;
+}
+
+// One pulse: HIGH right away, LOW after the sustain time.
+static void testPulse(void)
+{
+    MockGPIOBackend* pMock = new MockGPIOBackend();
+    GPIOControl gpio(std::unique_ptr<GPIOBackend>(pMock), SUSTAIN_MS);
+
+    gpio.outputPattern();
+    std::vector<MockGPIOBackend::Transition> t = pMock->transitions();
+    EXPECT(t.size() == 1 && t[0].high);
+
+    usleep(SUSTAIN_MS * 3 * 1000);
+    t = pMock->transitions();
+    EXPECT(t.size() == 2);
+    if(t.size() == 2)
+    {
+        EXPECT(! t[1].high);
+        EXPECT(elapsedMs(t[0].time, t[1].time) >= SUSTAIN_MS);
+    }
+    EXPECT(gpio.droppedPulses() == 0);
+}
+
+// Requests during a pulse or the LOW gap after it are dropped.
+static void testDropped(void)
+{
+    MockGPIOBackend* pMock = new MockGPIOBackend();
+    GPIOControl gpio(std::unique_ptr<GPIOBackend>(pMock), SUSTAIN_MS);
+
+    gpio.outputPattern();
+    gpio.outputPattern();
+    EXPECT(gpio.droppedPulses() == 1);
+
+    // LOW again but still within the gap.
+    usleep(SUSTAIN_MS * 3 / 2 * 1000);
+    gpio.outputPattern();
+    EXPECT(gpio.droppedPulses() == 2);
+
+    // Past the gap a new pulse goes out.
+    usleep(SUSTAIN_MS * 2 * 1000);
+    gpio.outputPattern();
+    EXPECT(gpio.droppedPulses() == 2);
+    std::vector<MockGPIOBackend::Transition> t = pMock->transitions();
+    EXPECT(t.size() == 3 && t[2].high);
+}
+
+// Hands its line changes over when the control deletes it.
+class KeptMockGPIOBackend : public MockGPIOBackend
+{
+public:
+    KeptMockGPIOBackend(std::vector<Transition>& kept) : m_Kept(kept) { }
+    virtual ~KeptMockGPIOBackend(void) { m_Kept = transitions(); }
+
+private:
+    std::vector<Transition>& m_Kept;
+};
+
+// The destructor leaves the line LOW mid-pulse.
+static void testDestroyMidPulse(void)
+{
+    std::vector<MockGPIOBackend::Transition> t;
+    {
+        GPIOControl gpio(std::unique_ptr<GPIOBackend>(new KeptMockGPIOBackend(t)), 1000);
+        gpio.outputPattern();
+    }
+    EXPECT(t.size() == 2 && t[0].high && ! t[1].high);
+}
+
+int main(void)
+{
+    testPulse();
+    testDropped();
+    testDestroyMidPulse();
+
+    if(s_Failures)
+    {
+        fprintf(stderr, "%d check(s) failed\n", s_Failures);
+        return 1;
+    }
+    printf("All GPIOControl checks passed\n");
+    return 0;
+}